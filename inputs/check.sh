@@ -0,0 +1,143 @@
+#!/bin/sh
+# Behaviour checks for the simulator: make check (src/Makefile) and ctest run this.
+#
+#   check.sh <mu-mips> <mu-mips-image>
+#
+# Every program here is run in each of its forms (hex text, assembly source, little- and
+# big-endian ELF executables and the images mu-mips-image makes of them) on each engine,
+# and all of them must end in the same state. A program with a .expected file must also
+# print each of its lines. The cache and branch predictor models, sampling and checkpoint
+# resume must not change the state either, and jit-verify must print and profile a run just
+# as the block engine does. The JIT must go on compiling when its code cache fills up.
+# data-le.elf and data-be.elf are data.in and data.data linked at MEM_TEXT_BEGIN and
+# MEM_DATA_BEGIN with 8188 bytes of bss after the data and the symbols main, loop, table
+# and total.
+
+if [ $# -ne 2 ]; then
+    echo "Usage: $0 <mu-mips> <mu-mips-image>"
+    exit 1
+fi
+SIM=$1
+IMAGE=$2
+INPUTS=$(dirname "$0")
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+fail() {
+    echo "FAIL: $*"
+    FAILED=1
+}
+
+# run <output> <program> [options]: the final state, without the statistics
+run() {
+    out=$1
+    shift
+    "$SIM" --run "$@" --mem 10010000:10010010 | grep -E '^(status|instructions|pc|r[0-9]+|hi|lo|mem) ' > "$out"
+}
+
+# image <image> <program> [mu-mips-image options]
+image() {
+    img=$1
+    program=$2
+    shift 2
+    "$IMAGE" "$@" -o "$img" "$program" > "$WORK/image.log" || fail "mu-mips-image $program: $(cat "$WORK/image.log")"
+}
+
+ENGINES="interp block pipeline"
+if "$SIM" --run "$INPUTS/test1.in" --engine jit > /dev/null 2>&1; then
+    ENGINES="$ENGINES jit"
+fi
+
+# check <name> <form>...: every form on every engine ends like the first on interp
+check() {
+    name=$1
+    shift
+    run "$WORK/$name.state" "$1" --engine interp
+    for form in "$@"; do
+        for engine in $ENGINES; do
+            run "$WORK/state" "$form" --engine "$engine"
+            cmp -s "$WORK/state" "$WORK/$name.state" || fail "$name: $(basename "$form") on $engine differs from $(basename "$1") on interp"
+        done
+    done
+    if [ -f "$INPUTS/$name.expected" ]; then
+        while read -r line; do
+            grep -qxF "$line" "$WORK/$name.state" || fail "$name: expected \"$line\""
+        done < "$INPUTS/$name.expected"
+    fi
+}
+
+for name in test1 test2 test3 loop; do
+    image "$WORK/$name.img" "$INPUTS/$name.in"
+    forms="$INPUTS/$name.in $WORK/$name.img"
+    if [ -f "$INPUTS/$name.s" ]; then
+        image "$WORK/$name-s.img" "$INPUTS/$name.s"
+        forms="$forms $INPUTS/$name.s $WORK/$name-s.img"
+    fi
+    check $name $forms
+done
+
+image "$WORK/data.img" "$INPUTS/data.in" -d "10010000:$INPUTS/data.data"
+image "$WORK/data-s.img" "$INPUTS/data.s"
+image "$WORK/data-le.img" "$INPUTS/data-le.elf"
+image "$WORK/data-be.img" "$INPUTS/data-be.elf"
+check data "$INPUTS/data.s" "$INPUTS/data-le.elf" "$INPUTS/data-be.elf" \
+    "$WORK/data.img" "$WORK/data-s.img" "$WORK/data-le.img" "$WORK/data-be.img"
+
+for source in "$INPUTS"/pseudo-*.s; do
+    name=$(basename "$source" .s)
+    image "$WORK/$name.img" "$source"
+    check $name "$source" "$WORK/$name.img"
+done
+
+# the timing models and sampling only time the run
+for name in loop data pseudo-jump; do
+    # the first form that has the data segment
+    for program in "$INPUTS/$name.s" "$INPUTS/$name-le.elf" "$INPUTS/$name.in"; do
+        [ -f "$program" ] && break
+    done
+    for options in "--engine pipeline --cache on" "--engine pipeline --bpred tournament" \
+                   "--engine interp --bpred gshare" "--engine block --sample 10000:100:200:300"; do
+        run "$WORK/state" "$program" $options
+        cmp -s "$WORK/state" "$WORK/$name.state" || fail "$name: $options changes the final state"
+    done
+done
+
+# jit-verify replays native code on the interpreter, and the replay must not print or profile
+# again; every division by zero in divzero.s prints a line
+case "$ENGINES" in
+*jit*)
+    for engine in block jit-verify; do
+        "$SIM" --run "$INPUTS/divzero.s" --engine $engine --bbv "$WORK/$engine.bbv" --bbv-interval 50 |
+            grep -v '^jit_' > "$WORK/$engine.out"
+    done
+    cmp -s "$WORK/jit-verify.out" "$WORK/block.out" || fail "divzero: jit-verify prints differently from block"
+    cmp -s "$WORK/jit-verify.bbv" "$WORK/block.bbv" || fail "divzero: jit-verify profiles differently from block"
+
+    # a full code cache is emptied and compiling goes on: 10400 bytes, the smallest cache,
+    # holds one block, so jit-flush.s's two loops compile on each of their three turns
+    run "$WORK/jit-flush.state" "$INPUTS/jit-flush.s" --engine interp
+    run "$WORK/state" "$INPUTS/jit-flush.s" --engine jit --jit-cache 10400
+    cmp -s "$WORK/state" "$WORK/jit-flush.state" || fail "jit-flush: a full code cache changes the final state"
+    "$SIM" --run "$INPUTS/jit-flush.s" --engine jit --jit-cache 10400 > "$WORK/jit.out"
+    grep -qx "jit_blocks 6" "$WORK/jit.out" && grep -qx "jit_flushes 5" "$WORK/jit.out" ||
+        fail "jit-flush: compiling stopped when the code cache filled ($(grep '^jit_' "$WORK/jit.out" | paste -sd ' ' -))"
+    ;;
+esac
+
+# a run stopped at a limit and started again from its checkpoint ends like an unbroken one
+"$SIM" --run "$INPUTS/loop.in" --checkpoint "$WORK/loop.ckpt" --every 100000 --max 1000000 > /dev/null
+[ $? -eq 2 ] || fail "loop: --max did not stop the checkpointed run"
+run "$WORK/state" "$INPUTS/loop.in" --checkpoint "$WORK/loop.ckpt" --every 100000
+cmp -s "$WORK/state" "$WORK/loop.state" || fail "loop: resuming from a checkpoint changes the final state"
+
+# a count that is not a 32-bit number is refused, not wrapped
+for count in "" -1 4294967296 99999999999999999999; do
+    "$SIM" --run "$INPUTS/loop.in" --max "$count" > /dev/null
+    [ $? -eq 1 ] || fail "--max \"$count\" was not refused"
+done
+
+if [ $FAILED -ne 0 ]; then
+    exit 1
+fi
+echo "All checks passed"
@@ -0,0 +1,23 @@
+# Sums a table of data words into the word after it and reads the result, the last table
+# word and a word of the zeroed space further on back into registers; every form of this
+# program (data.in with data.data, the ELF files, images) must end in the same state
+        .data
+table:  .word   0x11223344, 0xdeadbeef, 0x00000001, 0x80000000
+total:  .word   0
+        .space  8188
+        .text
+main:   lui     $s0, 0x1001
+        addiu   $t1, $zero, 4
+        addu    $t2, $zero, $zero
+        addu    $t0, $s0, $zero
+loop:   lw      $t3, 0($t0)
+        addu    $t2, $t2, $t3
+        addiu   $t0, $t0, 4
+        addiu   $t1, $t1, -1
+        bne     $t1, $zero, loop
+        sw      $t2, 16($s0)
+        lw      $s1, 16($s0)
+        lw      $s2, 12($s0)
+        lw      $s3, 4096($s0)
+        xor     $s4, $s1, $s2
+        syscall
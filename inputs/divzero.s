@@ -0,0 +1,8 @@
+# a division by zero in a hot block: each one prints "Result is undefined" and leaves HI and LO
+        .text
+main:   li      $t0, 100
+        li      $t1, 7
+loop:   div     $t1, $zero
+        addiu   $t0, $t0, -1
+        bnez    $t0, loop
+        syscall
@@ -0,0 +1,15 @@
+# two hot loops taking turns, three times over: with a code cache that holds one block at a
+# time, each loop is compiled again every time it comes round
+        .text
+main:   li      $s0, 3
+outer:  li      $t0, 20
+first:  addiu   $s1, $s1, 1
+        addiu   $t0, $t0, -1
+        bnez    $t0, first
+        li      $t0, 20
+second: addiu   $s2, $s2, 2
+        addiu   $t0, $t0, -1
+        bnez    $t0, second
+        addiu   $s0, $s0, -1
+        bnez    $s0, outer
+        syscall
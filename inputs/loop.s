@@ -0,0 +1,10 @@
+# loop.in in source form: adds 0x80000 down to 1 into the first data word
+        .text
+main:   lui     $at, 0x1001
+        lui     $t0, 0x0008
+loop:   lw      $t2, 0($at)
+        addu    $t2, $t2, $t0
+        sw      $t2, 0($at)
+        addiu   $t0, $t0, -1
+        bne     $t0, $zero, loop
+        syscall
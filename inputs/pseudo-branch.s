@@ -0,0 +1,39 @@
+# b, beqz, bnez, blt, bgt, ble and bge: $s0 counts the branches taken, $s1 the ones that
+# fell through, and nothing should land in $s7 ($t0 < $t1; SLT compares unsigned here)
+        .text
+main:   li      $t0, 1
+        li      $t1, 2
+        b       l1
+        addiu   $s7, $s7, 1
+l1:     addiu   $s0, $s0, 1
+        beqz    $t1, bad
+        addiu   $s1, $s1, 1
+        beqz    $zero, l2
+        addiu   $s7, $s7, 1
+l2:     addiu   $s0, $s0, 1
+        bnez    $zero, bad
+        addiu   $s1, $s1, 1
+        bnez    $t0, l3
+        addiu   $s7, $s7, 1
+l3:     addiu   $s0, $s0, 1
+        blt     $t1, $t0, bad
+        addiu   $s1, $s1, 1
+        blt     $t0, $t1, l4
+        addiu   $s7, $s7, 1
+l4:     addiu   $s0, $s0, 1
+        bgt     $t0, $t1, bad
+        addiu   $s1, $s1, 1
+        bgt     $t1, $t0, l5
+        addiu   $s7, $s7, 1
+l5:     addiu   $s0, $s0, 1
+        ble     $t1, $t0, bad
+        addiu   $s1, $s1, 1
+        ble     $t1, $t1, l6
+        addiu   $s7, $s7, 1
+l6:     addiu   $s0, $s0, 1
+        bge     $t0, $t1, bad
+        addiu   $s1, $s1, 1
+        bge     $t0, $t0, l7
+bad:    addiu   $s7, $s7, 1
+l7:     addiu   $s0, $s0, 1
+        syscall
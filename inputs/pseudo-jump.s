@@ -0,0 +1,14 @@
+# j and jal: calls twice a routine that doubles $a0, then jumps over a trap
+        .text
+main:   li      $a0, 3
+        jal     double
+        nop
+        jal     double
+        nop
+        move    $s0, $v0
+        j       done
+        li      $s7, 1
+double: addu    $v0, $a0, $a0
+        move    $a0, $v0
+        jr      $ra
+done:   syscall
@@ -0,0 +1,15 @@
+# loads and stores of a label, a label and offset, and an absolute address
+        .data
+first:  .word   0x11111111
+second: .word   0x22222222
+third:  .word   0
+        .text
+main:   lw      $t0, first
+        lw      $t1, second
+        addu    $t2, $t0, $t1
+        sw      $t2, third
+        lw      $s0, first+8
+        li      $t3, 0x44
+        sw      $t3, 0x10010010
+        lw      $s1, 0x10010010
+        syscall
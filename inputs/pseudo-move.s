@@ -0,0 +1,16 @@
+# nop, move, not, neg, negu, li and la
+        .data
+word:   .word   7
+        .text
+main:   nop
+        li      $t0, 5
+        li      $t1, -2
+        li      $t2, 0x12345678
+        li      $t3, 0xffff
+        move    $t4, $t2
+        not     $t5, $t0
+        neg     $t6, $t0
+        negu    $t7, $t1
+        la      $s0, word
+        la      $s1, word+8
+        syscall
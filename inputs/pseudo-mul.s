@@ -0,0 +1,9 @@
+# mul, the low word of the product (it goes through LO)
+        .text
+main:   li      $t0, 1000
+        li      $t1, -3
+        li      $t2, 0x10001
+        mul     $s0, $t0, $t1
+        mul     $s1, $t2, $t2
+        mul     $s2, $t1, $t1
+        syscall
@@ -0,0 +1,1094 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "mu-asm.h"
+#include "mu-mem.h"
+#include "mu-decode.h"
+
+/************************************************************/
+/* Two-pass assembler                                                                                             */
+/*                                                                                                                               */
+/* The first pass reads the source once, storing each instruction and data item      */
+/* straight into guest memory and noting every field that refers to a label; the       */
+/* second pass fills those fields in, once every label has its address.                     */
+/************************************************************/
+
+#define NO_SYMBOL 0xFFFFFFFF
+#define REG_ZERO 0
+#define REG_AT   1
+#define REG_RA   31
+
+/* the instruction word of op (an op id) with the given fields */
+#define R_TYPE(op, rs, rt, rd, sa) (OP_WORDS[op] | ((rs) << 21) | ((rt) << 16) | ((rd) << 11) | ((sa) << 6))
+#define I_TYPE(op, rs, rt, im) (OP_WORDS[op] | ((rs) << 21) | ((rt) << 16) | ((im) & 0xFFFF))
+
+/* the operands of an instruction, FORMAT_* named after the MIPS_ISA operands */
+typedef enum {
+    FORMAT_RD_RS_RT,        /* add rd, rs, rt */
+    FORMAT_RS_RT,           /* mult rs, rt */
+    FORMAT_RD_RT_SA,        /* sll rd, rt, sa */
+    FORMAT_RS,              /* jr rs */
+    FORMAT_RD,              /* mflo rd */
+    FORMAT_JALR,            /* jalr [rd,] rs */
+    FORMAT_NONE,            /* syscall */
+    FORMAT_RT_RS_IMM,       /* addi rt, rs, -32768..32767 or andi rt, rs, 0..65535 */
+    FORMAT_RT_IMM,          /* lui rt, 0..65535 */
+    FORMAT_MEMORY,          /* lw rt, offset(rs) or lw rt, label */
+    FORMAT_BRANCH_RS_RT,    /* beq rs, rt, label */
+    FORMAT_BRANCH_RS,       /* blez rs, label */
+    PSEUDO_NOP,
+    PSEUDO_MOVE,            /* move rd, rs */
+    PSEUDO_NOT,             /* not rd, rs */
+    PSEUDO_NEG,             /* neg rd, rs */
+    PSEUDO_LI,              /* li rt, value or la rt, label */
+    PSEUDO_MUL,             /* mul rd, rs, rt */
+    PSEUDO_B,               /* b label */
+    PSEUDO_BRANCH_ZERO,     /* beqz rs, label */
+    PSEUDO_BRANCH_COMPARE,  /* blt rs, rt, label */
+    PSEUDO_J,               /* j label */
+    PSEUDO_JAL              /* jal label */
+} asm_format_t;
+
+/* PSEUDO_BRANCH_COMPARE: the branch taken on the slt result, with the operands swapped if SWAP is set */
+#define SWAP 0x80
+
+typedef struct {
+    const char *name;       /* upper case */
+    uint8_t format;         /* asm_format_t */
+    uint8_t op;             /* op id of the instruction, or the one a pseudo-instruction varies */
+} asm_op_t;
+
+#define ASM_OP(name, class, code, operands, immediate) { #name, FORMAT_##operands, OP_##name },
+static const asm_op_t OPS[] = {
+    MIPS_ISA(ASM_OP)
+    { "NOP", PSEUDO_NOP, 0 },
+    { "MOVE", PSEUDO_MOVE, 0 },
+    { "NOT", PSEUDO_NOT, 0 },
+    { "NEG", PSEUDO_NEG, OP_SUB }, { "NEGU", PSEUDO_NEG, OP_SUBU },
+    { "LI", PSEUDO_LI, 0 }, { "LA", PSEUDO_LI, 0 },
+    { "MUL", PSEUDO_MUL, 0 },
+    { "B", PSEUDO_B, 0 },
+    { "BEQZ", PSEUDO_BRANCH_ZERO, OP_BEQ }, { "BNEZ", PSEUDO_BRANCH_ZERO, OP_BNE },
+    { "BLT", PSEUDO_BRANCH_COMPARE, OP_BNE }, { "BGT", PSEUDO_BRANCH_COMPARE, SWAP | OP_BNE },
+    { "BLE", PSEUDO_BRANCH_COMPARE, SWAP | OP_BEQ }, { "BGE", PSEUDO_BRANCH_COMPARE, OP_BEQ },
+    { "J", PSEUDO_J, 0 }, { "JAL", PSEUDO_JAL, 0 }
+};
+#undef ASM_OP
+
+#define NUM_OPS_ASM (sizeof(OPS) / sizeof(OPS[0]))
+#define OP_SLOTS 256        /* power of two, well above NUM_OPS_ASM */
+#define MAX_MNEMONIC 8
+
+/* how a field is filled in from an address */
+typedef enum {
+    FIX_WORD,               /* the whole word */
+    FIX_BRANCH,             /* offset in words from the branch */
+    FIX_HI,                 /* upper half, for lui + ori */
+    FIX_HI_ADJUSTED,        /* upper half, for lui + a sign extended offset */
+    FIX_LO                  /* lower half */
+} asm_fix_t;
+
+typedef struct {
+    const char *name;       /* in the source */
+    uint32_t length;
+    uint32_t hash;
+    uint32_t address;
+    uint32_t line;          /* where it was defined, 0 while it is only referred to */
+} asm_symbol_t;
+
+/* a field of the word at address that the second pass fills in */
+typedef struct {
+    uint32_t address;
+    uint32_t symbol;
+    uint32_t addend;
+    uint32_t line;
+    uint32_t kind;          /* asm_fix_t */
+} asm_fixup_t;
+
+/* an operand: symbol + value, or just value when symbol is NO_SYMBOL */
+typedef struct {
+    int64_t value;
+    uint32_t symbol;
+} asm_value_t;
+
+#define SECTION_TEXT 0
+#define SECTION_DATA 1
+
+typedef struct {
+    const char *name;
+    uint32_t address;       /* where the next item goes */
+    uint32_t run_start;     /* address when the section last became current */
+    uint32_t begin, end;    /* extent of everything emitted so far */
+    int used;
+    uint32_t region_begin, region_end;
+    uint32_t flags;         /* SEGMENT_* */
+} asm_section_t;
+
+typedef struct {
+    const char *p, *eol;    /* rest of the line being assembled */
+    uint32_t line;
+    asm_section_t sections[2];
+    asm_section_t *section;
+    asm_symbol_t *symbols;
+    uint32_t symbol_count, symbol_capacity;
+    uint32_t *buckets;      /* symbol index + 1 by name hash, 0 for none */
+    uint32_t bucket_count;  /* a power of two */
+    uint32_t *pending;      /* labels that take the address of the next item */
+    uint32_t pending_count, pending_capacity;
+    asm_fixup_t *fixups;
+    uint32_t fixup_count, fixup_capacity;
+    uint8_t ops[OP_SLOTS];  /* OPS index + 1 by mnemonic hash, 0 for none */
+    uint8_t *page;          /* page last stored to */
+    uint32_t page_address;
+    char *error;
+    size_t error_size;
+} assembler_t;
+
+/***************************************************************/
+/* Errors                                                                                                                   */
+/***************************************************************/
+static int fail(assembler_t *as, uint32_t line, const char *format, ...) {
+    va_list args;
+    int n = snprintf(as->error, as->error_size, "line %u: ", line);
+
+    if (n >= 0 && (size_t) n < as->error_size) {
+        va_start(args, format);
+        vsnprintf(as->error + n, as->error_size - n, format, args);
+        va_end(args);
+    }
+    return -1;
+}
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline int is_name_start(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '.';
+}
+
+static inline int is_name_char(char c) {
+    return is_name_start(c) || is_digit(c) || c == '$';
+}
+
+/* skip blanks and a comment */
+static inline void skip_space(assembler_t *as) {
+    while (as->p < as->eol && is_space(*as->p)) {
+        as->p++;
+    }
+    if (as->p < as->eol && *as->p == '#') {
+        as->p = as->eol;
+    }
+}
+
+static int expected(assembler_t *as, const char *what) {
+    uint32_t length = 0;
+
+    skip_space(as);
+    if (as->p == as->eol) {
+        return fail(as, as->line, "expected %s", what);
+    }
+    while (as->p + length < as->eol && !is_space(as->p[length]) && as->p[length] != ',' && length < 32) {
+        length++;
+    }
+    return fail(as, as->line, "expected %s at '%.*s'", what, length ? (int) length : 1, as->p);
+}
+
+static int expect(assembler_t *as, char c, const char *what) {
+    skip_space(as);
+    if (as->p == as->eol || *as->p != c) {
+        return expected(as, what);
+    }
+    as->p++;
+    return 0;
+}
+
+static void *grow(void *array, uint32_t *capacity, size_t size) {
+    *capacity = *capacity ? 2 * *capacity : 64;
+    array = realloc(array, *capacity * size);
+    if (array == NULL) {
+        printf("Error: Out of memory assembling\n");
+        exit(-1);
+    }
+    return array;
+}
+
+/***************************************************************/
+/* Symbols                                                                                                               */
+/***************************************************************/
+static uint32_t name_hash(const char *name, uint32_t length) {
+    uint32_t hash = 2166136261u;
+
+    while (length-- > 0) {
+        hash = (hash ^ (uint8_t) *name++) * 16777619u;
+    }
+    return hash;
+}
+
+/* index of the symbol called name; an unknown one is added if create is set, else NO_SYMBOL */
+static uint32_t find_symbol(assembler_t *as, const char *name, uint32_t length, int create) {
+    uint32_t hash = name_hash(name, length), slot, i;
+    asm_symbol_t *s;
+
+    if (2 * (as->symbol_count + 1) > as->bucket_count) {
+        free(as->buckets);
+        as->bucket_count = as->bucket_count ? 2 * as->bucket_count : 256;
+        as->buckets = calloc(as->bucket_count, sizeof(uint32_t));
+        if (as->buckets == NULL) {
+            printf("Error: Out of memory assembling\n");
+            exit(-1);
+        }
+        for (i = 0; i < as->symbol_count; i++) {
+            slot = as->symbols[i].hash & (as->bucket_count - 1);
+            while (as->buckets[slot] != 0) {
+                slot = (slot + 1) & (as->bucket_count - 1);
+            }
+            as->buckets[slot] = i + 1;
+        }
+    }
+    slot = hash & (as->bucket_count - 1);
+    while ((i = as->buckets[slot]) != 0) {
+        s = &as->symbols[i - 1];
+        if (s->hash == hash && s->length == length && memcmp(s->name, name, length) == 0) {
+            return i - 1;
+        }
+        slot = (slot + 1) & (as->bucket_count - 1);
+    }
+    if (!create) {
+        return NO_SYMBOL;
+    }
+    if (as->symbol_count == as->symbol_capacity) {
+        as->symbols = grow(as->symbols, &as->symbol_capacity, sizeof(asm_symbol_t));
+    }
+    s = &as->symbols[as->symbol_count];
+    s->name = name;
+    s->length = length;
+    s->hash = hash;
+    s->address = 0;
+    s->line = 0;
+    as->buckets[slot] = ++as->symbol_count;
+    return as->symbol_count - 1;
+}
+
+static int define_label(assembler_t *as, const char *name, uint32_t length) {
+    uint32_t i = find_symbol(as, name, length, 1);
+
+    if (as->symbols[i].line != 0) {
+        return fail(as, as->line, "label '%.*s' is already defined on line %u", (int) length, name, as->symbols[i].line);
+    }
+    as->symbols[i].line = as->line;
+    if (as->pending_count == as->pending_capacity) {
+        as->pending = grow(as->pending, &as->pending_capacity, sizeof(uint32_t));
+    }
+    as->pending[as->pending_count++] = i;
+    return 0;
+}
+
+/* give the labels waiting for an item the address it goes to */
+static void bind_labels(assembler_t *as) {
+    uint32_t i;
+
+    for (i = 0; i < as->pending_count; i++) {
+        as->symbols[as->pending[i]].address = as->section->address;
+    }
+    as->pending_count = 0;
+}
+
+/***************************************************************/
+/* Operands                                                                                                              */
+/***************************************************************/
+/* $0..$31 or the register's conventional name */
+static int register_number(const char *name, uint32_t length) {
+    int digit = length == 2 ? name[1] - '0' : -1;
+
+    if (length == 4 && memcmp(name, "zero", 4) == 0) {
+        return 0;
+    }
+    if (length != 2) {
+        return -1;
+    }
+    switch (name[0]) {
+        case 'a':
+            return name[1] == 't' ? 1 : digit >= 0 && digit <= 3 ? 4 + digit : -1;
+        case 'v':
+            return digit >= 0 && digit <= 1 ? 2 + digit : -1;
+        case 't':
+            return digit >= 0 && digit <= 7 ? 8 + digit : digit >= 8 && digit <= 9 ? 24 + digit - 8 : -1;
+        case 's':
+            return name[1] == 'p' ? 29 : digit >= 0 && digit <= 7 ? 16 + digit : digit == 8 ? 30 : -1;
+        case 'k':
+            return digit >= 0 && digit <= 1 ? 26 + digit : -1;
+        case 'g':
+            return name[1] == 'p' ? 28 : -1;
+        case 'f':
+            return name[1] == 'p' ? 30 : -1;
+        case 'r':
+            return name[1] == 'a' ? 31 : -1;
+    }
+    return -1;
+}
+
+static int parse_register(assembler_t *as, uint32_t *r) {
+    const char *name;
+    int number = 0;
+
+    skip_space(as);
+    if (as->p == as->eol || *as->p != '$') {
+        return expected(as, "a register");
+    }
+    name = ++as->p;
+    while (as->p < as->eol && is_name_char(*as->p) && *as->p != '$') {
+        as->p++;
+    }
+    if (as->p > name && is_digit(*name)) {
+        while (name < as->p && is_digit(*name) && number < 32) {
+            number = 10 * number + *name++ - '0';
+        }
+        if (name < as->p || number > 31) {
+            number = -1;
+        }
+    } else {
+        number = register_number(name, as->p - name);
+    }
+    if (number < 0) {
+        return fail(as, as->line, "unknown register '$%.*s'", (int) (as->p - name), name);
+    }
+    *r = number;
+    return 0;
+}
+
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+/* an escape sequence after the backslash, or a plain character */
+static int parse_char(assembler_t *as, uint8_t *c) {
+    if (as->p == as->eol) {
+        return expected(as, "a character");
+    }
+    if (*as->p != '\\') {
+        *c = *as->p++;
+        return 0;
+    }
+    if (++as->p == as->eol) {
+        return expected(as, "an escape sequence");
+    }
+    switch (*as->p++) {
+        case 'n': *c = '\n'; break;
+        case 't': *c = '\t'; break;
+        case 'r': *c = '\r'; break;
+        case '0': *c = '\0'; break;
+        case '\\': *c = '\\'; break;
+        case '\'': *c = '\''; break;
+        case '"': *c = '"'; break;
+        default:
+            return fail(as, as->line, "unknown escape sequence '\\%c'", as->p[-1]);
+    }
+    return 0;
+}
+
+static int parse_number(assembler_t *as, int64_t *value) {
+    uint64_t v = 0;
+    uint8_t c;
+    int digits = 0;
+
+    if (*as->p == '\'') {
+        as->p++;
+        if (parse_char(as, &c) != 0 || expect(as, '\'', "a closing quote") != 0) {
+            return -1;
+        }
+        *value = c;
+        return 0;
+    }
+    if (as->eol - as->p > 2 && as->p[0] == '0' && (as->p[1] | 0x20) == 'x' && hex_digit(as->p[2]) >= 0) {
+        for (as->p += 2; as->p < as->eol && hex_digit(*as->p) >= 0 && v <= 0xFFFFFFFF; digits++) {
+            v = (v << 4) | hex_digit(*as->p++);
+        }
+    } else {
+        for (; as->p < as->eol && is_digit(*as->p) && v <= 0xFFFFFFFF; digits++) {
+            v = 10 * v + *as->p++ - '0';
+        }
+    }
+    if (v > 0xFFFFFFFF || (as->p < as->eol && is_name_char(*as->p))) {
+        return expected(as, "a 32-bit number");
+    }
+    *value = v;
+    return 0;
+}
+
+/* [-] term { +|- term }, where a term is a number or a label; at most one label, added */
+static int parse_value(assembler_t *as, asm_value_t *v) {
+    const char *name;
+    int64_t term = 0;
+    int negative = 0;
+
+    v->value = 0;
+    v->symbol = NO_SYMBOL;
+    skip_space(as);
+    if (as->p < as->eol && (*as->p == '-' || *as->p == '+')) {
+        negative = *as->p++ == '-';
+    }
+    while (1) {
+        skip_space(as);
+        if (as->p < as->eol && (is_digit(*as->p) || *as->p == '\'')) {
+            if (parse_number(as, &term) != 0) {
+                return -1;
+            }
+        } else if (as->p < as->eol && is_name_start(*as->p)) {
+            name = as->p;
+            while (as->p < as->eol && is_name_char(*as->p)) {
+                as->p++;
+            }
+            if (v->symbol != NO_SYMBOL || negative) {
+                return fail(as, as->line, "a value can only add one label");
+            }
+            v->symbol = find_symbol(as, name, as->p - name, 1);
+            term = 0;
+        } else {
+            return expected(as, "a number or label");
+        }
+        v->value += negative ? -term : term;
+        skip_space(as);
+        if (as->p == as->eol || (*as->p != '+' && *as->p != '-')) {
+            break;
+        }
+        negative = *as->p++ == '-';
+    }
+    if (v->value < -0x80000000LL || v->value > 0xFFFFFFFFLL) {
+        return fail(as, as->line, "value does not fit in 32 bits");
+    }
+    return 0;
+}
+
+static int parse_constant(assembler_t *as, int64_t *value, int64_t min, int64_t max) {
+    asm_value_t v;
+
+    if (parse_value(as, &v) != 0) {
+        return -1;
+    }
+    if (v.symbol != NO_SYMBOL) {
+        return fail(as, as->line, "expected a number, not a label");
+    }
+    if (v.value < min || v.value > max) {
+        return fail(as, as->line, "%lld is out of range (%lld to %lld)", (long long) v.value, (long long) min, (long long) max);
+    }
+    *value = v.value;
+    return 0;
+}
+
+/***************************************************************/
+/* Guest memory                                                                                                    */
+/***************************************************************/
+static uint8_t *guest_bytes(assembler_t *as, uint32_t address) {
+    if (as->page == NULL || (address & ~PAGE_MASK) != as->page_address) {
+        as->page = mem_page_for_write(address);
+        as->page_address = address & ~PAGE_MASK;
+    }
+    return as->page + (address & PAGE_MASK);
+}
+
+/* check that bytes more fit in the current section's region */
+static int reserve(assembler_t *as, uint64_t bytes) {
+    asm_section_t *s = as->section;
+
+    if (bytes > 0 && (s->address < s->region_begin || s->address + bytes - 1 > s->region_end)) {
+        return fail(as, as->line, "%s runs past the end of its memory region", s->name);
+    }
+    return 0;
+}
+
+static int align(assembler_t *as, uint32_t alignment) {
+    uint64_t address = ((uint64_t) as->section->address + alignment - 1) & ~(uint64_t) (alignment - 1);
+
+    if (address > as->section->region_end + 1ull) {
+        return fail(as, as->line, "%s runs past the end of its memory region", as->section->name);
+    }
+    as->section->address = address;
+    return 0;
+}
+
+static int emit_byte(assembler_t *as, uint8_t byte) {
+    if (reserve(as, 1) != 0) {
+        return -1;
+    }
+    *guest_bytes(as, as->section->address++) = byte;
+    return 0;
+}
+
+static int emit_word(assembler_t *as, uint32_t word) {
+    uint8_t *p;
+
+    if (reserve(as, 4) != 0) {
+        return -1;
+    }
+    p = guest_bytes(as, as->section->address);
+    p[0] = word & 0xFF;
+    p[1] = (word >> 8) & 0xFF;
+    p[2] = (word >> 16) & 0xFF;
+    p[3] = (word >> 24) & 0xFF;
+    as->section->address += 4;
+    return 0;
+}
+
+/* fill in a field of the word at address */
+static int patch(assembler_t *as, uint32_t kind, uint32_t address, uint32_t value, uint32_t line) {
+    uint8_t *p = guest_bytes(as, address);
+    uint32_t word = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+    int32_t offset;
+
+    switch (kind) {
+        case FIX_WORD:
+            word = value;
+            break;
+        case FIX_BRANCH:
+            /* counted from the branch itself, as the simulator executes branches */
+            offset = (int32_t) (value - address);
+            if ((offset & 3) != 0 || offset < -0x20000 || offset > 0x1FFFC) {
+                return fail(as, line, "branch target 0x%08x is %s", value, (offset & 3) ? "not word aligned" : "out of reach");
+            }
+            word |= (offset >> 2) & 0xFFFF;
+            break;
+        case FIX_HI:
+            word |= value >> 16;
+            break;
+        case FIX_HI_ADJUSTED:
+            word |= ((value + 0x8000) >> 16) & 0xFFFF;
+            break;
+        case FIX_LO:
+            word |= value & 0xFFFF;
+            break;
+    }
+    p[0] = word & 0xFF;
+    p[1] = (word >> 8) & 0xFF;
+    p[2] = (word >> 16) & 0xFF;
+    p[3] = (word >> 24) & 0xFF;
+    return 0;
+}
+
+/* emit a word with a field taken from v: filled in now if v is a number, else by the second pass */
+static int emit_field(assembler_t *as, uint32_t word, uint32_t kind, const asm_value_t *v) {
+    uint32_t address = as->section->address;
+    asm_fixup_t *f;
+
+    if (emit_word(as, word) != 0) {
+        return -1;
+    }
+    if (v->symbol == NO_SYMBOL) {
+        return patch(as, kind, address, (uint32_t) v->value, as->line);
+    }
+    if (as->fixup_count == as->fixup_capacity) {
+        as->fixups = grow(as->fixups, &as->fixup_capacity, sizeof(asm_fixup_t));
+    }
+    f = &as->fixups[as->fixup_count++];
+    f->address = address;
+    f->symbol = v->symbol;
+    f->addend = (uint32_t) v->value;
+    f->line = as->line;
+    f->kind = kind;
+    return 0;
+}
+
+/***************************************************************/
+/* Instructions                                                                                                        */
+/***************************************************************/
+/* lw rt, offset(rs) with a 16-bit offset; anything else goes through $at */
+static int assemble_memory(assembler_t *as, uint32_t op) {
+    asm_value_t v = { 0, NO_SYMBOL };
+    uint32_t rt, base;
+
+    if (parse_register(as, &rt) != 0 || expect(as, ',', "','") != 0) {
+        return -1;
+    }
+    skip_space(as);
+    if ((as->p == as->eol || *as->p != '(') && parse_value(as, &v) != 0) {
+        return -1;
+    }
+    skip_space(as);
+    if (as->p < as->eol && *as->p == '(') {
+        as->p++;
+        if (parse_register(as, &base) != 0 || expect(as, ')', "')'") != 0) {
+            return -1;
+        }
+        if (v.symbol != NO_SYMBOL || v.value < -32768 || v.value > 32767) {
+            return fail(as, as->line, "the offset from a register must be a number from -32768 to 32767");
+        }
+        return emit_word(as, I_TYPE(op, base, rt, (uint32_t) v.value));
+    }
+    if (v.symbol == NO_SYMBOL && v.value >= -32768 && v.value <= 32767) {
+        return emit_word(as, I_TYPE(op, REG_ZERO, rt, (uint32_t) v.value));
+    }
+    if (emit_field(as, I_TYPE(OP_LUI, 0, REG_AT, 0), FIX_HI_ADJUSTED, &v) != 0) {
+        return -1;
+    }
+    return emit_field(as, I_TYPE(op, REG_AT, rt, 0), FIX_LO, &v);
+}
+
+/* li/la: the shortest sequence for a number, lui + ori for a label */
+static int assemble_li(assembler_t *as) {
+    asm_value_t v;
+    uint32_t rt, value;
+
+    if (parse_register(as, &rt) != 0 || expect(as, ',', "','") != 0 || parse_value(as, &v) != 0) {
+        return -1;
+    }
+    value = (uint32_t) v.value;
+    if (v.symbol == NO_SYMBOL) {
+        if (v.value >= -32768 && v.value <= 32767) {
+            return emit_word(as, I_TYPE(OP_ADDIU, REG_ZERO, rt, value));
+        }
+        if (value <= 0xFFFF) {
+            return emit_word(as, I_TYPE(OP_ORI, REG_ZERO, rt, value));
+        }
+        if (emit_word(as, I_TYPE(OP_LUI, 0, rt, value >> 16)) != 0) {
+            return -1;
+        }
+        return (value & 0xFFFF) == 0 ? 0 : emit_word(as, I_TYPE(OP_ORI, rt, rt, value));
+    }
+    if (emit_field(as, I_TYPE(OP_LUI, 0, rt, 0), FIX_HI, &v) != 0) {
+        return -1;
+    }
+    return emit_field(as, I_TYPE(OP_ORI, rt, rt, 0), FIX_LO, &v);
+}
+
+static int assemble_instruction(assembler_t *as, const asm_op_t *op) {
+    asm_value_t v;
+    uint32_t rs = 0, rt = 0, rd = 0;
+    int64_t n;
+
+    if (as->section != &as->sections[SECTION_TEXT]) {
+        return fail(as, as->line, "instructions belong in .text");
+    }
+    if (align(as, 4) != 0) {
+        return -1;
+    }
+    bind_labels(as);
+
+#define REG(r) if (parse_register(as, &(r)) != 0) return -1
+#define COMMA() if (expect(as, ',', "','") != 0) return -1
+#define TARGET() if (parse_value(as, &v) != 0) return -1
+
+    switch (op->format) {
+        case FORMAT_RD_RS_RT:
+            REG(rd); COMMA(); REG(rs); COMMA(); REG(rt);
+            return emit_word(as, R_TYPE(op->op, rs, rt, rd, 0));
+        case FORMAT_RS_RT:
+            REG(rs); COMMA(); REG(rt);
+            return emit_word(as, R_TYPE(op->op, rs, rt, 0, 0));
+        case FORMAT_RD_RT_SA:
+            REG(rd); COMMA(); REG(rt); COMMA();
+            if (parse_constant(as, &n, 0, 31) != 0) {
+                return -1;
+            }
+            return emit_word(as, R_TYPE(op->op, 0, rt, rd, (uint32_t) n));
+        case FORMAT_RS:
+            REG(rs);
+            return emit_word(as, R_TYPE(op->op, rs, 0, 0, 0));
+        case FORMAT_RD:
+            REG(rd);
+            return emit_word(as, R_TYPE(op->op, 0, 0, rd, 0));
+        case FORMAT_JALR:
+            REG(rs);
+            rd = REG_RA;
+            skip_space(as);
+            if (as->p < as->eol && *as->p == ',') {
+                as->p++;
+                rd = rs;
+                REG(rs);
+            }
+            return emit_word(as, R_TYPE(op->op, rs, 0, rd, 0));
+        case FORMAT_NONE:
+            return emit_word(as, R_TYPE(op->op, 0, 0, 0, 0));
+        case FORMAT_RT_RS_IMM:
+            REG(rt); COMMA(); REG(rs); COMMA();
+            if (parse_constant(as, &n, OP_IMMEDIATES[op->op] == IMM_SIGNED ? -32768 : 0,
+                               OP_IMMEDIATES[op->op] == IMM_SIGNED ? 32767 : 65535) != 0) {
+                return -1;
+            }
+            return emit_word(as, I_TYPE(op->op, rs, rt, (uint32_t) n));
+        case FORMAT_RT_IMM:
+            REG(rt); COMMA();
+            if (parse_constant(as, &n, 0, 65535) != 0) {
+                return -1;
+            }
+            return emit_word(as, I_TYPE(op->op, 0, rt, (uint32_t) n));
+        case FORMAT_MEMORY:
+            return assemble_memory(as, op->op);
+        case FORMAT_BRANCH_RS_RT:
+            REG(rs); COMMA(); REG(rt); COMMA(); TARGET();
+            return emit_field(as, I_TYPE(op->op, rs, rt, 0), FIX_BRANCH, &v);
+        case FORMAT_BRANCH_RS:
+            REG(rs); COMMA(); TARGET();
+            return emit_field(as, I_TYPE(op->op, rs, 0, 0), FIX_BRANCH, &v);
+        case PSEUDO_NOP:
+            return emit_word(as, 0);
+        case PSEUDO_MOVE:
+            REG(rd); COMMA(); REG(rs);
+            return emit_word(as, R_TYPE(OP_ADDU, rs, REG_ZERO, rd, 0));
+        case PSEUDO_NOT:
+            REG(rd); COMMA(); REG(rs);
+            return emit_word(as, R_TYPE(OP_NOR, rs, REG_ZERO, rd, 0));
+        case PSEUDO_NEG:
+            REG(rd); COMMA(); REG(rt);
+            return emit_word(as, R_TYPE(op->op, REG_ZERO, rt, rd, 0));
+        case PSEUDO_LI:
+            return assemble_li(as);
+        case PSEUDO_MUL:
+            REG(rd); COMMA(); REG(rs); COMMA(); REG(rt);
+            if (emit_word(as, R_TYPE(OP_MULT, rs, rt, 0, 0)) != 0) {
+                return -1;
+            }
+            return emit_word(as, R_TYPE(OP_MFLO, 0, 0, rd, 0));
+        case PSEUDO_B:
+            TARGET();
+            return emit_field(as, I_TYPE(OP_BEQ, REG_ZERO, REG_ZERO, 0), FIX_BRANCH, &v);
+        case PSEUDO_BRANCH_ZERO:
+            REG(rs); COMMA(); TARGET();
+            return emit_field(as, I_TYPE(op->op, rs, REG_ZERO, 0), FIX_BRANCH, &v);
+        case PSEUDO_BRANCH_COMPARE:
+            REG(rs); COMMA(); REG(rt); COMMA(); TARGET();
+            if (emit_word(as, (op->op & SWAP) ? R_TYPE(OP_SLT, rt, rs, REG_AT, 0)
+                                                 : R_TYPE(OP_SLT, rs, rt, REG_AT, 0)) != 0) {
+                return -1;
+            }
+            return emit_field(as, I_TYPE(op->op & ~SWAP, REG_AT, REG_ZERO, 0), FIX_BRANCH, &v);
+        case PSEUDO_J:
+        case PSEUDO_JAL:
+            TARGET();
+            if (emit_field(as, I_TYPE(OP_LUI, 0, REG_AT, 0), FIX_HI, &v) != 0 ||
+                emit_field(as, I_TYPE(OP_ORI, REG_AT, REG_AT, 0), FIX_LO, &v) != 0) {
+                return -1;
+            }
+            if (op->format == PSEUDO_J) {
+                return emit_word(as, R_TYPE(OP_JR, REG_AT, 0, 0, 0));
+            }
+            /* jalr links PC + 8: the nop makes that the instruction after the jal */
+            if (emit_word(as, R_TYPE(OP_JALR, REG_AT, 0, REG_RA, 0)) != 0) {
+                return -1;
+            }
+            return emit_word(as, 0);
+    }
+#undef REG
+#undef COMMA
+#undef TARGET
+    return 0;
+}
+
+/***************************************************************/
+/* Directives                                                                                                             */
+/***************************************************************/
+static int name_is(const char *name, uint32_t length, const char *directive) {
+    return strlen(directive) == length && memcmp(name, directive, length) == 0;
+}
+
+/* note the extent of what the current section got since it became current */
+static void close_run(assembler_t *as) {
+    asm_section_t *s = as->section;
+
+    if (s->address > s->run_start) {
+        if (!s->used || s->run_start < s->begin) {
+            s->begin = s->run_start;
+        }
+        if (!s->used || s->address > s->end) {
+            s->end = s->address;
+        }
+        s->used = 1;
+    }
+    s->run_start = s->address;
+}
+
+static int switch_section(assembler_t *as, int section) {
+    asm_section_t *s = &as->sections[section];
+    int64_t address;
+
+    bind_labels(as);
+    close_run(as);
+    as->section = s;
+    skip_space(as);
+    if (as->p < as->eol) {
+        if (parse_constant(as, &address, 0, 0xFFFFFFFF) != 0) {
+            return -1;
+        }
+        if (address < s->region_begin || address > s->region_end) {
+            return fail(as, as->line, "%s must lie within 0x%08x-0x%08x", s->name, s->region_begin, s->region_end);
+        }
+        s->address = (uint32_t) address;
+    }
+    s->run_start = s->address;
+    return 0;
+}
+
+static int assemble_string(assembler_t *as, int terminate) {
+    uint8_t c;
+
+    do {
+        if (expect(as, '"', "a string") != 0) {
+            return -1;
+        }
+        while (as->p < as->eol && *as->p != '"') {
+            if (parse_char(as, &c) != 0 || emit_byte(as, c) != 0) {
+                return -1;
+            }
+        }
+        if (as->p == as->eol) {
+            return fail(as, as->line, "unterminated string");
+        }
+        as->p++;
+        if (terminate && emit_byte(as, 0) != 0) {
+            return -1;
+        }
+        skip_space(as);
+    } while (as->p < as->eol && *as->p == ',' && as->p++);
+    return 0;
+}
+
+static int assemble_directive(assembler_t *as, const char *name, uint32_t length) {
+    asm_value_t v;
+    int64_t n;
+    int size;
+
+    if (name_is(name, length, ".text")) {
+        return switch_section(as, SECTION_TEXT);
+    }
+    if (name_is(name, length, ".data")) {
+        return switch_section(as, SECTION_DATA);
+    }
+    if (name_is(name, length, ".globl") || name_is(name, length, ".global") || name_is(name, length, ".ent") ||
+        name_is(name, length, ".end") || name_is(name, length, ".set")) {
+        as->p = as->eol;
+        return 0;
+    }
+    if (name_is(name, length, ".align")) {
+        if (parse_constant(as, &n, 0, PAGE_SHIFT) != 0) {
+            return -1;
+        }
+        return align(as, 1u << n);
+    }
+    if (name_is(name, length, ".space")) {
+        if (parse_constant(as, &n, 0, 0x7FFFFFFF) != 0 || reserve(as, n) != 0) {
+            return -1;
+        }
+        bind_labels(as);
+        as->section->address += n;
+        return 0;
+    }
+    if (name_is(name, length, ".ascii") || name_is(name, length, ".asciiz")) {
+        bind_labels(as);
+        return assemble_string(as, length == 7);
+    }
+    size = name_is(name, length, ".word") ? 4 : name_is(name, length, ".half") ? 2 : name_is(name, length, ".byte") ? 1 : 0;
+    if (size == 0) {
+        return fail(as, as->line, "unknown directive '%.*s'", (int) length, name);
+    }
+    if (align(as, size) != 0) {
+        return -1;
+    }
+    bind_labels(as);
+    do {
+        if (size == 4) {
+            if (parse_value(as, &v) != 0 || emit_field(as, 0, FIX_WORD, &v) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (parse_constant(as, &n, size == 2 ? -32768 : -128, size == 2 ? 65535 : 255) != 0 ||
+            emit_byte(as, n & 0xFF) != 0 || (size == 2 && emit_byte(as, (n >> 8) & 0xFF) != 0)) {
+            return -1;
+        }
+    } while (skip_space(as), as->p < as->eol && *as->p == ',' && as->p++);
+    return 0;
+}
+
+/***************************************************************/
+/* One line: labels, then a directive or an instruction                                             */
+/***************************************************************/
+static int assemble_line(assembler_t *as) {
+    const char *name;
+    char mnemonic[MAX_MNEMONIC];
+    uint32_t length, i, slot;
+    int result;
+
+    while (1) {
+        skip_space(as);
+        if (as->p == as->eol) {
+            return 0;
+        }
+        if (!is_name_start(*as->p)) {
+            return expected(as, "a label, directive or instruction");
+        }
+        name = as->p;
+        while (as->p < as->eol && is_name_char(*as->p)) {
+            as->p++;
+        }
+        length = as->p - name;
+        skip_space(as);
+        if (as->p == as->eol || *as->p != ':') {
+            break;
+        }
+        as->p++;
+        if (define_label(as, name, length) != 0) {
+            return -1;
+        }
+    }
+
+    if (name[0] == '.') {
+        result = assemble_directive(as, name, length);
+    } else {
+        /* mnemonics in either case */
+        for (i = 0; i < length && i < MAX_MNEMONIC; i++) {
+            mnemonic[i] = (name[i] >= 'a' && name[i] <= 'z') ? name[i] - 'a' + 'A' : name[i];
+        }
+        slot = name_hash(mnemonic, i) & (OP_SLOTS - 1);
+        while (length <= MAX_MNEMONIC && as->ops[slot] != 0 &&
+               !name_is(mnemonic, length, OPS[as->ops[slot] - 1].name)) {
+            slot = (slot + 1) & (OP_SLOTS - 1);
+        }
+        if (length > MAX_MNEMONIC || as->ops[slot] == 0) {
+            return fail(as, as->line, "unknown instruction '%.*s'", (int) length, name);
+        }
+        result = assemble_instruction(as, &OPS[as->ops[slot] - 1]);
+    }
+    if (result != 0) {
+        return -1;
+    }
+    skip_space(as);
+    if (as->p < as->eol) {
+        return expected(as, "the end of the line");
+    }
+    return 0;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const image_symbol_t *x = a, *y = b;
+
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/***************************************************************/
+/* Fill in the entry point, segments and labels                                                        */
+/***************************************************************/
+static void describe_program(assembler_t *as, image_info_t *info) {
+    const asm_symbol_t *s;
+    uint32_t i, entry;
+    size_t bytes = 0;
+
+    info->segments = malloc(3 * sizeof(image_segment_t));
+    info->symbols = malloc((as->symbol_count + 1) * sizeof(image_symbol_t));
+    for (i = 0; i < as->symbol_count; i++) {
+        bytes += as->symbols[i].length + 1;
+    }
+    info->strings = malloc(bytes + 1);
+    if (info->segments == NULL || info->symbols == NULL || info->strings == NULL) {
+        printf("Error: Out of memory assembling\n");
+        exit(-1);
+    }
+    for (i = 0; i < 2; i++) {
+        if (as->sections[i].used) {
+            info->segments[info->segment_count].address = as->sections[i].begin;
+            info->segments[info->segment_count].size = as->sections[i].end - as->sections[i].begin;
+            info->segments[info->segment_count].flags = as->sections[i].flags;
+            info->segments[info->segment_count].reserved = 0;
+            info->segment_count++;
+        }
+    }
+    for (i = 0; i < as->symbol_count; i++) {
+        s = &as->symbols[i];
+        info->symbols[i].address = s->address;
+        info->symbols[i].name = info->strings_size;
+        memcpy(info->strings + info->strings_size, s->name, s->length);
+        info->strings[info->strings_size + s->length] = '\0';
+        info->strings_size += s->length + 1;
+    }
+    info->symbol_count = as->symbol_count;
+    qsort(info->symbols, info->symbol_count, sizeof(image_symbol_t), compare_symbols);
+
+    if ((i = find_symbol(as, "__start", 7, 0)) != NO_SYMBOL || (i = find_symbol(as, "main", 4, 0)) != NO_SYMBOL) {
+        entry = as->symbols[i].address;
+    } else {
+        entry = as->sections[SECTION_TEXT].used ? as->sections[SECTION_TEXT].begin : MEM_TEXT_BEGIN;
+    }
+    info->entry = entry;
+}
+
+/***************************************************************/
+/* Assemble source into the current address space                                                */
+/***************************************************************/
+int assemble(const char *source, size_t length, image_info_t *info, char *error, size_t error_size) {
+    const char *next = source, *end = source + length;
+    assembler_t as;
+    const asm_fixup_t *f;
+    const asm_symbol_t *s;
+    uint32_t i, slot;
+    int result = 0;
+
+    memset(&as, 0, sizeof(as));
+    memset(info, 0, sizeof(*info));
+    as.error = error;
+    as.error_size = error_size;
+    as.sections[SECTION_TEXT] = (asm_section_t) { ".text", MEM_TEXT_BEGIN, MEM_TEXT_BEGIN, 0, 0, 0,
+                                                  MEM_TEXT_BEGIN, MEM_TEXT_END, SEGMENT_TEXT };
+    as.sections[SECTION_DATA] = (asm_section_t) { ".data", MEM_DATA_BEGIN, MEM_DATA_BEGIN, 0, 0, 0,
+                                                  MEM_DATA_BEGIN, MEM_DATA_END, SEGMENT_DATA };
+    as.section = &as.sections[SECTION_TEXT];
+    for (i = 0; i < NUM_OPS_ASM; i++) {
+        slot = name_hash(OPS[i].name, strlen(OPS[i].name)) & (OP_SLOTS - 1);
+        while (as.ops[slot] != 0) {
+            slot = (slot + 1) & (OP_SLOTS - 1);
+        }
+        as.ops[slot] = i + 1;
+    }
+    if (error_size > 0) {
+        error[0] = '\0';
+    }
+    reset_memory();
+    flush_predecode();
+
+    /* first pass: everything but the fields that refer to labels */
+    while (next < end && result == 0) {
+        as.p = next;
+        as.eol = memchr(next, '\n', end - next);
+        if (as.eol == NULL) {
+            as.eol = end;
+        }
+        next = as.eol + 1;
+        as.line++;
+        result = assemble_line(&as);
+    }
+    if (result == 0) {
+        /* labels at the very end mark the end of their section */
+        bind_labels(&as);
+        close_run(&as);
+    }
+
+    /* second pass: the label references */
+    for (i = 0; i < as.fixup_count && result == 0; i++) {
+        f = &as.fixups[i];
+        s = &as.symbols[f->symbol];
+        if (s->line == 0) {
+            result = fail(&as, f->line, "undefined label '%.*s'", (int) s->length, s->name);
+        } else {
+            result = patch(&as, f->kind, f->address, s->address + f->addend, f->line);
+        }
+    }
+
+    if (result == 0) {
+        describe_program(&as, info);
+    } else {
+        reset_memory();
+    }
+    free(as.symbols);
+    free(as.buckets);
+    free(as.pending);
+    free(as.fixups);
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef MU_ASM_H
+#define MU_ASM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mu-load.h"
+
+/******************************************************************************/
+/* Assembler                                                                                                                                               */
+/******************************************************************************/
+/* MIPS source, one statement per line, # starts a comment:
+ *   labels       name:  (any number in front of a statement, or on a line of their own)
+ *   sections     .text [address]   .data [address]   (MEM_TEXT_BEGIN and MEM_DATA_BEGIN by default)
+ *   data         .word  .half  .byte  (values, .word also labels)   .ascii  .asciiz  "text"
+ *                .space <bytes>   .align <power of two>   (.globl .global .ent .end .set are ignored)
+ *   instructions every MIPS_ISA entry (mu-decode.h), registers as $0..$31 or by name
+ *   pseudo       nop  move  not  neg  negu  li  la  mul  b  beqz  bnez  blt  bgt  ble  bge  j  jal,
+ *                and loads and stores of a label or address
+ * Operands are numbers (decimal, 0x hex, 'c') or label [+|- number].
+ * Code is assembled for this simulator rather than a MIPS processor: there are no delay slots and
+ * a branch offset counts from the branch itself. J-format jumps are not implemented, so j and jal
+ * jump through $at with jr and jalr; jalr links PC + 8, so jal is followed by a nop.
+ * Pseudo-instructions that need a scratch register use $at. Execution starts at __start or main,
+ * else at the beginning of the text. */
+
+/* assemble source into the current address space, replacing its contents; fills info with the
+ * entry point, the text and data segments and the labels (info's pages stay empty). Returns 0,
+ * -1 with a "line <n>: <reason>" message in error if the source has a mistake (and then memory
+ * is left empty) */
+int assemble(const char *source, size_t length, image_info_t *info, char *error, size_t error_size);
+
+#endif
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mu-sim.h"
+#include "mu-bbv.h"
+
+/************************************************************/
+/* Basic-block vector writer                                                                                     */
+/*                                                                                                                               */
+/* The interval's counts live in an open-addressed table of leaders; USED lists the    */
+/* slots taken, so writing the interval out and emptying the table only touches     */
+/* the blocks it ran.                                                                                                   */
+/************************************************************/
+
+#define FIRST_SLOTS 1024
+
+int BBV_ACTIVE;
+
+static FILE *BBV_FILE;
+static uint32_t INTERVAL;
+static uint32_t FILLED;             /* instructions counted in the interval */
+static int WRITE_FAILED;
+
+static bbv_entry_t *TABLE;          /* instructions == 0 marks a free slot */
+static uint32_t SLOTS;              /* power of two */
+static uint32_t *USED;              /* indexes of the taken slots */
+static uint32_t USED_COUNT;
+
+/* the block cycle() is stepping through */
+static uint32_t OPEN_LEADER, OPEN_LENGTH;
+
+static uint32_t slot_of(uint32_t leader) {
+    return ((leader >> 2) * 2654435761u) & (SLOTS - 1);
+}
+
+static void grow_table() {
+    bbv_entry_t *old = TABLE;
+    uint32_t old_slots = SLOTS, i, slot;
+
+    SLOTS = SLOTS == 0 ? FIRST_SLOTS : 2 * SLOTS;
+    TABLE = calloc(SLOTS, sizeof(bbv_entry_t));
+    USED = realloc(USED, SLOTS / 2 * sizeof(uint32_t));
+    if (TABLE == NULL || USED == NULL) {
+        printf("Error: Out of memory counting %u basic blocks\n", USED_COUNT);
+        exit(-1);
+    }
+    USED_COUNT = 0;
+    for (i = 0; i < old_slots; i++) {
+        if (old[i].instructions == 0) {
+            continue;
+        }
+        for (slot = slot_of(old[i].leader); TABLE[slot].instructions != 0; slot = (slot + 1) & (SLOTS - 1)) {
+        }
+        TABLE[slot] = old[i];
+        USED[USED_COUNT++] = slot;
+    }
+    free(old);
+}
+
+/************************************************************/
+/* Write the interval out and empty the table                                                        */
+/************************************************************/
+static void write_interval() {
+    bbv_interval_t header;
+    uint32_t i;
+
+    header.instructions = FILLED;
+    header.blocks = USED_COUNT;
+    if (fwrite(&header, sizeof(header), 1, BBV_FILE) != 1) {
+        WRITE_FAILED = 1;
+    }
+    for (i = 0; i < USED_COUNT; i++) {
+        if (fwrite(&TABLE[USED[i]], sizeof(bbv_entry_t), 1, BBV_FILE) != 1) {
+            WRITE_FAILED = 1;
+        }
+        TABLE[USED[i]].instructions = 0;
+    }
+    USED_COUNT = 0;
+    FILLED = 0;
+}
+
+static void count(uint32_t leader, uint32_t instructions) {
+    uint32_t slot;
+
+    if (2 * (USED_COUNT + 1) > SLOTS) {
+        grow_table();
+    }
+    for (slot = slot_of(leader);; slot = (slot + 1) & (SLOTS - 1)) {
+        if (TABLE[slot].instructions == 0) {
+            TABLE[slot].leader = leader;
+            USED[USED_COUNT++] = slot;
+            break;
+        }
+        if (TABLE[slot].leader == leader) {
+            break;
+        }
+    }
+    TABLE[slot].instructions += instructions;
+    FILLED += instructions;
+    if (FILLED >= INTERVAL) {
+        write_interval();
+    }
+}
+
+/************************************************************/
+/* Start profiling to path                                                                                          */
+/************************************************************/
+int bbv_open(const char *path, uint32_t interval) {
+    bbv_header_t header;
+
+    if (BBV_ACTIVE) {
+        bbv_close();
+    }
+    if (interval == 0) {
+        printf("Error: A profile interval must hold at least one instruction\n");
+        return 0;
+    }
+    BBV_FILE = fopen(path, "wb");
+    if (BBV_FILE == NULL) {
+        printf("Error: Can't open profile file %s\n", path);
+        return 0;
+    }
+    if (SLOTS == 0) {
+        grow_table();
+        /* the simulator exits from several places; write the last interval out */
+        atexit(bbv_close);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BBV_MAGIC, sizeof(header.magic));
+    header.version = BBV_VERSION;
+    header.interval = interval;
+    header.start = INSTRUCTION_COUNT;
+    /* a header that could not be written is reported when the profile is closed */
+    WRITE_FAILED = fwrite(&header, sizeof(header), 1, BBV_FILE) != 1;
+
+    INTERVAL = interval;
+    FILLED = 0;
+    OPEN_LENGTH = 0;
+    BBV_ACTIVE = 1;
+    return 1;
+}
+
+/************************************************************/
+/* Write out the last interval and stop profiling                                                    */
+/************************************************************/
+void bbv_close() {
+    if (!BBV_ACTIVE) {
+        return;
+    }
+    BBV_ACTIVE = 0;
+    if (OPEN_LENGTH > 0) {
+        count(OPEN_LEADER, OPEN_LENGTH);
+        OPEN_LENGTH = 0;
+    }
+    if (FILLED > 0) {
+        write_interval();
+    }
+    if (fclose(BBV_FILE) != 0 || WRITE_FAILED) {
+        printf("Error: Writing the profile file failed\n");
+    }
+    BBV_FILE = NULL;
+}
+
+/************************************************************/
+/* Count executed blocks                                                                                           */
+/************************************************************/
+void bbv_block(uint32_t leader, uint32_t instructions) {
+    if (OPEN_LENGTH > 0) {
+        /* cycle() stopped partway through a block; this may be the rest of it */
+        if (leader == OPEN_LEADER + 4 * OPEN_LENGTH) {
+            leader = OPEN_LEADER;
+            instructions += OPEN_LENGTH;
+        } else {
+            count(OPEN_LEADER, OPEN_LENGTH);
+        }
+        OPEN_LENGTH = 0;
+    }
+    if (instructions > 0) {
+        count(leader, instructions);
+    }
+}
+
+void bbv_step(uint32_t pc, uint32_t next_pc) {
+    if (OPEN_LENGTH == 0) {
+        OPEN_LEADER = pc;
+    }
+    OPEN_LENGTH++;
+    if (next_pc != pc + 4 || OPEN_LENGTH == MAX_BLOCK_LENGTH || ends_block(predecode_fetch(pc)->op)) {
+        count(OPEN_LEADER, OPEN_LENGTH);
+        OPEN_LENGTH = 0;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef MU_BBV_H
+#define MU_BBV_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Basic-block vector profile                                                                                                                        */
+/******************************************************************************/
+/* splits the run into intervals of about the same number of instructions and records, for
+ * each, how many instructions every basic block executed, keyed by the block's leader (the PC
+ * it was entered at). The blocks are the block engine's: a block ends after a control
+ * transfer or MAX_BLOCK_LENGTH instructions. An interval closes at the first block boundary
+ * after it reaches its length, so intervals run a few instructions over.
+ * A profile file is a bbv_header_t followed, for each interval, by a bbv_interval_t and its
+ * bbv_entry_t's, all in the writing host's byte order (as for the binary trace). Only the
+ * blocks an interval executed are listed.
+ * Pick simulation points from a profile with mu-mips-simpoint. Like the binary trace, the
+ * profile is process-wide and meant for a single guest. */
+#define BBV_MAGIC "MUBBVECT"
+#define BBV_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t interval;          /* instructions per interval */
+	uint32_t start;             /* instruction count when profiling began */
+	uint32_t reserved;
+} bbv_header_t;
+
+typedef struct {
+	uint32_t instructions;      /* in this interval */
+	uint32_t blocks;            /* bbv_entry_t's that follow */
+} bbv_interval_t;
+
+typedef struct {
+	uint32_t leader;
+	uint32_t instructions;      /* executed in the block during the interval */
+} bbv_entry_t;
+
+extern int BBV_ACTIVE;
+
+/* start profiling the current simulator to path; returns 1, 0 (with a message) on failure */
+int bbv_open(const char *path, uint32_t interval);
+/* write out the last, partial interval and stop */
+void bbv_close();
+/* count a whole block the block engine ran */
+void bbv_block(uint32_t leader, uint32_t instructions);
+/* count one instruction cycle() ran, which went on to next_pc */
+void bbv_step(uint32_t pc, uint32_t next_pc);
+
+#endif
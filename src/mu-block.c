@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mu-sim.h"
+#include "mu-block.h"
+#include "mu-jit.h"
+#include "mu-bbv.h"
+
+/************************************************************/
+/* Block engine                                                                                                          */
+/*                                                                                                                               */
+/* Executes whole basic blocks from the translation cache. Inside a block the      */
+/* handlers of mu-ops.def are chained through their pre-bound labels; at the end    */
+/* the block's successor is taken from its chain slots, falling back to a hash        */
+/* lookup (and a translation on a miss) only when the exit changes.                     */
+/* INSTRUCTION_COUNT is updated once per block.                                                 */
+/************************************************************/
+
+#if defined(__GNUC__) && !defined(MU_NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+/* the current simulator's translation cache */
+#define BLOCK_HASH (SIM->blocks.hash)
+#define BLOCK_GENERATION (SIM->blocks.generation)
+
+static uint32_t block_hash(uint32_t pc) {
+    return (pc >> 2) & (BLOCK_HASH_SIZE - 1);
+}
+
+/************************************************************/
+/* Control transfers (and SYSCALL) end a basic block                                                */
+/************************************************************/
+int ends_block(uint8_t op) {
+    switch (op) {
+        case OP_JR:
+        case OP_JALR:
+        case OP_SYSCALL:
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLEZ:
+        case OP_BGTZ:
+        case OP_BLTZ:
+        case OP_BGEZ:
+            return 1;
+    }
+    return 0;
+}
+
+/************************************************************/
+/* Drop every translated block                                                                           */
+/************************************************************/
+void flush_blocks() {
+    int i;
+    for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+        while (BLOCK_HASH[i] != NULL) {
+            block_t *next = BLOCK_HASH[i]->hash_next;
+            free(BLOCK_HASH[i]);
+            BLOCK_HASH[i] = next;
+        }
+    }
+    jit_flush();
+    BLOCK_GENERATION = CODE_GENERATION;
+}
+
+/************************************************************/
+/* Make every compiled block run on the handlers again, and compile again once it is  */
+/* hot (the JIT is reusing its code cache). Blocks whose compilation failed or did     */
+/* not match the interpreter stay uncompiled.                                                          */
+/************************************************************/
+void drop_native_code() {
+    block_t *b;
+    int i;
+
+    for (i = 0; i < BLOCK_HASH_SIZE; i++) {
+        for (b = BLOCK_HASH[i]; b != NULL; b = b->hash_next) {
+            if (b->native != NULL) {
+                b->native = NULL;
+                b->jit_tried = 0;
+            }
+        }
+    }
+}
+
+/************************************************************/
+/* Translate the basic block starting at pc                                                             */
+/* Returns NULL for code outside the text segment, which is never translated.        */
+/************************************************************/
+static block_t *build_block(uint32_t pc, const void *const *dispatch_table) {
+    block_op_t ops[MAX_BLOCK_LENGTH];
+    uint32_t length = 0;
+    uint32_t address = pc;
+    block_t *b;
+
+    if (pc - MEM_TEXT_BEGIN > MEM_TEXT_END - MEM_TEXT_BEGIN || (pc & 3) != 0) {
+        return NULL;
+    }
+    do {
+        const decoded_insn_t *d = predecode_fetch(address);
+        ops[length].d = *d;
+        ops[length].handler = dispatch_table != NULL ? dispatch_table[d->op] : NULL;
+        length++;
+        address += 4;
+        if (ends_block(d->op)) {
+            break;
+        }
+    } while (length < MAX_BLOCK_LENGTH && address - MEM_TEXT_BEGIN <= MEM_TEXT_END - MEM_TEXT_BEGIN);
+
+    b = malloc(sizeof(block_t) + length * sizeof(block_op_t));
+    if (b == NULL) {
+        printf("Error: Out of memory translating block at 0x%08x\n", pc);
+        exit(-1);
+    }
+    b->start_pc = pc;
+    b->fall_pc = address;
+    b->length = length;
+    b->exec_count = 0;
+    b->native = NULL;
+    b->jit_tried = 0;
+    b->succ[0] = b->succ[1] = NULL;
+    b->succ_pc[0] = b->succ_pc[1] = 0;
+    for (address = 0; address < length; address++) {
+        b->ops[address] = ops[address];
+    }
+    b->hash_next = BLOCK_HASH[block_hash(pc)];
+    BLOCK_HASH[block_hash(pc)] = b;
+    return b;
+}
+
+/************************************************************/
+/* Find (or translate) the block starting at pc                                                        */
+/************************************************************/
+static block_t *lookup_block(uint32_t pc, const void *const *dispatch_table) {
+    block_t *b;
+    for (b = BLOCK_HASH[block_hash(pc)]; b != NULL; b = b->hash_next) {
+        if (b->start_pc == pc) {
+            return b;
+        }
+    }
+    return build_block(pc, dispatch_table);
+}
+
+/* unpack the operation's fields (same as the FETCH of the other cores) */
+#define LOAD_OP() \
+    do { \
+        rs = op->d.rs; \
+        rt = op->d.rt; \
+        rd = op->d.rd; \
+        sa = op->d.sa; \
+        im = op->d.imm; \
+        target = op->d.target; \
+        next_pc = CURRENT_STATE.PC + 0x4; \
+        TRACE_INSTRUCTION(CURRENT_STATE.PC, &op->d); \
+    } while (0)
+
+/************************************************************/
+/* Execute up to max_instructions block by block, stopping early at SYSCALL        */
+/* Returns the number of instructions executed.                                                      */
+/************************************************************/
+uint32_t run_blocks(uint32_t max_instructions) {
+    block_t *b, *prev = NULL;
+    const block_op_t *op, *end;
+    uint32_t rs, rt, rd, sa, im, target, next_pc;
+    uint32_t executed = 0, retired;
+
+#ifdef USE_COMPUTED_GOTO
+#define OP_LABEL(name, ...) [OP_##name] = &&TARGET_##name,
+    static const void *const dispatch_table[NUM_OPS] = {
+        [OP_UNDECODED] = &&TARGET_INVALID,
+        FOR_EACH_OP(OP_LABEL)
+    };
+#undef OP_LABEL
+#else
+    static const void *const *const dispatch_table = NULL;
+#endif
+
+    while (executed < max_instructions && RUN_FLAG) {
+        uint32_t pc = CURRENT_STATE.PC;
+
+        if (BLOCK_GENERATION != CODE_GENERATION) {
+            /* text was written (or reloaded) since these blocks were translated */
+            flush_blocks();
+            prev = NULL;
+        }
+
+        /* follow the chain out of the previous block, looking the block up only on a new exit */
+        if (prev != NULL) {
+            int slot = pc == prev->fall_pc ? 0 : 1;
+            if (prev->succ[slot] != NULL && prev->succ_pc[slot] == pc) {
+                b = prev->succ[slot];
+            } else {
+                b = lookup_block(pc, dispatch_table);
+                prev->succ[slot] = b;
+                prev->succ_pc[slot] = pc;
+            }
+        } else {
+            b = lookup_block(pc, dispatch_table);
+        }
+
+        if (b == NULL || b->length > max_instructions - executed) {
+            /* untranslatable code, or not enough budget left for the whole block */
+            cycle();
+            executed++;
+            prev = NULL;
+            continue;
+        }
+
+        b->exec_count++;
+        op = b->ops;
+        end = op + b->length;
+
+        if (SIM_ENGINE == ENGINE_JIT && !TRACE_ENABLED()) {
+            if (b->native == NULL && !b->jit_tried && b->exec_count >= JIT_THRESHOLD) {
+                jit_compile(b);
+            }
+            if (b->native != NULL) {
+                /* the native code may stop early, leaving the rest of the block to the handlers */
+                op += jit_run(b);
+            }
+        }
+
+#define NEXT_STATE CURRENT_STATE
+#ifdef USE_COMPUTED_GOTO
+#define TARGET(name) TARGET_##name:
+#define NEXT_INSN() \
+    do { \
+        CURRENT_STATE.PC = next_pc; \
+        if (++op == end || CODE_GENERATION != BLOCK_GENERATION) { \
+            goto block_exit; \
+        } \
+        LOAD_OP(); \
+        goto *op->handler; \
+    } while (0)
+
+        if (op == end || CODE_GENERATION != BLOCK_GENERATION) {
+            goto block_exit;
+        }
+        LOAD_OP();
+        goto *op->handler;
+#include "mu-ops.def"
+block_exit:
+
+#else
+#define TARGET(name) case OP_##name:
+#define NEXT_INSN() break
+
+        while (op != end && CODE_GENERATION == BLOCK_GENERATION) {
+            LOAD_OP();
+            switch (op->d.op) {
+                default:
+#include "mu-ops.def"
+            }
+            CURRENT_STATE.PC = next_pc;
+            op++;
+        }
+#endif
+#undef TARGET
+#undef NEXT_INSN
+#undef NEXT_STATE
+
+        /* a store into the text segment can end the block early */
+        retired = op - b->ops;
+        INSTRUCTION_COUNT += retired;
+        if (BBV_ACTIVE) {
+            bbv_block(b->start_pc, retired);
+        }
+        executed += retired;
+        prev = b;
+    }
+    return executed;
+}
@@ -0,0 +1,46 @@
+#ifndef MU_BLOCK_H
+#define MU_BLOCK_H
+
+#include <stdint.h>
+
+#include "mu-decode.h"
+
+/******************************************************************************/
+/* Basic-block translation cache                                                                                                                     */
+/******************************************************************************/
+/* a block is a straight run of text ending after the first control transfer (branch, JR, JALR,
+ * SYSCALL), MAX_BLOCK_LENGTH instructions or the end of the text segment. It is translated once
+ * into an array of operations with their handler pre-bound, and remembers the blocks it last
+ * exited to so hot paths jump block to block without a cache lookup. */
+#define MAX_BLOCK_LENGTH 64
+#define BLOCK_HASH_SIZE 4096
+
+typedef struct {
+	const void *handler;  /* computed-goto label of the handler (unused by the switch fallback) */
+	decoded_insn_t d;
+} block_op_t;
+
+typedef struct block {
+	uint32_t start_pc;
+	uint32_t fall_pc;         /* address after the last instruction */
+	uint32_t length;          /* in instructions */
+	uint32_t exec_count;
+	void *native;             /* code compiled by the JIT, or NULL */
+	uint32_t jit_tried;       /* compilation was attempted (it is not retried unless the code cache is emptied) */
+	struct block *hash_next;
+	struct block *succ[2];    /* chained successors: [0] falls through to fall_pc, [1] any other exit */
+	uint32_t succ_pc[2];
+	block_op_t ops[];
+} block_t;
+
+typedef struct {
+	block_t *hash[BLOCK_HASH_SIZE];
+	uint32_t generation;      /* CODE_GENERATION the cached blocks were translated from */
+} block_cache_t;
+
+int ends_block(uint8_t op);
+uint32_t run_blocks(uint32_t max_instructions);
+void flush_blocks();
+void drop_native_code();
+
+#endif
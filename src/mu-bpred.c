@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-sim.h"
+#include "mu-bpred.h"
+
+/************************************************************/
+/* Branch predictor                                                                                                     */
+/*                                                                                                                               */
+/* bpred_predict() only reads the tables; bpred_resolve() scores the guess and         */
+/* trains them with what the instruction did.                                                         */
+/************************************************************/
+
+#define MAX_TABLE_BITS 24
+#define MAX_RAS_DEPTH 4096
+#define FIRST_SITE_SLOTS 256
+
+/* 2-bit counters start weakly not taken (and the chooser weakly on bimodal) */
+#define COUNTER_INIT 1
+
+/* PCs held in the BTB and the stack are word addresses */
+#define PC_BITS 30
+
+const char *const BPRED_SCHEME_NAMES[BPRED_SCHEMES] = { "static", "bimodal", "gshare", "tournament" };
+
+/* what kind of control transfer an instruction is */
+#define KIND_NONE        0
+#define KIND_CONDITIONAL 1
+#define KIND_JR          2
+#define KIND_JALR        3
+
+static int branch_kind(const decoded_insn_t *d) {
+    switch (d->op) {
+        case OP_BEQ: case OP_BNE: case OP_BLEZ: case OP_BGTZ: case OP_BLTZ: case OP_BGEZ:
+            return KIND_CONDITIONAL;
+        case OP_JR:
+            return KIND_JR;
+        case OP_JALR:
+            return KIND_JALR;
+        default:
+            return KIND_NONE;
+    }
+}
+
+static int uses_bimodal(uint8_t scheme) {
+    return scheme == BPRED_BIMODAL || scheme == BPRED_TOURNAMENT;
+}
+
+static int uses_gshare(uint8_t scheme) {
+    return scheme == BPRED_GSHARE || scheme == BPRED_TOURNAMENT;
+}
+
+/************************************************************/
+/* Predictor the bpred on command turns on                                                            */
+/************************************************************/
+void bpred_defaults(bpred_t *b) {
+    static const bpred_config_t defaults = { BPRED_GSHARE, 12, 12, 512, 16 };
+
+    bpred_configure(b, &defaults);
+}
+
+static uint8_t *new_counters(uint32_t count) {
+    uint8_t *counters = malloc(count);
+
+    if (counters == NULL) {
+        printf("Error: Out of memory allocating %u branch predictor counters\n", count);
+        exit(-1);
+    }
+    memset(counters, COUNTER_INIT, count);
+    return counters;
+}
+
+static uint32_t *new_words(uint32_t count) {
+    uint32_t *words = calloc(count, sizeof(uint32_t));
+
+    if (words == NULL && count > 0) {
+        printf("Error: Out of memory allocating the branch predictor\n");
+        exit(-1);
+    }
+    return words;
+}
+
+/************************************************************/
+/* Give the predictor new tables                                                                          */
+/************************************************************/
+int bpred_configure(bpred_t *b, const bpred_config_t *config) {
+    uint32_t counters;
+    int enabled = b->enabled;
+
+    if (config->scheme >= BPRED_SCHEMES || config->table_bits == 0 || config->table_bits > MAX_TABLE_BITS ||
+        config->history_bits > 32 || (config->btb_entries & (config->btb_entries - 1)) != 0 ||
+        config->btb_entries > 1u << MAX_TABLE_BITS || config->ras_depth > MAX_RAS_DEPTH) {
+        return -1;
+    }
+    counters = 1u << config->table_bits;
+    bpred_free(b);
+    b->enabled = enabled;
+    b->config = *config;
+    if (uses_bimodal(config->scheme)) {
+        b->bimodal = new_counters(counters);
+    }
+    if (uses_gshare(config->scheme)) {
+        b->gshare = new_counters(counters);
+    }
+    if (config->scheme == BPRED_TOURNAMENT) {
+        b->chooser = new_counters(counters);
+    }
+    b->btb_tags = new_words(config->btb_entries);
+    b->btb_targets = new_words(config->btb_entries);
+    b->ras = new_words(config->ras_depth);
+    return 0;
+}
+
+void bpred_free(bpred_t *b) {
+    free(b->bimodal);
+    free(b->gshare);
+    free(b->chooser);
+    free(b->btb_tags);
+    free(b->btb_targets);
+    free(b->ras);
+    free(b->sites);
+    memset(b, 0, sizeof(*b));
+}
+
+/************************************************************/
+/* Forget everything learnt and zero the statistics                                                 */
+/************************************************************/
+void bpred_reset() {
+    uint32_t counters = 1u << BPRED.config.table_bits;
+
+    if (BPRED.bimodal != NULL) {
+        memset(BPRED.bimodal, COUNTER_INIT, counters);
+    }
+    if (BPRED.gshare != NULL) {
+        memset(BPRED.gshare, COUNTER_INIT, counters);
+    }
+    if (BPRED.chooser != NULL) {
+        memset(BPRED.chooser, COUNTER_INIT, counters);
+    }
+    if (BPRED.config.btb_entries > 0) {
+        memset(BPRED.btb_tags, 0, BPRED.config.btb_entries * sizeof(uint32_t));
+    }
+    BPRED.history = 0;
+    BPRED.ras_top = 0;
+    if (BPRED.sites != NULL) {
+        memset(BPRED.sites, 0, BPRED.site_slots * sizeof(bpred_site_t));
+    }
+    BPRED.site_count = 0;
+    memset(&BPRED.stats, 0, sizeof(BPRED.stats));
+}
+
+uint64_t bpred_budget(const bpred_t *b) {
+    uint64_t tables = uses_bimodal(b->config.scheme) + uses_gshare(b->config.scheme) +
+                      (b->config.scheme == BPRED_TOURNAMENT);
+
+    return tables * 2 * (1ull << b->config.table_bits) + (uses_gshare(b->config.scheme) ? b->config.history_bits : 0) +
+           (uint64_t) b->config.btb_entries * 2 * PC_BITS + (uint64_t) b->config.ras_depth * PC_BITS;
+}
+
+/************************************************************/
+/* Tables                                                                                                                  */
+/************************************************************/
+static uint32_t bimodal_index(uint32_t pc) {
+    return (pc >> 2) & ((1u << BPRED.config.table_bits) - 1);
+}
+
+static uint32_t gshare_index(uint32_t pc, uint32_t history) {
+    history = BPRED.config.history_bits == 32 ? history : history & ((1u << BPRED.config.history_bits) - 1);
+
+    return ((pc >> 2) ^ history) & ((1u << BPRED.config.table_bits) - 1);
+}
+
+static void train(uint8_t *counter, int taken) {
+    if (taken && *counter < 3) {
+        (*counter)++;
+    } else if (!taken && *counter > 0) {
+        (*counter)--;
+    }
+}
+
+/* whether the scheme has the conditional branch d at pc taken */
+static int predict_taken(uint32_t pc, const decoded_insn_t *d) {
+    switch (BPRED.config.scheme) {
+        case BPRED_STATIC:
+            return d->target <= pc;
+        case BPRED_BIMODAL:
+            return BPRED.bimodal[bimodal_index(pc)] >= 2;
+        case BPRED_GSHARE:
+            return BPRED.gshare[gshare_index(pc, BPRED.history)] >= 2;
+        default:
+            if (BPRED.chooser[bimodal_index(pc)] >= 2) {
+                return BPRED.gshare[gshare_index(pc, BPRED.history)] >= 2;
+            }
+            return BPRED.bimodal[bimodal_index(pc)] >= 2;
+    }
+}
+
+/* train the counters the prediction made with history read */
+static void train_direction(uint32_t pc, uint32_t history, int taken) {
+    uint8_t *local = NULL, *global = NULL;
+
+    if (uses_bimodal(BPRED.config.scheme)) {
+        local = &BPRED.bimodal[bimodal_index(pc)];
+    }
+    if (uses_gshare(BPRED.config.scheme)) {
+        global = &BPRED.gshare[gshare_index(pc, history)];
+    }
+    if (local != NULL && global != NULL && (*local >= 2) != (*global >= 2)) {
+        /* lean toward whichever side was right */
+        train(&BPRED.chooser[bimodal_index(pc)], (*global >= 2) == taken);
+    }
+    if (local != NULL) {
+        train(local, taken);
+    }
+    if (global != NULL) {
+        train(global, taken);
+    }
+    BPRED.history = (BPRED.history << 1) | taken;
+}
+
+/* the target the BTB holds for pc, fall_through without one */
+static uint32_t btb_lookup(uint32_t pc, uint32_t fall_through) {
+    uint32_t entry;
+
+    if (BPRED.config.btb_entries == 0) {
+        return fall_through;
+    }
+    entry = (pc >> 2) & (BPRED.config.btb_entries - 1);
+    return BPRED.btb_tags[entry] == pc + 1 ? BPRED.btb_targets[entry] : fall_through;
+}
+
+static void btb_update(uint32_t pc, uint32_t target) {
+    uint32_t entry;
+
+    if (BPRED.config.btb_entries == 0) {
+        return;
+    }
+    entry = (pc >> 2) & (BPRED.config.btb_entries - 1);
+    BPRED.btb_tags[entry] = pc + 1;     /* + 1 so that PC 0 is not an empty entry */
+    BPRED.btb_targets[entry] = target;
+}
+
+static void ras_push(uint32_t address) {
+    if (BPRED.config.ras_depth == 0) {
+        return;
+    }
+    if (BPRED.ras_top == BPRED.config.ras_depth) {
+        memmove(BPRED.ras, BPRED.ras + 1, (BPRED.ras_top - 1) * sizeof(uint32_t));
+        BPRED.ras_top--;
+    }
+    BPRED.ras[BPRED.ras_top++] = address;
+}
+
+/* the counts kept for the branch at pc */
+static bpred_site_t *site(uint32_t pc) {
+    bpred_site_t *old = BPRED.sites;
+    uint32_t slots = BPRED.site_slots, i, slot;
+
+    if (2 * (BPRED.site_count + 1) > BPRED.site_slots) {
+        BPRED.site_slots = slots == 0 ? FIRST_SITE_SLOTS : 2 * slots;
+        BPRED.sites = calloc(BPRED.site_slots, sizeof(bpred_site_t));
+        if (BPRED.sites == NULL) {
+            printf("Error: Out of memory counting %u branches\n", BPRED.site_count);
+            exit(-1);
+        }
+        for (i = 0; i < slots; i++) {
+            if (old[i].executed == 0) {
+                continue;
+            }
+            for (slot = (old[i].pc >> 2) * 2654435761u; BPRED.sites[slot & (BPRED.site_slots - 1)].executed != 0; slot++) {
+            }
+            BPRED.sites[slot & (BPRED.site_slots - 1)] = old[i];
+        }
+        free(old);
+    }
+    for (slot = (pc >> 2) * 2654435761u;; slot++) {
+        bpred_site_t *s = &BPRED.sites[slot & (BPRED.site_slots - 1)];
+
+        if (s->executed == 0) {
+            s->pc = pc;
+            BPRED.site_count++;
+            return s;
+        }
+        if (s->pc == pc) {
+            return s;
+        }
+    }
+}
+
+/************************************************************/
+/* Predict the PC after the instruction at pc                                                         */
+/************************************************************/
+uint32_t bpred_predict(uint32_t pc, bpred_prediction_t *p) {
+    const decoded_insn_t *d = predecode_fetch(pc);
+    uint32_t fall_through = pc + 4;
+
+    p->history = BPRED.history;
+    p->taken = 0;
+    p->from_ras = 0;
+    switch (branch_kind(d)) {
+        case KIND_CONDITIONAL:
+            p->taken = predict_taken(pc, d);
+            p->next_pc = p->taken ? btb_lookup(pc, fall_through) : fall_through;
+            break;
+        case KIND_JR:
+            if (d->rs == 31 && BPRED.ras_top > 0) {
+                p->from_ras = 1;
+                p->next_pc = BPRED.ras[BPRED.ras_top - 1];
+            } else {
+                p->next_pc = btb_lookup(pc, fall_through);
+            }
+            break;
+        case KIND_JALR:
+            p->next_pc = btb_lookup(pc, fall_through);
+            break;
+        default:
+            p->next_pc = fall_through;
+            break;
+    }
+    return p->next_pc;
+}
+
+/************************************************************/
+/* Score a prediction and train on the outcome                                                       */
+/************************************************************/
+void bpred_resolve(uint32_t pc, const bpred_prediction_t *p, uint32_t next_pc) {
+    const decoded_insn_t *d = predecode_fetch(pc);
+    int kind = branch_kind(d), taken = next_pc != pc + 4, miss = p->next_pc != next_pc, wrong_way = 0;
+    bpred_site_t *s;
+
+    BPRED.stats.instructions++;
+    if (kind == KIND_NONE) {
+        return;
+    }
+    BPRED.stats.branches++;
+    BPRED.stats.taken += taken;
+    BPRED.stats.mispredicts += miss;
+    s = site(pc);
+    s->executed++;
+    s->taken += taken;
+    s->mispredicts += miss;
+    if (kind == KIND_CONDITIONAL) {
+        BPRED.stats.conditional++;
+        wrong_way = p->taken != taken;
+        BPRED.stats.direction_mispredicts += miss && wrong_way;
+        train_direction(pc, p->history, taken);
+    }
+    if (kind == KIND_JR && d->rs == 31 && BPRED.ras_top > 0) {
+        BPRED.ras_top--;
+    }
+    if (p->from_ras) {
+        /* a return: the stack predicted it, not the BTB */
+        BPRED.stats.ras_mispredicts += miss;
+        return;
+    }
+    BPRED.stats.btb_misses += miss && !wrong_way;
+    if (kind == KIND_JALR) {
+        ras_push(pc + 8);   /* the link JALR writes */
+    }
+    if (taken) {
+        btb_update(pc, next_pc);
+    }
+}
+
+/************************************************************/
+/* The branch PCs mispredicted most                                                                     */
+/************************************************************/
+static int by_mispredicts(const void *a, const void *b) {
+    const bpred_site_t *x = a, *y = b;
+
+    if (x->mispredicts != y->mispredicts) {
+        return x->mispredicts < y->mispredicts ? 1 : -1;
+    }
+    if (x->executed != y->executed) {
+        return x->executed < y->executed ? 1 : -1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+uint32_t bpred_worst_sites(bpred_site_t *sites, uint32_t max) {
+    bpred_site_t *all;
+    uint32_t i, n = 0;
+
+    if (BPRED.site_count == 0) {
+        return 0;
+    }
+    all = malloc(BPRED.site_count * sizeof(bpred_site_t));
+    if (all == NULL) {
+        printf("Error: Out of memory sorting %u branches\n", BPRED.site_count);
+        exit(-1);
+    }
+    for (i = 0; i < BPRED.site_slots; i++) {
+        if (BPRED.sites[i].executed != 0) {
+            all[n++] = BPRED.sites[i];
+        }
+    }
+    qsort(all, n, sizeof(bpred_site_t), by_mispredicts);
+    if (n > max) {
+        n = max;
+    }
+    memcpy(sites, all, n * sizeof(bpred_site_t));
+    free(all);
+    return n;
+}
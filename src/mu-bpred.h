@@ -0,0 +1,107 @@
+#ifndef MU_BPRED_H
+#define MU_BPRED_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Branch predictor model                                                                                                                               */
+/******************************************************************************/
+/* predicts, for the instruction at a PC, the PC after it, and scores the guess once the
+ * instruction has run. The direction of the conditional branches comes from the scheme:
+ *   static      backward taken, forward not taken
+ *   bimodal     a table of 2-bit counters indexed by the PC
+ *   gshare      2-bit counters indexed by the PC xor the global history of directions
+ *   tournament  bimodal and gshare, with a table of 2-bit counters per PC choosing between them
+ * A taken branch and JALR go to the target the direct-mapped BTB remembers for their PC (none:
+ * the fetch goes on at PC + 4), JR $31 to the top of the return address stack, which JALR
+ * pushes. Like a fetch unit with predecode bits, the predictor knows which instructions are
+ * branches before they run; everything else goes on at PC + 4.
+ * The tables, the history and the stack change only as branches resolve, never down a wrong
+ * path. A prediction keeps the history it was made with, so a branch fetched before older ones
+ * resolved still trains, and is scored against, the counter it was predicted from.
+ * The pipeline engine fetches from the predicted PC; the functional engines score a prediction
+ * for every instruction instead (and so step through cycle() while it is on). */
+#define BPRED_STATIC     0
+#define BPRED_BIMODAL    1
+#define BPRED_GSHARE     2
+#define BPRED_TOURNAMENT 3
+#define BPRED_SCHEMES    4
+
+typedef struct {
+	uint8_t scheme;             /* BPRED_* */
+	uint8_t table_bits;         /* log2 of the counters in each table */
+	uint8_t history_bits;       /* gshare's global history */
+	uint32_t btb_entries;       /* power of two, 0 for no BTB */
+	uint32_t ras_depth;         /* 0 for no return address stack */
+} bpred_config_t;
+
+/* what the predictor guessed for one instruction, kept until the instruction resolves */
+typedef struct {
+	uint32_t next_pc;
+	uint32_t history;           /* global history the direction was read with */
+	uint8_t taken;              /* conditional branches: the direction guessed */
+	uint8_t from_ras;           /* next_pc came off the return address stack */
+} bpred_prediction_t;
+
+/* what one branch PC did */
+typedef struct {
+	uint32_t pc;
+	uint32_t executed;          /* 0 marks a free slot */
+	uint32_t taken;
+	uint32_t mispredicts;
+} bpred_site_t;
+
+typedef struct {
+	uint64_t instructions;      /* scored */
+	uint64_t branches;          /* control transfers: branches, JR and JALR */
+	uint64_t conditional;
+	uint64_t taken;
+	uint64_t mispredicts;       /* predicted next PC wrong, one of: */
+	uint64_t direction_mispredicts; /*   conditional branches that went the other way */
+	uint64_t btb_misses;        /*   right direction, but the BTB had no target or the wrong one */
+	uint64_t ras_mispredicts;   /*   returns the stack got wrong */
+} bpred_stats_t;
+
+typedef struct {
+	int enabled;
+	bpred_config_t config;
+	uint8_t *bimodal;           /* 2-bit counters, also the tournament's local side */
+	uint8_t *gshare;
+	uint8_t *chooser;           /* tournament: 2 and up picks gshare */
+	uint32_t history;
+	uint32_t *btb_tags;         /* PC + 1 of the branch in each entry, 0 for none */
+	uint32_t *btb_targets;
+	uint32_t *ras;
+	uint32_t ras_top;           /* entries in use; a full stack drops its oldest */
+	bpred_site_t *sites;        /* open-addressed table of branch PCs */
+	uint32_t site_slots;        /* power of two */
+	uint32_t site_count;
+	bpred_stats_t stats;
+} bpred_t;
+
+/* the current simulator's predictor */
+#define BPRED (SIM->bpred)
+
+extern const char *const BPRED_SCHEME_NAMES[BPRED_SCHEMES];
+
+/* gshare with 4K-counter tables, 12 bits of history, a 512-entry BTB and a 16-deep stack */
+void bpred_defaults(bpred_t *b);
+/* change the predictor's tables, emptying them; returns 0, -1 (and changes nothing) if the
+ * BTB size is not a power of two, a table would have more than 2^24 entries, the history more
+ * than 32 bits or the stack more than 4096 */
+int bpred_configure(bpred_t *b, const bpred_config_t *config);
+void bpred_free(bpred_t *b);
+/* forget everything learnt and zero the statistics */
+void bpred_reset();
+/* storage the configured tables take, in bits */
+uint64_t bpred_budget(const bpred_t *b);
+
+/* the PC predicted to follow the instruction at pc, with what it was based on in p */
+uint32_t bpred_predict(uint32_t pc, bpred_prediction_t *p);
+/* score p against the next_pc the instruction at pc went to, and learn from it */
+void bpred_resolve(uint32_t pc, const bpred_prediction_t *p, uint32_t next_pc);
+/* fills sites (which holds max) with the branch PCs mispredicted most, most first;
+ * returns how many it filled */
+uint32_t bpred_worst_sites(bpred_site_t *sites, uint32_t max);
+
+#endif
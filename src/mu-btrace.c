@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "mu-sim.h"
+#include "mu-btrace.h"
+
+/************************************************************/
+/* Binary trace writer                                                                                             */
+/*                                                                                                                               */
+/* The simulator fills the ring a chunk at a time and hands each full chunk to the     */
+/* writer thread, which writes it out while the next chunks fill. Nothing is ever       */
+/* dropped: when every chunk is waiting to be written the simulator waits too.          */
+/************************************************************/
+
+int BTRACE_ACTIVE;
+
+static FILE *BTRACE_FILE;
+static btrace_record_t *RING;                   /* BTRACE_CHUNKS * BTRACE_CHUNK_RECORDS */
+static uint32_t CHUNK_LENGTH[BTRACE_CHUNKS];    /* records in each handed-over chunk */
+static uint64_t PRODUCED, CONSUMED;             /* chunks handed over / written */
+static uint32_t FILL;                           /* records in the chunk being filled */
+static int CLOSING;
+static int WRITE_FAILED;
+
+static pthread_t WRITER;
+static pthread_mutex_t RING_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t CHUNK_READY = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t CHUNK_FREE = PTHREAD_COND_INITIALIZER;
+
+/* the record being filled between btrace_begin() and btrace_end() */
+static btrace_record_t *CURRENT_RECORD;
+
+static void *btrace_writer(void *unused) {
+    uint32_t chunk;
+
+    pthread_mutex_lock(&RING_LOCK);
+    for (;;) {
+        while (CONSUMED == PRODUCED && !CLOSING) {
+            pthread_cond_wait(&CHUNK_READY, &RING_LOCK);
+        }
+        if (CONSUMED == PRODUCED) {
+            break;
+        }
+        chunk = CONSUMED % BTRACE_CHUNKS;
+        pthread_mutex_unlock(&RING_LOCK);
+
+        if (fwrite(&RING[chunk * BTRACE_CHUNK_RECORDS], sizeof(btrace_record_t), CHUNK_LENGTH[chunk], BTRACE_FILE) != CHUNK_LENGTH[chunk]) {
+            WRITE_FAILED = 1;
+        }
+
+        pthread_mutex_lock(&RING_LOCK);
+        CONSUMED++;
+        pthread_cond_signal(&CHUNK_FREE);
+    }
+    pthread_mutex_unlock(&RING_LOCK);
+    return NULL;
+}
+
+/************************************************************/
+/* Hand the chunk being filled to the writer and wait for a free one                      */
+/************************************************************/
+static void hand_over_chunk() {
+    pthread_mutex_lock(&RING_LOCK);
+    CHUNK_LENGTH[PRODUCED % BTRACE_CHUNKS] = FILL;
+    PRODUCED++;
+    pthread_cond_signal(&CHUNK_READY);
+    while (PRODUCED - CONSUMED == BTRACE_CHUNKS) {
+        pthread_cond_wait(&CHUNK_FREE, &RING_LOCK);
+    }
+    pthread_mutex_unlock(&RING_LOCK);
+    FILL = 0;
+}
+
+/************************************************************/
+/* Start tracing every executed instruction to path                                                 */
+/************************************************************/
+int btrace_open(const char *path) {
+    btrace_header_t header;
+
+    if (BTRACE_ACTIVE) {
+        btrace_close();
+    }
+    BTRACE_FILE = fopen(path, "wb");
+    if (BTRACE_FILE == NULL) {
+        printf("Error: Can't open trace file %s\n", path);
+        return 0;
+    }
+    if (RING == NULL) {
+        RING = malloc((size_t) BTRACE_CHUNKS * BTRACE_CHUNK_RECORDS * sizeof(btrace_record_t));
+        if (RING == NULL) {
+            printf("Error: Out of memory allocating the trace buffer\n");
+            exit(-1);
+        }
+        /* the simulator exits from several places; flush whatever is still buffered */
+        atexit(btrace_close);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BTRACE_MAGIC, sizeof(header.magic));
+    header.version = BTRACE_VERSION;
+    header.record_size = sizeof(btrace_record_t);
+    /* a header that could not be written is reported when the trace is closed */
+    WRITE_FAILED = fwrite(&header, sizeof(header), 1, BTRACE_FILE) != 1;
+
+    PRODUCED = CONSUMED = 0;
+    FILL = 0;
+    CLOSING = 0;
+    if (pthread_create(&WRITER, NULL, btrace_writer, NULL) != 0) {
+        printf("Error: Can't start the trace writer\n");
+        fclose(BTRACE_FILE);
+        return 0;
+    }
+    BTRACE_ACTIVE = 1;
+    return 1;
+}
+
+/************************************************************/
+/* Write out everything traced so far and stop tracing                                             */
+/************************************************************/
+void btrace_close() {
+    if (!BTRACE_ACTIVE) {
+        return;
+    }
+    BTRACE_ACTIVE = 0;
+    if (FILL > 0) {
+        hand_over_chunk();
+    }
+    pthread_mutex_lock(&RING_LOCK);
+    CLOSING = 1;
+    pthread_cond_signal(&CHUNK_READY);
+    pthread_mutex_unlock(&RING_LOCK);
+    pthread_join(WRITER, NULL);
+
+    if (fclose(BTRACE_FILE) != 0 || WRITE_FAILED) {
+        printf("Error: Writing the trace file failed\n");
+    }
+    BTRACE_FILE = NULL;
+}
+
+/************************************************************/
+/* Start the record of the instruction about to execute at pc                                  */
+/* Everything taken from d is filled in here: a store into a text page re-decodes    */
+/* the page, so d may no longer describe the instruction once it has run.              */
+/************************************************************/
+void btrace_begin(uint32_t pc, const decoded_insn_t *d) {
+    btrace_record_t *r = &RING[(PRODUCED % BTRACE_CHUNKS) * BTRACE_CHUNK_RECORDS + FILL];
+
+    r->pc = pc;
+    r->ins = d->ins;
+    r->value = 0;
+    r->address = 0;
+    r->dest = BTRACE_DEST_NONE;
+    r->flags = 0;
+    r->reserved = 0;
+
+    switch (d->op) {
+        case OP_ADD:
+        case OP_ADDU:
+        case OP_SUB:
+        case OP_SUBU:
+        case OP_AND:
+        case OP_OR:
+        case OP_XOR:
+        case OP_NOR:
+        case OP_SLT:
+        case OP_SLL:
+        case OP_SRL:
+        case OP_SRA:
+        case OP_JALR:
+        case OP_MFLO:
+        case OP_MFHI:
+            r->dest = d->rd;
+            break;
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_ANDI:
+        case OP_ORI:
+        case OP_XORI:
+        case OP_LUI:
+            r->dest = d->rt;
+            break;
+        case OP_SLTI:  /* executes as LW */
+        case OP_LW:
+        case OP_LB:
+        case OP_LH:
+            r->dest = d->rt;
+            r->flags = BTRACE_LOAD;
+            r->address = d->imm + CURRENT_STATE.REGS[d->rs];
+            break;
+        case OP_SW:
+        case OP_SB:
+        case OP_SH:
+            r->flags = BTRACE_STORE;
+            r->address = d->imm + CURRENT_STATE.REGS[d->rs];
+            r->value = CURRENT_STATE.REGS[d->rt];
+            break;
+        case OP_SYSCALL:
+            r->dest = 0;
+            break;
+        case OP_MULT:
+        case OP_MULTU:
+        case OP_DIV:
+        case OP_DIVU:
+        case OP_MTLO:
+            r->dest = BTRACE_DEST_LO;
+            break;
+        case OP_MTHI:
+            r->dest = BTRACE_DEST_HI;
+            break;
+    }
+    CURRENT_RECORD = r;
+}
+
+/************************************************************/
+/* Complete the record with the instruction's result                                                */
+/************************************************************/
+void btrace_end() {
+    btrace_record_t *r = CURRENT_RECORD;
+
+    if (r->dest < MIPS_REGS) {
+        r->value = CURRENT_STATE.REGS[r->dest];
+    } else if (r->dest == BTRACE_DEST_LO) {
+        r->value = CURRENT_STATE.LO;
+    } else if (r->dest == BTRACE_DEST_HI) {
+        r->value = CURRENT_STATE.HI;
+    }
+
+    if (++FILL == BTRACE_CHUNK_RECORDS) {
+        hand_over_chunk();
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef MU_BTRACE_H
+#define MU_BTRACE_H
+
+#include <stdint.h>
+
+#include "mu-decode.h"
+#include "mu-trace.h"
+
+/******************************************************************************/
+/* Binary execution trace                                                                                                                              */
+/******************************************************************************/
+/* a trace file is a btrace_header_t followed by one btrace_record_t per executed instruction,
+ * all in the byte order of the host that wrote it (a reader on a host of the other order finds
+ * the version wrong and rejects the file). Records are collected in an in-memory ring and written out by a background
+ * thread, so the simulator only stalls when the disk falls a whole ring behind.
+ * Decode or filter trace files with mu-mips-trace. */
+#define BTRACE_MAGIC "MUBTRACE"
+#define BTRACE_VERSION 1
+
+/* btrace_record_t.dest for values not going to a GPR */
+#define BTRACE_DEST_HI   32
+#define BTRACE_DEST_LO   33  /* also MULT/DIV, which record LO only */
+#define BTRACE_DEST_NONE 0xFF
+
+/* btrace_record_t.flags */
+#define BTRACE_LOAD  0x1   /* address is the effective address of a load */
+#define BTRACE_STORE 0x2   /* address is the effective address of a store, value the stored word */
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+} btrace_header_t;
+
+typedef struct {
+	uint32_t pc;
+	uint32_t ins;
+	uint32_t value;      /* new value of dest (or the stored word) */
+	uint32_t address;    /* with BTRACE_LOAD/BTRACE_STORE */
+	uint8_t dest;        /* GPR number, BTRACE_DEST_HI/LO or BTRACE_DEST_NONE */
+	uint8_t flags;
+	uint16_t reserved;
+} btrace_record_t;
+
+/* records per write; the ring holds BTRACE_CHUNKS of them */
+#define BTRACE_CHUNK_RECORDS 4096
+#define BTRACE_CHUNKS 256
+
+extern int BTRACE_ACTIVE;
+
+int btrace_open(const char *path);
+void btrace_close();
+void btrace_begin(uint32_t pc, const decoded_insn_t *d);
+void btrace_end();
+
+/* trace points around each instruction cycle() executes; like the text trace, they are
+ * compiled out of a TRACE=off build */
+#if MU_TRACE_MAX > TRACE_OFF
+#define BTRACE_BEGIN(pc, d) \
+    do { \
+        if (BTRACE_ACTIVE) { \
+            btrace_begin(pc, d); \
+        } \
+    } while (0)
+#define BTRACE_END() \
+    do { \
+        if (BTRACE_ACTIVE) { \
+            btrace_end(); \
+        } \
+    } while (0)
+#else
+#define BTRACE_BEGIN(pc, d) ((void) 0)
+#define BTRACE_END() ((void) 0)
+#endif
+
+#endif
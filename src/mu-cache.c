@@ -0,0 +1,270 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-sim.h"
+#include "mu-cache.h"
+
+/************************************************************/
+/* Cache hierarchy                                                                                                      */
+/*                                                                                                                               */
+/* A miss fills its line from the level below (L2, else memory) and costs the hit      */
+/* latency plus whatever the fill cost there.                                                           */
+/************************************************************/
+
+#define RANDOM_SEED 0x2545F491
+
+const char *const CACHE_NAMES[CACHE_LEVELS] = { "l1i", "l1d", "l2" };
+
+static int is_power_of_two(uint32_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+/************************************************************/
+/* The hierarchy cache on turns on                                                                       */
+/************************************************************/
+void cache_defaults(cache_hierarchy_t *h) {
+    static const cache_config_t defaults[CACHE_LEVELS] = {
+        [CACHE_L1I] = { 16 << 10, 2, 32, CACHE_LRU, 1, 1, 1 },
+        [CACHE_L1D] = { 16 << 10, 4, 32, CACHE_LRU, 1, 1, 1 },
+        [CACHE_L2] = { 256 << 10, 8, 64, CACHE_LRU, 1, 1, 10 }
+    };
+    int i;
+
+    h->memory_latency = 100;
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        cache_configure(&h->level[i], &defaults[i]);
+    }
+}
+
+/************************************************************/
+/* Give a level a new geometry                                                                            */
+/************************************************************/
+int cache_configure(cache_t *c, const cache_config_t *config) {
+    uint32_t sets = 0, lines = 0;
+    uint32_t *tags = NULL;
+    uint64_t *stamps = NULL, *plru = NULL;
+
+    if (config->size != 0) {
+        if (!is_power_of_two(config->size) || !is_power_of_two(config->ways) ||
+            !is_power_of_two(config->line_size) || config->line_size < 4 ||
+            config->size < config->ways * config->line_size || config->latency == 0 ||
+            config->replacement > CACHE_RANDOM || (config->replacement == CACHE_PLRU && config->ways > 64)) {
+            return -1;
+        }
+        lines = config->size / config->line_size;
+        sets = lines / config->ways;
+        tags = calloc(lines, sizeof(uint32_t));
+        if (config->replacement == CACHE_LRU) {
+            stamps = calloc(lines, sizeof(uint64_t));
+        } else if (config->replacement == CACHE_PLRU) {
+            plru = calloc(sets, sizeof(uint64_t));
+        }
+        if (tags == NULL || (config->replacement == CACHE_LRU && stamps == NULL) ||
+            (config->replacement == CACHE_PLRU && plru == NULL)) {
+            printf("Error: Out of memory allocating a %u byte cache\n", config->size);
+            exit(-1);
+        }
+    }
+    free(c->tags);
+    free(c->stamps);
+    free(c->plru);
+    memset(c, 0, sizeof(*c));
+    c->config = *config;
+    c->sets = sets;
+    while (config->size != 0 && (1u << c->line_shift) < config->line_size) {
+        c->line_shift++;
+    }
+    c->tags = tags;
+    c->stamps = stamps;
+    c->plru = plru;
+    c->random = RANDOM_SEED;
+    return 0;
+}
+
+void cache_free(cache_hierarchy_t *h) {
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        free(h->level[i].tags);
+        free(h->level[i].stamps);
+        free(h->level[i].plru);
+        memset(&h->level[i], 0, sizeof(cache_t));
+    }
+}
+
+/************************************************************/
+/* Empty every level and zero the statistics                                                          */
+/************************************************************/
+void caches_reset() {
+    cache_t *c;
+    int i;
+
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        c = &CACHES.level[i];
+        if (c->config.size == 0) {
+            continue;
+        }
+        memset(c->tags, 0, c->sets * c->config.ways * sizeof(uint32_t));
+        if (c->stamps != NULL) {
+            memset(c->stamps, 0, c->sets * c->config.ways * sizeof(uint64_t));
+        }
+        if (c->plru != NULL) {
+            memset(c->plru, 0, c->sets * sizeof(uint64_t));
+        }
+        c->clock = 0;
+        c->random = RANDOM_SEED;
+        memset(&c->stats, 0, sizeof(c->stats));
+    }
+}
+
+/************************************************************/
+/* Replacement                                                                                                           */
+/************************************************************/
+/* PLRU: node n of the tree (from 1) points at the half holding the next victim, 1 for the upper */
+static void touch(cache_t *c, uint32_t set, uint32_t way) {
+    uint32_t ways = c->config.ways, node = 1, span = ways;
+
+    switch (c->config.replacement) {
+        case CACHE_LRU:
+            c->stamps[set * ways + way] = ++c->clock;
+            break;
+        case CACHE_PLRU:
+            while (span > 1) {
+                span >>= 1;
+                if (way & span) {
+                    c->plru[set] &= ~(1ull << node);
+                    node = 2 * node + 1;
+                } else {
+                    c->plru[set] |= 1ull << node;
+                    node = 2 * node;
+                }
+            }
+            break;
+    }
+}
+
+static uint32_t victim(cache_t *c, uint32_t set, const uint32_t *tags) {
+    uint32_t ways = c->config.ways, way, best = 0, node = 1, span = ways;
+    const uint64_t *stamps;
+
+    for (way = 0; way < ways; way++) {
+        if (!(tags[way] & CACHE_VALID)) {
+            return way;
+        }
+    }
+    switch (c->config.replacement) {
+        case CACHE_LRU:
+            stamps = &c->stamps[set * ways];
+            for (way = 1; way < ways; way++) {
+                if (stamps[way] < stamps[best]) {
+                    best = way;
+                }
+            }
+            return best;
+        case CACHE_PLRU:
+            while (span > 1) {
+                span >>= 1;
+                if (c->plru[set] & (1ull << node)) {
+                    best |= span;
+                    node = 2 * node + 1;
+                } else {
+                    node = 2 * node;
+                }
+            }
+            return best;
+        default:
+            c->random ^= c->random << 13;
+            c->random ^= c->random >> 17;
+            c->random ^= c->random << 5;
+            return c->random & (ways - 1);
+    }
+}
+
+/************************************************************/
+/* Access a level                                                                                                        */
+/* Returns the cycles it takes.                                                                                  */
+/************************************************************/
+static uint32_t cache_access(int level, uint32_t address, int write);
+
+/* the level a miss in level goes to, -1 for memory */
+static int level_below(int level) {
+    return level != CACHE_L2 && CACHES.level[CACHE_L2].config.size != 0 ? CACHE_L2 : -1;
+}
+
+static uint32_t access_below(int level, uint32_t address, int write) {
+    int below = level_below(level);
+
+    return below < 0 ? CACHES.memory_latency : cache_access(below, address, write);
+}
+
+static uint32_t cache_access(int level, uint32_t address, int write) {
+    cache_t *c = &CACHES.level[level];
+    uint32_t ways = c->config.ways, way, cycles, line, set;
+    uint32_t *tags;
+
+    if (c->config.size == 0) {
+        return access_below(level, address, write);
+    }
+    line = address & ~(c->config.line_size - 1);
+    set = (address >> c->line_shift) & (c->sets - 1);
+    tags = &c->tags[set * ways];
+    if (write) {
+        c->stats.writes++;
+    } else {
+        c->stats.reads++;
+    }
+    for (way = 0; way < ways; way++) {
+        if ((tags[way] & ~CACHE_DIRTY) == (line | CACHE_VALID)) {
+            break;
+        }
+    }
+    cycles = c->config.latency;
+    if (way == ways) {
+        if (write) {
+            c->stats.write_misses++;
+        } else {
+            c->stats.read_misses++;
+        }
+        if (write && !c->config.write_allocate) {
+            /* the store goes around this level */
+            access_below(level, address, 1);
+            return cycles;
+        }
+        way = victim(c, set, tags);
+        if (tags[way] & CACHE_VALID) {
+            c->stats.evictions++;
+            if (tags[way] & CACHE_DIRTY) {
+                c->stats.writebacks++;
+                access_below(level, tags[way] & ~(CACHE_VALID | CACHE_DIRTY), 1);
+            }
+        }
+        cycles += access_below(level, line, 0);
+        tags[way] = line | CACHE_VALID;
+    }
+    touch(c, set, way);
+    if (write) {
+        if (c->config.write_back) {
+            tags[way] |= CACHE_DIRTY;
+        } else {
+            access_below(level, address, 1);
+        }
+    }
+    return cycles;
+}
+
+/************************************************************/
+/* Cycles an instruction fetch, load or store takes                                                */
+/************************************************************/
+uint32_t cache_fetch(uint32_t address) {
+    return CACHES.enabled ? cache_access(CACHE_L1I, address, 0) : 1;
+}
+
+uint32_t cache_load(uint32_t address) {
+    return CACHES.enabled ? cache_access(CACHE_L1D, address, 0) : 1;
+}
+
+uint32_t cache_store(uint32_t address) {
+    return CACHES.enabled ? cache_access(CACHE_L1D, address, 1) : 1;
+}
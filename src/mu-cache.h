@@ -0,0 +1,84 @@
+#ifndef MU_CACHE_H
+#define MU_CACHE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Cache hierarchy model                                                                                                                                  */
+/******************************************************************************/
+/* split L1 instruction and data caches in front of a unified L2 and memory. The caches keep
+ * tags only (the data stays in guest memory), so they change timing and nothing else: the
+ * pipeline engine asks them how many cycles a fetch or a load or store takes and stalls IF or
+ * MEM for the cycles beyond the first. A level with size 0 is left out, and with the hierarchy
+ * off every access takes one cycle.
+ * Each level's tags are one array, set after set, holding the line address with CACHE_VALID and
+ * CACHE_DIRTY in its low bits, so a lookup reads a single run of words. Write-through stores and
+ * the write-backs of dirty lines go on to the next level through a write buffer that never fills,
+ * so they are counted there but cost the store no time. */
+#define CACHE_L1I 0
+#define CACHE_L1D 1
+#define CACHE_L2  2
+#define CACHE_LEVELS 3
+
+#define CACHE_LRU    0
+#define CACHE_PLRU   1  /* tree pseudo-LRU */
+#define CACHE_RANDOM 2
+
+#define CACHE_VALID 0x1
+#define CACHE_DIRTY 0x2
+
+typedef struct {
+	uint32_t size;              /* bytes, 0 for no cache */
+	uint32_t ways;
+	uint32_t line_size;         /* bytes */
+	uint8_t replacement;        /* CACHE_LRU, CACHE_PLRU or CACHE_RANDOM */
+	uint8_t write_back;         /* else write-through */
+	uint8_t write_allocate;     /* a store miss fetches the line */
+	uint32_t latency;           /* cycles for a hit */
+} cache_config_t;
+
+typedef struct {
+	uint64_t reads, writes;
+	uint64_t read_misses, write_misses;
+	uint64_t evictions;         /* valid lines replaced */
+	uint64_t writebacks;        /* dirty lines written to the next level */
+} cache_stats_t;
+
+typedef struct {
+	cache_config_t config;
+	uint32_t sets;
+	uint32_t line_shift;
+	uint32_t *tags;             /* sets * ways */
+	uint64_t *stamps;           /* LRU: when each line was last used (64 bits never wrap) */
+	uint64_t *plru;             /* PLRU: one tree per set */
+	uint64_t clock;             /* LRU time */
+	uint32_t random;            /* xorshift state */
+	cache_stats_t stats;
+} cache_t;
+
+typedef struct {
+	int enabled;
+	uint32_t memory_latency;    /* cycles for a line from memory */
+	cache_t level[CACHE_LEVELS];
+} cache_hierarchy_t;
+
+/* the current simulator's caches */
+#define CACHES (SIM->caches)
+
+extern const char *const CACHE_NAMES[CACHE_LEVELS];
+
+/* the hierarchy the cache on command turns on */
+void cache_defaults(cache_hierarchy_t *h);
+/* give a level a new geometry, emptying it; returns 0, -1 (and changes nothing) if the sizes
+ * are not powers of two that fit together or PLRU has more than 64 ways */
+int cache_configure(cache_t *c, const cache_config_t *config);
+void cache_free(cache_hierarchy_t *h);
+/* empty every level and zero the statistics */
+void caches_reset();
+
+/* cycles an access of the current simulator takes */
+uint32_t cache_fetch(uint32_t address);
+uint32_t cache_load(uint32_t address);
+uint32_t cache_store(uint32_t address);
+
+#endif
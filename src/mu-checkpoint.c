@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mu-checkpoint.h"
+#include "mu-load.h"
+
+/************************************************************/
+/* Checkpoints                                                                                                           */
+/*                                                                                                                               */
+/* Saves a simulator to a file and resumes it by mapping the file's page data.       */
+/************************************************************/
+
+static const uint8_t ZERO_DATA[PAGE_SIZE];
+
+/************************************************************/
+/* Write a checkpoint                                                                                                  */
+/************************************************************/
+int mips_sim_checkpoint(mips_sim_t *sim, const char *path) {
+    mem_snapshot_t snap;
+    ckpt_header_t header;
+    char temp[sizeof(header.program_file) + 8];
+    uint32_t *addresses;
+    uint32_t i, pages;
+    FILE *fp;
+    int error = 0;
+
+    if (strlen(path) + 5 > sizeof(temp)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    sprintf(temp, "%s.tmp", path);
+    fp = fopen(temp, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+
+    mips_sim_select(sim);
+    /* an immutable view of memory, for the price of a pointer per page */
+    mem_snapshot(&snap);
+    addresses = malloc((snap.count + 1) * sizeof(uint32_t));
+    if (addresses == NULL) {
+        printf("Error: Out of memory writing a checkpoint\n");
+        exit(-1);
+    }
+    pages = 0;
+    for (i = 0; i < snap.count; i++) {
+        if (memcmp(snap.pages[i].data, ZERO_DATA, PAGE_SIZE) != 0) {
+            addresses[pages++] = snap.pages[i].address;
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CKPT_MAGIC, sizeof(header.magic));
+    header.version = CKPT_VERSION;
+    header.page_size = PAGE_SIZE;
+    header.record_size = PAGE_RECORD_SIZE;
+    header.page_count = pages;
+    header.records_offset = (sizeof(header) + pages * sizeof(uint32_t) + PAGE_MASK) & ~(uint64_t) PAGE_MASK;
+    header.state = CURRENT_STATE;
+    header.run_flag = RUN_FLAG;
+    header.instruction_count = INSTRUCTION_COUNT;
+    header.program_size = PROGRAM_SIZE;
+    header.prev_instruction = prevInstruction;
+    strcpy(header.program_file, prog_file);
+
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(addresses, sizeof(uint32_t), pages, fp) != pages ||
+        fseek(fp, header.records_offset, SEEK_SET) != 0) {
+        error = 1;
+    }
+    for (i = 0; i < snap.count && !error; i++) {
+        if (memcmp(snap.pages[i].data, ZERO_DATA, PAGE_SIZE) != 0 && write_page_records(fp, &snap.pages[i], 1) != 0) {
+            error = 1;
+        }
+    }
+    mem_snapshot_free(&snap);
+    free(addresses);
+
+    /* a preempted job must find either the old checkpoint or the whole new one */
+    if (fflush(fp) != 0 || fsync(fileno(fp)) != 0) {
+        error = 1;
+    }
+    if (fclose(fp) != 0 || error || rename(temp, path) != 0) {
+        error = errno;
+        unlink(temp);
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/************************************************************/
+/* Resume from a checkpoint                                                                                       */
+/************************************************************/
+int mips_sim_resume(mips_sim_t *sim, const char *path) {
+    ckpt_header_t header;
+    uint32_t *addresses;
+    struct stat st;
+    int fd, mapped;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (read(fd, &header, sizeof(header)) != sizeof(header) ||
+        memcmp(header.magic, CKPT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CKPT_VERSION || header.page_size != PAGE_SIZE ||
+        header.record_size != PAGE_RECORD_SIZE || fstat(fd, &st) != 0 ||
+        memchr(header.program_file, '\0', sizeof(header.program_file)) == NULL) {
+        close(fd);
+        return -1;
+    }
+    addresses = malloc((header.page_count + 1) * sizeof(uint32_t));
+    if (addresses == NULL) {
+        printf("Error: Out of memory reading a checkpoint\n");
+        exit(-1);
+    }
+    mips_sim_select(sim);
+    mapped = read(fd, addresses, header.page_count * sizeof(uint32_t)) == (ssize_t) (header.page_count * sizeof(uint32_t)) &&
+             map_page_records(fd, st.st_size, header.records_offset, addresses, header.page_count) == 0;
+    close(fd);
+    free(addresses);
+    if (!mapped) {
+        return -1;
+    }
+
+    CURRENT_STATE = header.state;
+    RUN_FLAG = header.run_flag;
+    INSTRUCTION_COUNT = header.instruction_count;
+    PROGRAM_SIZE = header.program_size;
+    prevInstruction = header.prev_instruction;
+    strcpy(prog_file, header.program_file);
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef MU_CHECKPOINT_H
+#define MU_CHECKPOINT_H
+
+#include <stdint.h>
+
+#include "mu-sim.h"
+
+/******************************************************************************/
+/* Checkpoint files                                                                                                                                          */
+/******************************************************************************/
+/* a checkpoint is a ckpt_header_t, the addresses of the pages it holds (ascending, one uint32_t
+ * each), then from records_offset their page records (mu-load.h). Pages that are all zero are
+ * left out. Everything is in host byte
+ * order. Resuming maps the file and points the page tables straight at the records, so it
+ * reads nothing but the header and the address list, however much memory the guest uses. */
+#define CKPT_MAGIC "MUCKPT\r\n"
+#define CKPT_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t page_size;        /* PAGE_SIZE */
+	uint32_t record_size;      /* PAGE_RECORD_SIZE */
+	uint32_t page_count;
+	uint64_t records_offset;   /* page aligned */
+	CPU_State state;
+	uint32_t run_flag;
+	uint32_t instruction_count;
+	uint32_t program_size;
+	uint32_t prev_instruction;
+	char program_file[256];
+} ckpt_header_t;
+
+/* write the machine state to path, replacing it only once the new file is complete;
+ * returns 0, or -1 with errno set */
+int mips_sim_checkpoint(mips_sim_t *sim, const char *path);
+/* continue from a checkpoint, as mips_sim_restore() would; mips_sim_reset() afterwards reloads
+ * the program named in it. Returns 0, -1 if path can't be read or is not a checkpoint of this
+ * build (and then nothing changes) */
+int mips_sim_resume(mips_sim_t *sim, const char *path);
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+/* no tracing: the state handling is what gets measured */
+#define MU_TRACE_MAX 0
+
+#include "mu-mips.h"
+
+/***************************************************************/
+/* Per-cycle cost micro-benchmark                                                                              */
+/*                                                                                                                                    */
+/* Runs a program (restarting it at every SYSCALL) through two copies of the           */
+/* mu-ops.def handlers that differ only in how an instruction retires:                          */
+/*   copy      the old cycle(): results go to NEXT_STATE, which is then copied         */
+/*             whole into CURRENT_STATE                                                                        */
+/*   in-place  the current cycle(): results are written straight into CURRENT_STATE  */
+/* and reports the best-of-5 average cost of one cycle.                                            */
+/***************************************************************/
+
+#define BENCH_CYCLES 20000000
+#define BENCH_REPEATS 5
+
+/* the simulator mu-ops.def works on (normally created by mips_sim_new() in mu-sim.c) */
+_Thread_local mips_sim_t *SIM;
+static CPU_State NEXT_STATE;
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void restart() {
+    CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+    NEXT_STATE = CURRENT_STATE;
+    RUN_FLAG = TRUE;
+}
+
+static void cycle_copy() {
+    const decoded_insn_t *d = predecode_fetch(CURRENT_STATE.PC);
+    uint32_t rs = d->rs, rt = d->rt, rd = d->rd, sa = d->sa, im = d->imm, target = d->target;
+    uint32_t next_pc = CURRENT_STATE.PC + 0x4;
+
+    switch (d->op) {
+        default:
+#define TARGET(op) case OP_##op:
+#define NEXT_INSN() break
+#include "mu-ops.def"
+#undef TARGET
+#undef NEXT_INSN
+    }
+    NEXT_STATE.PC = next_pc;
+    CURRENT_STATE = NEXT_STATE;
+}
+
+static void cycle_in_place() {
+    const decoded_insn_t *d = predecode_fetch(CURRENT_STATE.PC);
+    uint32_t rs = d->rs, rt = d->rt, rd = d->rd, sa = d->sa, im = d->imm, target = d->target;
+    uint32_t next_pc = CURRENT_STATE.PC + 0x4;
+
+    switch (d->op) {
+        default:
+#define NEXT_STATE CURRENT_STATE
+#define TARGET(op) case OP_##op:
+#define NEXT_INSN() break
+#include "mu-ops.def"
+#undef TARGET
+#undef NEXT_INSN
+#undef NEXT_STATE
+    }
+    CURRENT_STATE.PC = next_pc;
+}
+
+static double bench_cycles(void (*step)()) {
+    double start, elapsed, best = 1e30;
+    int i, r;
+
+    for (r = 0; r < BENCH_REPEATS; r++) {
+        restart();
+        start = now_ns();
+        for (i = 0; i < BENCH_CYCLES; i++) {
+            step();
+            if (!RUN_FLAG) {
+                restart();
+            }
+        }
+        elapsed = (now_ns() - start) / BENCH_CYCLES;
+        best = elapsed < best ? elapsed : best;
+    }
+    return best;
+}
+
+static void bench_program(const char *path) {
+    FILE *fp;
+    uint32_t word;
+    uint32_t address = MEM_TEXT_BEGIN;
+    double copy_ns, in_place_ns;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Error: Can't open program file %s\n", path);
+        exit(-1);
+    }
+    SIM = calloc(1, sizeof(mips_sim_t));
+    if (SIM == NULL) {
+        printf("Error: Out of memory allocating a simulator\n");
+        exit(-1);
+    }
+    MEM = &SIM->mem;
+    PREDECODE = &SIM->decode;
+    init_memory();
+    init_predecode();
+    while (fscanf(fp, "%x\n", &word) == 1) {
+        mem_write_32(address, word);
+        address += 4;
+    }
+    fclose(fp);
+
+    copy_ns = bench_cycles(cycle_copy);
+    in_place_ns = bench_cycles(cycle_in_place);
+    printf("%-24s copy %6.2f ns/cycle  in-place %6.2f ns/cycle  (%.1f%% less)\n",
+           path, copy_ns, in_place_ns, 100.0 * (copy_ns - in_place_ns) / copy_ns);
+
+    reset_memory();
+    flush_predecode();
+    free(SIM);
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    if (argc < 2) {
+        printf("Usage: %s <input program>...\n", argv[0]);
+        exit(1);
+    }
+    for (i = 1; i < argc; i++) {
+        bench_program(argv[i]);
+    }
+    return 0;
+}
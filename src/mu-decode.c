@@ -0,0 +1,175 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-decode.h"
+
+#define OP_NAME(name, ...) [OP_##name] = #name,
+const char *const OP_NAMES[NUM_OPS] = {
+    [OP_UNDECODED] = "UNDECODED",
+    FOR_EACH_OP(OP_NAME)
+};
+#undef OP_NAME
+
+#define OP_WORD(name, class, code, operands, immediate) [OP_##name] = ISA_WORD(class, code),
+const uint32_t OP_WORDS[NUM_OPS] = {
+    MIPS_ISA(OP_WORD)
+};
+#undef OP_WORD
+
+#define OP_IMMEDIATE(name, class, code, operands, immediate) [OP_##name] = IMM_##immediate,
+const uint8_t OP_IMMEDIATES[NUM_OPS] = {
+    MIPS_ISA(OP_IMMEDIATE)
+};
+#undef OP_IMMEDIATE
+
+/************************************************************/
+/* Decode tables, generated from MIPS_ISA                                                             */
+/*                                                                                                                               */
+/* The opcode picks the op, or for opcodes 0 and 1 the second level table that the  */
+/* funct or the rt field picks it from. Encodings not in MIPS_ISA are OP_INVALID.       */
+/************************************************************/
+#define LEVEL_SPECIAL NUM_OPS
+#define LEVEL_REGIMM  (NUM_OPS + 1)
+
+/* ISA entries of one class */
+#define ONLY(class, wanted, ...) ONLY_##class##_##wanted(__VA_ARGS__)
+#define ONLY_SPECIAL_SPECIAL(...) __VA_ARGS__
+#define ONLY_SPECIAL_REGIMM(...)
+#define ONLY_SPECIAL_OPCODE(...)
+#define ONLY_REGIMM_SPECIAL(...)
+#define ONLY_REGIMM_REGIMM(...) __VA_ARGS__
+#define ONLY_REGIMM_OPCODE(...)
+#define ONLY_OPCODE_SPECIAL(...)
+#define ONLY_OPCODE_REGIMM(...)
+#define ONLY_OPCODE_OPCODE(...) __VA_ARGS__
+
+#define OPCODE_ENTRY(name, class, code, ...) ONLY(class, OPCODE, [code] = OP_##name,)
+#define SPECIAL_ENTRY(name, class, code, ...) ONLY(class, SPECIAL, [code] = OP_##name,)
+#define REGIMM_ENTRY(name, class, code, ...) ONLY(class, REGIMM, [code] = OP_##name,)
+
+static const uint8_t OPCODE_OPS[64] = {
+    [0 ... 63] = OP_INVALID,
+    [0x00] = LEVEL_SPECIAL,
+    [0x01] = LEVEL_REGIMM,
+    MIPS_ISA(OPCODE_ENTRY)
+};
+
+static const uint8_t SPECIAL_OPS[64] = {
+    [0 ... 63] = OP_INVALID,
+    MIPS_ISA(SPECIAL_ENTRY)
+};
+
+static const uint8_t REGIMM_OPS[32] = {
+    [0 ... 31] = OP_INVALID,
+    MIPS_ISA(REGIMM_ENTRY)
+};
+
+static const struct {
+    uint8_t shift, mask;    /* the field of the instruction word that indexes ops */
+    const uint8_t *ops;
+} SECOND_LEVEL[2] = {
+    [LEVEL_SPECIAL - NUM_OPS] = { 0, 0x3F, SPECIAL_OPS },
+    [LEVEL_REGIMM - NUM_OPS] = { 16, 0x1F, REGIMM_OPS }
+};
+
+_Thread_local predecode_t *PREDECODE;
+
+uint32_t extend_sign(uint32_t im) {
+    uint32_t data = (im & 0x0000FFFF);
+    uint32_t mask = 0x00008000;
+    if (mask & data) {
+        data = data | 0xFFFF0000;
+    }
+
+    return data;
+}
+
+/************************************************************/
+/* Decode an instruction word fetched from pc                                                        */
+/************************************************************/
+void decode_instruction(uint32_t ins, uint32_t pc, decoded_insn_t *d) {
+    uint32_t im = (0x0000FFFF & ins);
+    uint8_t op = OPCODE_OPS[ins >> 26];
+
+    if (op >= NUM_OPS) {
+        op = SECOND_LEVEL[op - NUM_OPS].ops[(ins >> SECOND_LEVEL[op - NUM_OPS].shift) & SECOND_LEVEL[op - NUM_OPS].mask];
+    }
+    d->ins = ins;
+    d->op = op;
+    d->rs = (0x03E00000 & ins) >> 21;
+    d->rt = (0x001F0000 & ins) >> 16;
+    d->rd = (0x0000F800 & ins) >> 11;
+    d->sa = (0x000007C0 & ins) >> 6;
+    d->target = pc + (extend_sign(im) << 2);
+    switch (OP_IMMEDIATES[op]) {
+        case IMM_ZERO: d->imm = im; break;
+        case IMM_UPPER: d->imm = im << 16; break;
+        default: d->imm = extend_sign(im); break;
+    }
+}
+
+/************************************************************/
+/* Drop the decoded records of a text page about to be written                              */
+/************************************************************/
+static void predecode_write_fault(uint32_t page_address) {
+    uint32_t offset = page_address - MEM_TEXT_BEGIN;
+    if (offset <= MEM_TEXT_END - MEM_TEXT_BEGIN && DECODE_PAGES[offset >> PAGE_SHIFT] != NULL) {
+        memset(DECODE_PAGES[offset >> PAGE_SHIFT], 0, INSNS_PER_PAGE * sizeof(decoded_insn_t));
+        CODE_GENERATION++;
+    }
+}
+
+/************************************************************/
+/* Decode and cache an instruction not yet in the predecode cache                             */
+/************************************************************/
+const decoded_insn_t *predecode_miss(uint32_t pc) {
+    uint32_t offset = pc - MEM_TEXT_BEGIN;
+    decoded_insn_t **page;
+    decoded_insn_t *d;
+
+    if (offset > MEM_TEXT_END - MEM_TEXT_BEGIN || (pc & 3) != 0) {
+        decode_instruction(mem_read_32(pc), pc, &PREDECODE->uncached);
+        return &PREDECODE->uncached;
+    }
+
+    page = &DECODE_PAGES[offset >> PAGE_SHIFT];
+    if (*page == NULL) {
+        *page = calloc(INSNS_PER_PAGE, sizeof(decoded_insn_t));
+        if (*page == NULL) {
+            printf("Error: Out of memory allocating predecode page for address 0x%08x\n", pc);
+            exit(-1);
+        }
+    }
+    /* any later store into this page must invalidate what we decode from it */
+    mem_write_protect(pc);
+    d = &(*page)[(offset & PAGE_MASK) >> 2];
+    decode_instruction(mem_read_32(pc), pc, d);
+    return d;
+}
+
+/************************************************************/
+/* Hook the predecode cache into the memory write path                                         */
+/************************************************************/
+void init_predecode() {
+    int i;
+    for (i = 0; i < TEXT_PAGES; i++) {
+        DECODE_PAGES[i] = NULL;
+    }
+    MEM_WRITE_FAULT_HOOK = predecode_write_fault;
+}
+
+/************************************************************/
+/* Drop every decoded record (memory was reloaded)                                              */
+/************************************************************/
+void flush_predecode() {
+    int i;
+    for (i = 0; i < TEXT_PAGES; i++) {
+        if (DECODE_PAGES[i] != NULL) {
+            free(DECODE_PAGES[i]);
+            DECODE_PAGES[i] = NULL;
+        }
+    }
+    CODE_GENERATION++;
+}
@@ -0,0 +1,152 @@
+#ifndef MU_DECODE_H
+#define MU_DECODE_H
+
+#include <stdint.h>
+
+#include "mu-mem.h"
+
+/******************************************************************************/
+/* Instruction set                                                                                                                                              */
+/******************************************************************************/
+/* every instruction the simulator implements: the one description the decoder, the disassembler and
+ * the assembler are generated from (what each instruction does is in mu-ops.def)
+ *   ISA(name, class, code, operands, immediate)
+ *     class      SPECIAL: opcode 0 and code is the funct field, REGIMM: opcode 1 and code is the rt
+ *                field, OPCODE: code is the opcode
+ *     operands   the assembler's operand syntax (mu-asm.c)
+ *     immediate  how the handler gets the 16-bit immediate: SIGNED (sign extended), ZERO (zero
+ *                extended) or UPPER (shifted into the upper half); R-type instructions don't use it
+ * J-format jumps (opcodes 2 and 3) are not implemented and decode as OP_INVALID. */
+#define MIPS_ISA(ISA) \
+	/* R-type */ \
+	ISA(ADD,     SPECIAL, 0x20, RD_RS_RT,     SIGNED) \
+	ISA(ADDU,    SPECIAL, 0x21, RD_RS_RT,     SIGNED) \
+	ISA(SUB,     SPECIAL, 0x22, RD_RS_RT,     SIGNED) \
+	ISA(SUBU,    SPECIAL, 0x23, RD_RS_RT,     SIGNED) \
+	ISA(MULT,    SPECIAL, 0x18, RS_RT,        SIGNED) \
+	ISA(MULTU,   SPECIAL, 0x19, RS_RT,        SIGNED) \
+	ISA(DIV,     SPECIAL, 0x1A, RS_RT,        SIGNED) \
+	ISA(DIVU,    SPECIAL, 0x1B, RS_RT,        SIGNED) \
+	ISA(AND,     SPECIAL, 0x24, RD_RS_RT,     SIGNED) \
+	ISA(OR,      SPECIAL, 0x25, RD_RS_RT,     SIGNED) \
+	ISA(XOR,     SPECIAL, 0x26, RD_RS_RT,     SIGNED) \
+	ISA(NOR,     SPECIAL, 0x27, RD_RS_RT,     SIGNED) \
+	ISA(SLT,     SPECIAL, 0x2A, RD_RS_RT,     SIGNED) \
+	ISA(SLL,     SPECIAL, 0x00, RD_RT_SA,     SIGNED) \
+	ISA(SRL,     SPECIAL, 0x02, RD_RT_SA,     SIGNED) \
+	ISA(SRA,     SPECIAL, 0x03, RD_RT_SA,     SIGNED) \
+	ISA(JR,      SPECIAL, 0x08, RS,           SIGNED) \
+	ISA(JALR,    SPECIAL, 0x09, JALR,         SIGNED) \
+	ISA(MTLO,    SPECIAL, 0x13, RS,           SIGNED) \
+	ISA(MTHI,    SPECIAL, 0x11, RS,           SIGNED) \
+	ISA(MFLO,    SPECIAL, 0x12, RD,           SIGNED) \
+	ISA(MFHI,    SPECIAL, 0x10, RD,           SIGNED) \
+	ISA(SYSCALL, SPECIAL, 0x0C, NONE,         SIGNED) \
+	/* I-type */ \
+	ISA(ADDI,    OPCODE,  0x08, RT_RS_IMM,    SIGNED) \
+	ISA(ADDIU,   OPCODE,  0x09, RT_RS_IMM,    SIGNED) \
+	ISA(ANDI,    OPCODE,  0x0C, RT_RS_IMM,    ZERO) \
+	ISA(ORI,     OPCODE,  0x0D, RT_RS_IMM,    ZERO) \
+	ISA(XORI,    OPCODE,  0x0E, RT_RS_IMM,    ZERO) \
+	ISA(SLTI,    OPCODE,  0x0A, RT_RS_IMM,    SIGNED) \
+	ISA(LW,      OPCODE,  0x23, MEMORY,       SIGNED) \
+	ISA(LB,      OPCODE,  0x20, MEMORY,       SIGNED) \
+	ISA(LH,      OPCODE,  0x21, MEMORY,       SIGNED) \
+	ISA(LUI,     OPCODE,  0x0F, RT_IMM,       UPPER) \
+	ISA(SW,      OPCODE,  0x2B, MEMORY,       SIGNED) \
+	ISA(SB,      OPCODE,  0x28, MEMORY,       SIGNED) \
+	ISA(SH,      OPCODE,  0x29, MEMORY,       SIGNED) \
+	ISA(BEQ,     OPCODE,  0x04, BRANCH_RS_RT, SIGNED) \
+	ISA(BNE,     OPCODE,  0x05, BRANCH_RS_RT, SIGNED) \
+	ISA(BLEZ,    OPCODE,  0x06, BRANCH_RS,    SIGNED) \
+	ISA(BGTZ,    OPCODE,  0x07, BRANCH_RS,    SIGNED) \
+	ISA(BLTZ,    REGIMM,  0x00, BRANCH_RS,    SIGNED) \
+	ISA(BGEZ,    REGIMM,  0x01, BRANCH_RS,    SIGNED)
+
+/* the instruction word of an ISA entry with every operand field zero */
+#define ISA_WORD(class, code) ISA_WORD_##class(code)
+#define ISA_WORD_SPECIAL(code) ((uint32_t) (code))
+#define ISA_WORD_REGIMM(code) ((0x01u << 26) | ((uint32_t) (code) << 16))
+#define ISA_WORD_OPCODE(code) ((uint32_t) (code) << 26)
+
+/* immediate handling, as in the ISA table */
+#define IMM_SIGNED 0
+#define IMM_ZERO   1
+#define IMM_UPPER  2
+
+/******************************************************************************/
+/* Decoded instructions                                                                                                                                     */
+/******************************************************************************/
+/* handler ids, one per instruction handle_instruction() implements. X is called with the name
+ * and, except for INVALID, the rest of the instruction's ISA entry.
+ * OP_UNDECODED marks an empty predecode slot, OP_INVALID an encoding with no handler (executes as a no-op). */
+#define FOR_EACH_OP(X) \
+	X(INVALID) \
+	MIPS_ISA(X)
+
+#define OP_ENUM(name, ...) OP_##name,
+typedef enum {
+	OP_UNDECODED = 0,
+	FOR_EACH_OP(OP_ENUM)
+	NUM_OPS
+} op_id_t;
+#undef OP_ENUM
+
+/* mnemonic of each op id, for traces */
+extern const char *const OP_NAMES[NUM_OPS];
+/* the instruction word of each op with every operand field zero */
+extern const uint32_t OP_WORDS[NUM_OPS];
+/* how each op gets its immediate (IMM_*) */
+extern const uint8_t OP_IMMEDIATES[NUM_OPS];
+
+typedef struct {
+	uint8_t op;         /* op_id_t */
+	uint8_t rs, rt, rd;
+	uint8_t sa;
+	uint32_t imm;       /* immediate as the handler consumes it: sign/zero extended, LUI already shifted */
+	uint32_t target;    /* taken target of PC-relative branches */
+	uint32_t ins;       /* raw instruction word, only used for tracing */
+} decoded_insn_t;
+
+uint32_t extend_sign(uint32_t im);
+void decode_instruction(uint32_t ins, uint32_t pc, decoded_insn_t *d);
+
+/******************************************************************************/
+/* Predecode cache                                                                                                                                         */
+/******************************************************************************/
+/* one decoded record per text word, allocated a page at a time. Pages holding decoded records are
+ * write protected, so a store into them drops the page's records before the store lands. */
+#define TEXT_PAGES (((MEM_TEXT_END - MEM_TEXT_BEGIN) >> PAGE_SHIFT) + 1)
+#define INSNS_PER_PAGE (PAGE_SIZE / 4)
+
+typedef struct {
+	decoded_insn_t *pages[TEXT_PAGES];
+	/* bumped whenever decoded records are dropped; anything derived from them (blocks) is stale */
+	uint32_t generation;
+	decoded_insn_t uncached;  /* record for fetches outside the text segment, which are never cached */
+} predecode_t;
+
+/* the predecode cache of the address space in MEM */
+extern _Thread_local predecode_t *PREDECODE;
+#define DECODE_PAGES (PREDECODE->pages)
+#define CODE_GENERATION (PREDECODE->generation)
+
+void init_predecode();
+void flush_predecode();
+const decoded_insn_t *predecode_miss(uint32_t pc);
+
+/***************************************************************/
+/* Decoded record for the instruction at pc                                                          */
+/***************************************************************/
+static inline const decoded_insn_t *predecode_fetch(uint32_t pc) {
+	uint32_t offset = pc - MEM_TEXT_BEGIN;
+	if (offset <= MEM_TEXT_END - MEM_TEXT_BEGIN && (pc & 3) == 0) {
+		decoded_insn_t *page = DECODE_PAGES[offset >> PAGE_SHIFT];
+		if (page != NULL && page[(offset & PAGE_MASK) >> 2].op != OP_UNDECODED) {
+			return &page[(offset & PAGE_MASK) >> 2];
+		}
+	}
+	return predecode_miss(pc);
+}
+
+#endif
@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-disasm.h"
+#include "mu-decode.h"
+
+/************************************************************/
+/* Print an instruction word (in MIPS assembly format)                                        */
+/*                                                                                                                               */
+/* The op comes from the decoder, so anything the simulator executes is listed and   */
+/* nothing else is: R-type words with their fields, the rest as I-type.                     */
+/************************************************************/
+void fprint_instruction(FILE *fp, uint32_t ins) {
+    decoded_insn_t d;
+    uint32_t opcode = (0xFC000000 & ins);
+
+    decode_instruction(ins, 0, &d);
+    if (d.op == OP_INVALID) {
+        return;
+    }
+    if (opcode == 0x00000000) {
+        //R-Type statement
+        fprintf(fp, "\n\n%s Instruction:"
+                   "\n-> OC: %x"
+                   "\n-> rs: %x"
+                   "\n-> rt: %x"
+                   "\n-> rd: %x"
+                   "\n-> shamt: %x"
+                   "\n-> func: %x\n",
+                   OP_NAMES[d.op], opcode, d.rs, d.rt, d.rd, d.sa, (0x0000003F & ins));
+    } else {
+        //I-type statement
+        fprintf(fp, "\n%s Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n",
+                OP_NAMES[d.op], opcode, d.rs, d.rt, (0x0000FFFF & ins));
+    }
+}
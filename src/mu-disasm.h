@@ -0,0 +1,10 @@
+#ifndef MU_DISASM_H
+#define MU_DISASM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* the listing print_instruction() produces, for any instruction word and output stream */
+void fprint_instruction(FILE *fp, uint32_t ins);
+
+#endif
@@ -0,0 +1,709 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "mu-sim.h"
+#include "mu-block.h"
+#include "mu-jit.h"
+#include "mu-btrace.h"
+
+#if defined(__x86_64__) && !defined(MU_NO_JIT)
+#include <sys/mman.h>
+
+/************************************************************/
+/* Block compiler                                                                                                        */
+/*                                                                                                                               */
+/* The generated function takes the CPU_State in rdi and keeps it in rbx; guest       */
+/* registers are read and written straight in that state, so nothing has to be          */
+/* written back when the native code returns. Loads and stores call back into the      */
+/* memory system when the inline page-table walk misses, and the few instructions    */
+/* with no native translation (MULT/DIV, SLTI, SYSCALL) call handle_instruction().   */
+/* Every exit stores the next PC and returns the number of guest instructions         */
+/* retired.                                                                                                             */
+/* Semantics follow mu-ops.def exactly, quirks included (OR is a logical or, SRA     */
+/* shifts in zeros, LB/LH OR in a constant).                                                           */
+/************************************************************/
+
+typedef uint32_t (*native_block_t)(CPU_State *state);
+
+/* worst-case code size of one guest instruction, exits included */
+#define JIT_MAX_INSN_BYTES 160
+
+/* the longest translation, SW/SB/SH: address 12, rt 6, page lookup 56, write-pointer and
+ * STORE_LOG_ACTIVE tests 28, inline store and jmp 8, callback and its test 14, jcc 6, exit 17 */
+#define JIT_STORE_BYTES 147
+typedef char insn_size_check[JIT_STORE_BYTES <= JIT_MAX_INSN_BYTES ? 1 : -1];
+
+/* room a block is given to compile into: its instructions plus the prologue and the exit */
+#define JIT_BLOCK_RESERVE ((MAX_BLOCK_LENGTH + 1) * JIT_MAX_INSN_BYTES)
+
+#define STATE_PC      offsetof(CPU_State, PC)
+#define STATE_REG(r)  (offsetof(CPU_State, REGS) + 4 * (r))
+#define STATE_HI      offsetof(CPU_State, HI)
+#define STATE_LO      offsetof(CPU_State, LO)
+
+/* log2(sizeof(mem_pte_t)), for indexing a page table */
+#define PTE_SHIFT 4
+typedef char pte_size_check[sizeof(mem_pte_t) == (1 << PTE_SHIFT) ? 1 : -1];
+
+/* host registers */
+#define EAX 0
+#define ECX 1
+#define ESI 6
+#define EDI 7
+
+/* condition codes (low nibble of Jcc/SETcc) */
+#define CC_B  0x2
+#define CC_E  0x4
+#define CC_NE 0x5
+#define CC_A  0x7
+
+/* group-1 ALU extensions (81 /ext) and shift extensions (C1 /ext) */
+#define ALU_ADD 0
+#define ALU_OR  1
+#define ALU_AND 4
+#define ALU_XOR 6
+#define SHIFT_SHL 4
+#define SHIFT_SHR 5
+
+/* ALU eax, [rbx+disp32] opcodes */
+#define OPC_ADD 0x03
+#define OPC_OR  0x0B
+#define OPC_AND 0x23
+#define OPC_SUB 0x2B
+#define OPC_XOR 0x33
+#define OPC_CMP 0x3B
+
+/* the current simulator's code cache */
+#define CODE_CACHE (SIM->jit.code)
+#define CODE_USED (SIM->jit.used)
+#define CODE_SIZE (SIM->jit.size)
+#define CODE_CACHE_FAILED (SIM->jit.failed)
+#define STORE_LOG (SIM->jit.store_log)
+#define STORE_LOG_LENGTH (SIM->jit.store_log_length)
+#define STORE_LOG_ACTIVE (SIM->jit.store_log_active)
+
+/* end of the code emitted so far, and of the room it may take */
+static _Thread_local uint8_t *emit_ptr, *emit_limit;
+/* set once an emitter found no room; the block is abandoned */
+static _Thread_local int emit_overflow;
+
+/************************************************************/
+/* Memory callbacks of the generated code                                                          */
+/************************************************************/
+static uint32_t jit_load(uint32_t address) {
+    return mem_read_32(address);
+}
+
+/* returns non-zero when the store hit translated code, which ends the native run */
+static uint32_t jit_store(uint32_t address, uint32_t value) {
+    uint32_t generation = CODE_GENERATION;
+    if (STORE_LOG_ACTIVE && STORE_LOG_LENGTH < MAX_BLOCK_LENGTH) {
+        STORE_LOG[STORE_LOG_LENGTH].address = address;
+        STORE_LOG[STORE_LOG_LENGTH].old_value = mem_read_32(address);
+        STORE_LOG[STORE_LOG_LENGTH].new_value = value;
+        STORE_LOG_LENGTH++;
+    }
+    mem_write_32(address, value);
+    return CODE_GENERATION != generation;
+}
+
+/* run the instruction at CURRENT_STATE.PC exactly as cycle() would */
+static void jit_fallback() {
+    handle_instruction();
+}
+
+/************************************************************/
+/* x86-64 encoders                                                                                                 */
+/************************************************************/
+static int emit_room(uint32_t bytes) {
+    if (emit_overflow || (size_t) (emit_limit - emit_ptr) < bytes) {
+        emit_overflow = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static void emit8(uint8_t byte) {
+    if (emit_room(1)) {
+        *emit_ptr++ = byte;
+    }
+}
+
+static void emit32(uint32_t value) {
+    if (emit_room(4)) {
+        memcpy(emit_ptr, &value, 4);
+        emit_ptr += 4;
+    }
+}
+
+static void emit64(uint64_t value) {
+    if (emit_room(8)) {
+        memcpy(emit_ptr, &value, 8);
+        emit_ptr += 8;
+    }
+}
+
+/* mov reg, [rbx+offset] */
+static void emit_load(int reg, uint32_t offset) {
+    emit8(0x8B);
+    emit8(0x80 | (reg << 3) | 3);
+    emit32(offset);
+}
+
+/* mov [rbx+offset], reg */
+static void emit_store(int reg, uint32_t offset) {
+    emit8(0x89);
+    emit8(0x80 | (reg << 3) | 3);
+    emit32(offset);
+}
+
+/* mov dword [rbx+offset], value */
+static void emit_store_imm(uint32_t offset, uint32_t value) {
+    emit8(0xC7);
+    emit8(0x83);
+    emit32(offset);
+    emit32(value);
+}
+
+/* <op> eax, [rbx+offset] */
+static void emit_alu_mem(uint8_t opcode, uint32_t offset) {
+    emit8(opcode);
+    emit8(0x83);
+    emit32(offset);
+}
+
+/* <op> reg, value */
+static void emit_alu_imm(int ext, int reg, uint32_t value) {
+    emit8(0x81);
+    emit8(0xC0 | (ext << 3) | reg);
+    emit32(value);
+}
+
+/* shl/shr reg, count */
+static void emit_shift(int ext, int reg, uint8_t count) {
+    emit8(0xC1);
+    emit8(0xC0 | (ext << 3) | reg);
+    emit8(count);
+}
+
+/* not reg */
+static void emit_not(int reg) {
+    emit8(0xF7);
+    emit8(0xD0 | reg);
+}
+
+/* test reg, reg */
+static void emit_test(int reg) {
+    emit8(0x85);
+    emit8(0xC0 | (reg << 3) | reg);
+}
+
+/* set<cc> reg8; movzx reg, reg8 (eax or ecx only) */
+static void emit_setcc(int cc, int reg) {
+    emit8(0x0F);
+    emit8(0x90 | cc);
+    emit8(0xC0 | reg);
+    emit8(0x0F);
+    emit8(0xB6);
+    emit8(0xC0 | (reg << 3) | reg);
+}
+
+/* mov rax, function; call rax */
+static void emit_call(const void *function) {
+    emit8(0x48);
+    emit8(0xB8);
+    emit64((uint64_t) (uintptr_t) function);
+    emit8(0xFF);
+    emit8(0xD0);
+}
+
+/* j<cc> rel32 with the displacement left to emit_patch(); returns the displacement field */
+static uint8_t *emit_jcc(int cc) {
+    uint8_t *field;
+    emit8(0x0F);
+    emit8(0x80 | cc);
+    field = emit_ptr;
+    emit32(0);
+    return field;
+}
+
+/* point a jump emitted by emit_jcc() at the current position */
+static void emit_patch(uint8_t *field) {
+    uint32_t displacement = (uint32_t) (emit_ptr - (field + 4));
+    if (emit_overflow) {
+        /* the field itself may never have been written */
+        return;
+    }
+    memcpy(field, &displacement, 4);
+}
+
+/* return to the block engine with count instructions retired (PC already stored) */
+static void emit_return(uint32_t count) {
+    emit8(0xB8);
+    emit32(count);
+    emit8(0x5B);  /* pop rbx */
+    emit8(0xC3);  /* ret */
+}
+
+static void emit_exit(uint32_t pc, uint32_t count) {
+    emit_store_imm(STATE_PC, pc);
+    emit_return(count);
+}
+
+/* jmp rel32 with the displacement left to emit_patch() */
+static uint8_t *emit_jmp() {
+    uint8_t *field;
+    emit8(0xE9);
+    field = emit_ptr;
+    emit32(0);
+    return field;
+}
+
+/* edi = REGS[rs] + im, the effective address */
+static void emit_address(const decoded_insn_t *d) {
+    emit_load(EDI, STATE_REG(d->rs));
+    emit_alu_imm(ALU_ADD, EDI, d->imm);
+}
+
+/************************************************************/
+/* Inline mem_pte() for the address in edi, leaving the page offset in eax and the   */
+/* pte field at field_offset (read or write pointer) in rdx. An access that crosses    */
+/* the page end jumps to *slow, to be patched to the out-of-line call.                     */
+/************************************************************/
+static void emit_page_lookup(uint8_t field_offset, uint8_t **slow) {
+    emit8(0x89);  /* mov eax, edi */
+    emit8(0xF8);
+    emit8(0x25);  /* and eax, PAGE_MASK */
+    emit32(PAGE_MASK);
+    emit8(0x3D);  /* cmp eax, PAGE_SIZE - 4 */
+    emit32(PAGE_SIZE - 4);
+    *slow = emit_jcc(CC_A);
+    emit8(0x89);  /* mov ecx, edi */
+    emit8(0xF9);
+    emit_shift(SHIFT_SHR, ECX, PDIR_SHIFT);
+    emit8(0x48);  /* mov rdx, MEM_PAGE_DIR */
+    emit8(0xBA);
+    emit64((uint64_t) (uintptr_t) MEM_PAGE_DIR);
+    emit8(0x48);  /* mov rdx, [rdx+rcx*8] */
+    emit8(0x8B);
+    emit8(0x14);
+    emit8(0xCA);
+    emit8(0x89);  /* mov ecx, edi */
+    emit8(0xF9);
+    emit_shift(SHIFT_SHR, ECX, PAGE_SHIFT);
+    emit_alu_imm(ALU_AND, ECX, PTAB_ENTRIES - 1);
+    emit_shift(SHIFT_SHL, ECX, PTE_SHIFT);
+    emit8(0x48);  /* mov rdx, [rdx+rcx+field_offset] */
+    emit8(0x8B);
+    emit8(0x54);
+    emit8(0x0A);
+    emit8(field_offset);
+}
+
+/************************************************************/
+/* Emit the code of one instruction                                                                     */
+/************************************************************/
+static void compile_instruction(const decoded_insn_t *d, uint32_t pc, uint32_t count) {
+    uint8_t *skip, *done, *slow[3];
+
+    switch (d->op) {
+        case OP_INVALID:
+            break;
+        case OP_ADD:
+        case OP_ADDU:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_ADD, STATE_REG(d->rt));
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_SUB:
+        case OP_SUBU:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_SUB, STATE_REG(d->rt));
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_AND:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_AND, STATE_REG(d->rt));
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_OR:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_OR, STATE_REG(d->rt));
+            emit_setcc(CC_NE, EAX);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_XOR:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_XOR, STATE_REG(d->rt));
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_NOR:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_OR, STATE_REG(d->rt));
+            emit_not(EAX);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_SLT:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_mem(OPC_CMP, STATE_REG(d->rt));
+            emit_setcc(CC_B, EAX);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_SLL:
+            emit_load(EAX, STATE_REG(d->rt));
+            emit_shift(SHIFT_SHL, EAX, d->sa);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_SRL:
+        case OP_SRA:
+            emit_load(EAX, STATE_REG(d->rt));
+            emit_shift(SHIFT_SHR, EAX, d->sa);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_JR:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_store(EAX, STATE_PC);
+            emit_return(count + 1);
+            break;
+        case OP_JALR:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_store_imm(STATE_REG(d->rd), pc + 0x8);
+            emit_store(EAX, STATE_PC);
+            emit_return(count + 1);
+            break;
+        case OP_MTLO:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_store(EAX, STATE_LO);
+            break;
+        case OP_MTHI:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_store(EAX, STATE_HI);
+            break;
+        case OP_MFLO:
+            emit_load(EAX, STATE_LO);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_MFHI:
+            emit_load(EAX, STATE_HI);
+            emit_store(EAX, STATE_REG(d->rd));
+            break;
+        case OP_ADDI:
+        case OP_ADDIU:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_imm(ALU_ADD, EAX, d->imm);
+            emit_store(EAX, STATE_REG(d->rt));
+            break;
+        case OP_ANDI:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_imm(ALU_AND, EAX, d->imm);
+            emit_store(EAX, STATE_REG(d->rt));
+            break;
+        case OP_ORI:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_imm(ALU_OR, EAX, d->imm);
+            emit_store(EAX, STATE_REG(d->rt));
+            break;
+        case OP_XORI:
+            emit_load(EAX, STATE_REG(d->rs));
+            emit_alu_imm(ALU_XOR, EAX, d->imm);
+            emit_store(EAX, STATE_REG(d->rt));
+            break;
+        case OP_LUI:
+            emit_store_imm(STATE_REG(d->rt), d->imm);
+            break;
+        case OP_LW:
+        case OP_LB:
+        case OP_LH:
+            emit_address(d);
+            emit_page_lookup(offsetof(mem_pte_t, read), slow);
+            emit8(0x8B);  /* mov eax, [rdx+rax] */
+            emit8(0x04);
+            emit8(0x02);
+            done = emit_jmp();
+            emit_patch(slow[0]);
+            emit_call(jit_load);
+            emit_patch(done);
+            if (d->op == OP_LB) {
+                emit_alu_imm(ALU_OR, EAX, 0x0000000F);
+            } else if (d->op == OP_LH) {
+                emit_alu_imm(ALU_OR, EAX, 0x000000FF);
+            }
+            emit_store(EAX, STATE_REG(d->rt));
+            break;
+        case OP_SW:
+        case OP_SB:
+        case OP_SH:
+            emit_address(d);
+            emit_load(ESI, STATE_REG(d->rt));
+            emit_page_lookup(offsetof(mem_pte_t, write), slow);
+            /* a write-protected page, or a verification run logging its stores, takes the call */
+            emit8(0x48);  /* test rdx, rdx */
+            emit8(0x85);
+            emit8(0xD2);
+            slow[1] = emit_jcc(CC_E);
+            emit8(0x48);  /* mov rcx, &STORE_LOG_ACTIVE */
+            emit8(0xB9);
+            emit64((uint64_t) (uintptr_t) &STORE_LOG_ACTIVE);
+            emit8(0x83);  /* cmp dword [rcx], 0 */
+            emit8(0x39);
+            emit8(0x00);
+            slow[2] = emit_jcc(CC_NE);
+            emit8(0x89);  /* mov [rdx+rax], esi */
+            emit8(0x34);
+            emit8(0x02);
+            done = emit_jmp();
+            emit_patch(slow[0]);
+            emit_patch(slow[1]);
+            emit_patch(slow[2]);
+            emit_call(jit_store);
+            emit_test(EAX);
+            skip = emit_jcc(CC_E);
+            emit_exit(pc + 0x4, count + 1);
+            emit_patch(skip);
+            emit_patch(done);
+            break;
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_BLEZ:
+        case OP_BGTZ:
+        case OP_BLTZ:
+        case OP_BGEZ:
+            /* eax = branch taken */
+            emit_load(EAX, STATE_REG(d->rs));
+            if (d->op == OP_BEQ || d->op == OP_BNE) {
+                emit_alu_mem(OPC_CMP, STATE_REG(d->rt));
+                emit_setcc(d->op == OP_BEQ ? CC_E : CC_NE, EAX);
+            } else {
+                if (d->op == OP_BGTZ || d->op == OP_BGEZ) {
+                    emit_not(EAX);
+                }
+                emit_shift(SHIFT_SHR, EAX, 31);
+                if (d->op == OP_BLEZ || d->op == OP_BGTZ) {
+                    /* these also test rt, as handle_instruction() does */
+                    emit_load(ECX, STATE_REG(d->rt));
+                    emit_test(ECX);
+                    emit_setcc(d->op == OP_BLEZ ? CC_E : CC_NE, ECX);
+                    emit8(0x09);  /* or eax, ecx */
+                    emit8(0xC8);
+                }
+            }
+            emit_test(EAX);
+            skip = emit_jcc(CC_E);
+            emit_exit(d->target, count + 1);
+            emit_patch(skip);
+            emit_exit(pc + 0x4, count + 1);
+            break;
+        default:
+            /* MULT/DIV (which look at prevInstruction), SLTI and SYSCALL */
+            emit_store_imm(STATE_PC, pc);
+            emit_call(jit_fallback);
+            if (ends_block(d->op)) {
+                emit_return(count + 1);
+            }
+            break;
+    }
+}
+
+/************************************************************/
+/* Compile into the whole code cache                                                                    */
+/************************************************************/
+void jit_defaults(jit_cache_t *jit) {
+    jit->size = JIT_CACHE_SIZE;
+}
+
+/************************************************************/
+/* Compile into the first <bytes> of the code cache only, so that it fills up sooner   */
+/* Returns nonzero, after saying why, when no block would fit or the cache is smaller. */
+/************************************************************/
+int jit_set_cache_size(uint32_t bytes) {
+    if (bytes < JIT_BLOCK_RESERVE || bytes > JIT_CACHE_SIZE) {
+        printf("Error: The code cache can be %u to %u bytes\n", JIT_BLOCK_RESERVE, JIT_CACHE_SIZE);
+        return -1;
+    }
+    CODE_SIZE = bytes;
+    return 0;
+}
+
+/************************************************************/
+/* Map the code cache (once)                                                                                */
+/************************************************************/
+int jit_available() {
+    void *cache;
+
+    if (CODE_CACHE != NULL) {
+        return 1;
+    }
+    if (CODE_CACHE_FAILED) {
+        return 0;
+    }
+    cache = mmap(NULL, JIT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (cache == MAP_FAILED) {
+        printf("Error: Cannot map an executable code cache, the JIT is disabled\n");
+        CODE_CACHE_FAILED = 1;
+        return 0;
+    }
+    CODE_CACHE = cache;
+    return 1;
+}
+
+/************************************************************/
+/* Compile a block                                                                                                   */
+/************************************************************/
+void jit_compile(block_t *b) {
+    uint8_t *start;
+    uint32_t i;
+
+    b->jit_tried = 1;
+    if (!jit_available()) {
+        return;
+    }
+    if (CODE_USED + JIT_BLOCK_RESERVE > CODE_SIZE) {
+        /* full: start again, and let the blocks that are still hot compile again */
+        drop_native_code();
+        CODE_USED = 0;
+        SIM->jit.flushes++;
+    }
+
+    start = emit_ptr = CODE_CACHE + CODE_USED;
+    emit_limit = CODE_CACHE + CODE_SIZE;
+    emit_overflow = 0;
+    emit8(0x53);  /* push rbx (also aligns the stack for the callbacks) */
+    emit8(0x48);  /* mov rbx, rdi */
+    emit8(0x89);
+    emit8(0xFB);
+    for (i = 0; i < b->length; i++) {
+        compile_instruction(&b->ops[i].d, b->start_pc + 4 * i, i);
+    }
+    if (!ends_block(b->ops[b->length - 1].d.op)) {
+        emit_exit(b->fall_pc, b->length);
+    }
+    if (emit_overflow) {
+        /* the estimate above was short; leave the block to the block engine */
+        b->native = NULL;
+        return;
+    }
+
+    CODE_USED = ((emit_ptr - CODE_CACHE) + 15) & ~15;
+    b->native = start;
+    SIM->jit.compiled++;
+}
+
+/************************************************************/
+/* Run a compiled block on CURRENT_STATE                                                               */
+/* Returns the number of instructions retired by the native code, which is short of    */
+/* the block length only when a store hit translated code.                                   */
+/************************************************************/
+uint32_t jit_run(block_t *b) {
+    native_block_t native = (native_block_t) b->native;
+    CPU_State before, after;
+    uint32_t executed, i, j;
+    int mismatch = 0, btrace_active;
+
+    if (!JIT_VERIFY) {
+        return native(&CURRENT_STATE);
+    }
+
+    before = CURRENT_STATE;
+    STORE_LOG_LENGTH = 0;
+    STORE_LOG_ACTIVE = 1;
+    executed = native(&CURRENT_STATE);
+    STORE_LOG_ACTIVE = 0;
+    after = CURRENT_STATE;
+
+    /* undo the native stores and replay the same instructions on the interpreter. The native
+     * run has already counted, printed, traced and profiled them, so the replay runs the bare
+     * handlers (not cycle()) with the program's output and the binary trace off. */
+    for (i = STORE_LOG_LENGTH; i > 0; i--) {
+        mem_write_32(STORE_LOG[i - 1].address, STORE_LOG[i - 1].old_value);
+    }
+    CURRENT_STATE = before;
+    btrace_active = BTRACE_ACTIVE;
+    BTRACE_ACTIVE = 0;
+    JIT_REPLAYING = 1;
+    for (i = 0; i < executed; i++) {
+        handle_instruction();
+    }
+    JIT_REPLAYING = 0;
+    BTRACE_ACTIVE = btrace_active;
+
+    if (after.PC != CURRENT_STATE.PC) {
+        printf("JIT mismatch in block 0x%08x: PC jit 0x%08x interp 0x%08x\n", b->start_pc, after.PC, CURRENT_STATE.PC);
+        mismatch = 1;
+    }
+    for (i = 0; i < MIPS_REGS; i++) {
+        if (after.REGS[i] != CURRENT_STATE.REGS[i]) {
+            printf("JIT mismatch in block 0x%08x: R%u jit 0x%08x interp 0x%08x\n", b->start_pc, i, after.REGS[i], CURRENT_STATE.REGS[i]);
+            mismatch = 1;
+        }
+    }
+    if (after.HI != CURRENT_STATE.HI || after.LO != CURRENT_STATE.LO) {
+        printf("JIT mismatch in block 0x%08x: HI/LO jit 0x%08x/0x%08x interp 0x%08x/0x%08x\n", b->start_pc, after.HI, after.LO, CURRENT_STATE.HI, CURRENT_STATE.LO);
+        mismatch = 1;
+    }
+    /* the last native store to each address must match memory after the replay */
+    for (i = 0; i < STORE_LOG_LENGTH; i++) {
+        for (j = i + 1; j < STORE_LOG_LENGTH && STORE_LOG[j].address != STORE_LOG[i].address; j++) {
+        }
+        if (j == STORE_LOG_LENGTH && mem_read_32(STORE_LOG[i].address) != STORE_LOG[i].new_value) {
+            printf("JIT mismatch in block 0x%08x: [0x%08x] jit 0x%08x interp 0x%08x\n", b->start_pc, STORE_LOG[i].address, STORE_LOG[i].new_value, mem_read_32(STORE_LOG[i].address));
+            mismatch = 1;
+        }
+    }
+    if (mismatch) {
+        /* keep the interpreter's results and stop using the compiled code */
+        b->native = NULL;
+    }
+    return executed;
+}
+
+/************************************************************/
+/* Forget all compiled code (the blocks using it are gone)                                      */
+/************************************************************/
+void jit_flush() {
+    CODE_USED = 0;
+}
+
+/************************************************************/
+/* Give the code cache back (the simulator is going away)                                       */
+/************************************************************/
+void jit_unmap() {
+    if (CODE_CACHE != NULL) {
+        munmap(CODE_CACHE, JIT_CACHE_SIZE);
+        CODE_CACHE = NULL;
+    }
+    CODE_USED = 0;
+}
+
+#else
+
+void jit_defaults(jit_cache_t *jit) {
+    jit->size = JIT_CACHE_SIZE;
+}
+
+int jit_set_cache_size(uint32_t bytes) {
+    SIM->jit.size = bytes;
+    return 0;
+}
+
+int jit_available() {
+    return 0;
+}
+
+void jit_compile(block_t *b) {
+    b->jit_tried = 1;
+}
+
+uint32_t jit_run(block_t *b) {
+    return 0;
+}
+
+void jit_flush() {
+}
+
+void jit_unmap() {
+}
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef MU_JIT_H
+#define MU_JIT_H
+
+#include <stdint.h>
+
+#include "mu-block.h"
+
+/******************************************************************************/
+/* x86-64 translator for hot basic blocks                                                                                                   */
+/******************************************************************************/
+/* with the jit engine, a block that has run JIT_THRESHOLD times is compiled to native code
+ * working directly on CURRENT_STATE; instructions without a native translation call back into
+ * handle_instruction(). The native code returns how many instructions it retired, and the block
+ * engine runs whatever is left of the block (after a store into the text segment) through the
+ * mu-ops.def handlers. Native code has no trace points, so it only runs while tracing is off.
+ * When the code cache is full it is emptied: every block loses its native code and is compiled
+ * again if it is still run often.
+ * Built on x86-64 hosts unless -DMU_NO_JIT is given. */
+#define JIT_THRESHOLD 16
+#define JIT_CACHE_SIZE (4 << 20)
+
+/* a store made by native code, kept while verifying so it can be undone */
+typedef struct {
+	uint32_t address;
+	uint32_t old_value;
+	uint32_t new_value;
+} store_record_t;
+
+/* code cache of one simulator; the generated code embeds the addresses of that simulator's
+ * page directory and store log, so it only ever runs on the simulator that compiled it */
+typedef struct {
+	uint8_t *code;            /* JIT_CACHE_SIZE bytes, mapped on first use */
+	uint32_t used;
+	uint32_t size;            /* bytes of it compiled into, JIT_CACHE_SIZE unless jit_set_cache_size() says less */
+	uint32_t compiled;        /* blocks compiled */
+	uint32_t flushes;         /* times it was emptied because it was full */
+	int failed;               /* the mapping was refused */
+	int verify;               /* every native run is replayed on the interpreter and the results compared */
+	int replaying;            /* the replay is running: it repeats no output, trace or profile */
+	store_record_t store_log[MAX_BLOCK_LENGTH];
+	uint32_t store_log_length;
+	int store_log_active;
+} jit_cache_t;
+
+/* the current simulator's setting (jit-verify engine) */
+#define JIT_VERIFY (SIM->jit.verify)
+#define JIT_REPLAYING (SIM->jit.replaying)
+
+void jit_defaults(jit_cache_t *jit);
+int jit_set_cache_size(uint32_t bytes);
+int jit_available();
+void jit_compile(block_t *b);
+uint32_t jit_run(block_t *b);
+void jit_flush();
+void jit_unmap();
+
+#endif
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <elf.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mu-load.h"
+#include "mu-mem.h"
+#include "mu-decode.h"
+
+/************************************************************/
+/* Program loaders                                                                                                   */
+/************************************************************/
+
+#define NOT_HEX 0xFF
+
+static const uint8_t HEX_VALUE[256] = {
+    [0 ... 255] = NOT_HEX,
+    ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+    ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+    ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+    ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15
+};
+
+static inline int is_space(uint8_t c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define ONES  0x0101010101010101ull
+#define HIGHS 0x8080808080808080ull
+
+/***************************************************************/
+/* Convert exactly eight hex digits at p, all eight bytes at once                                */
+/* Returns 0 if any of them is not a hex digit.                                                          */
+/***************************************************************/
+static inline int parse_8_digits(const uint8_t *p, uint32_t *word) {
+    uint64_t x, lower, digit, alpha, v;
+
+    memcpy(&x, p, 8);
+    if (x & HIGHS) {
+        return 0;
+    }
+    /* with every byte below 0x80, adding 0x80 - bound sets a byte's top bit iff byte >= bound
+     * and never carries into the next byte */
+    lower = x | (0x20 * ONES);
+    digit = (x + (0x80 - '0') * ONES) & ~(x + (0x80 - '9' - 1) * ONES);
+    alpha = (lower + (0x80 - 'a') * ONES) & ~(lower + (0x80 - 'f' - 1) * ONES);
+    if (((digit | alpha) & HIGHS) != HIGHS) {
+        return 0;
+    }
+    /* digit values, then fold the nibbles together: the first character is the top nibble */
+    v = (x & (0x0F * ONES)) + ((alpha & HIGHS) >> 7) * 9;
+    v = ((v & 0x0F000F000F000F00ull) >> 8) | ((v & 0x000F000F000F000Full) << 4);
+    v = ((v & 0x00FF000000FF0000ull) >> 16) | ((v & 0x000000FF000000FFull) << 8);
+    v = ((v & 0x0000FFFF00000000ull) >> 32) | ((v & 0x000000000000FFFFull) << 16);
+    *word = (uint32_t) v;
+    return 1;
+}
+#else
+static inline int parse_8_digits(const uint8_t *p, uint32_t *word) {
+    uint32_t v = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        if (HEX_VALUE[p[i]] == NOT_HEX) {
+            return 0;
+        }
+        v = (v << 4) | HEX_VALUE[p[i]];
+    }
+    *word = v;
+    return 1;
+}
+#endif
+
+/***************************************************************/
+/* Load a text program                                                                                                  */
+/* Words go straight into the pages, fetched once per page rather than per word.   */
+/***************************************************************/
+int load_hex(const char *text, size_t length, uint32_t address) {
+    const uint8_t *p = (const uint8_t *) text, *end = p + length;
+    uint8_t *page = NULL;
+    uint32_t word, offset;
+    int words = 0;
+
+    while (1) {
+        while (p < end && is_space(*p)) {
+            p++;
+        }
+        if (p == end) {
+            break;
+        }
+        /* nearly every line is exactly eight digits */
+        if (end - p >= 8 && (end - p == 8 || is_space(p[8])) && parse_8_digits(p, &word)) {
+            p += 8;
+        } else {
+            if (end - p > 2 && p[0] == '0' && (p[1] | 0x20) == 'x' && HEX_VALUE[p[2]] != NOT_HEX) {
+                p += 2;
+            }
+            if (HEX_VALUE[*p] == NOT_HEX) {
+                return -1;
+            }
+            word = 0;
+            while (p < end && HEX_VALUE[*p] != NOT_HEX) {
+                word = (word << 4) | HEX_VALUE[*p++];
+            }
+            if (p < end && !is_space(*p)) {
+                return -1;
+            }
+        }
+
+        offset = address & PAGE_MASK;
+        if (page == NULL || offset == 0) {
+            page = mem_page_for_write(address);
+            if (page == NULL) {
+                return -1;
+            }
+        }
+        page[offset + 3] = (word >> 24) & 0xFF;
+        page[offset + 2] = (word >> 16) & 0xFF;
+        page[offset + 1] = (word >> 8) & 0xFF;
+        page[offset + 0] = (word >> 0) & 0xFF;
+        address += 4;
+        words++;
+    }
+    return words;
+}
+
+/***************************************************************/
+/* Write page records                                                                                                   */
+/***************************************************************/
+int write_page_records(FILE *fp, const mem_page_copy_t *pages, uint32_t count) {
+    mem_page_header_t header = { 0, 1, { 0, 0 } };
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (fwrite(&header, sizeof(header), 1, fp) != 1 || fwrite(pages[i].data, PAGE_SIZE, 1, fp) != 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Map page records as the current address space                                                  */
+/***************************************************************/
+int map_page_records(int fd, uint64_t file_size, uint64_t records_offset, const uint32_t *addresses, uint32_t count) {
+    mem_page_copy_t *pages;
+    uint8_t *base;
+    uint32_t i;
+
+    if (records_offset > file_size || (file_size - records_offset) / PAGE_RECORD_SIZE < count) {
+        return -1;
+    }
+    base = NULL;
+    if (file_size > 0) {
+        base = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base == MAP_FAILED) {
+            return -1;
+        }
+    }
+    pages = malloc((count + 1) * sizeof(mem_page_copy_t));
+    if (pages == NULL) {
+        printf("Error: Out of memory mapping pages\n");
+        exit(-1);
+    }
+    for (i = 0; i < count; i++) {
+        pages[i].address = addresses[i] & ~PAGE_MASK;
+        pages[i].data = base + records_offset + (uint64_t) i * PAGE_RECORD_SIZE + sizeof(mem_page_header_t);
+    }
+
+    reset_memory();
+    flush_predecode();
+    if (base != NULL) {
+        mem_map_pages(base, file_size, pages, count);
+    }
+    free(pages);
+    return 0;
+}
+
+/***************************************************************/
+/* Read count elements of size at offset into a new buffer, NULL if the file is short     */
+/***************************************************************/
+static void *read_table(int fd, uint64_t offset, uint32_t count, size_t size) {
+    void *table = malloc((size_t) count * size + 1);
+
+    if (table == NULL) {
+        printf("Error: Out of memory reading an image\n");
+        exit(-1);
+    }
+    if (pread(fd, table, (size_t) count * size, offset) != (ssize_t) ((size_t) count * size)) {
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+static int compare_symbols(const void *a, const void *b) {
+    const image_symbol_t *x = a, *y = b;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/***************************************************************/
+/* Read the tables of an image                                                                                   */
+/***************************************************************/
+int read_image_info(int fd, uint64_t file_size, image_info_t *info) {
+    image_header_t header;
+    uint64_t offset;
+    uint32_t i;
+
+    memset(info, 0, sizeof(*info));
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != IMAGE_VERSION || header.record_size != PAGE_RECORD_SIZE) {
+        return -1;
+    }
+    offset = sizeof(header);
+    info->segments = read_table(fd, offset, header.segment_count, sizeof(image_segment_t));
+    offset += (uint64_t) header.segment_count * sizeof(image_segment_t);
+    info->symbols = read_table(fd, offset, header.symbol_count, sizeof(image_symbol_t));
+    offset += (uint64_t) header.symbol_count * sizeof(image_symbol_t);
+    info->strings = read_table(fd, offset, header.strings_size, 1);
+    offset += header.strings_size;
+    info->pages = read_table(fd, offset, header.page_count, sizeof(uint32_t));
+    info->entry = header.entry;
+    info->segment_count = header.segment_count;
+    info->symbol_count = header.symbol_count;
+    info->strings_size = header.strings_size;
+    info->page_count = header.page_count;
+    info->records_offset = header.records_offset;
+    if (info->segments == NULL || info->symbols == NULL || info->strings == NULL || info->pages == NULL ||
+        (header.strings_size > 0 && info->strings[header.strings_size - 1] != '\0') ||
+        header.records_offset > file_size ||
+        (file_size - header.records_offset) / PAGE_RECORD_SIZE < header.page_count) {
+        free_image_info(info);
+        return -1;
+    }
+    for (i = 0; i < header.symbol_count; i++) {
+        if (info->symbols[i].name >= header.strings_size) {
+            free_image_info(info);
+            return -1;
+        }
+    }
+    qsort(info->symbols, info->symbol_count, sizeof(image_symbol_t), compare_symbols);
+    return 0;
+}
+
+/***************************************************************/
+/* Load an image into the current address space                                                     */
+/***************************************************************/
+int load_image(int fd, uint64_t file_size, image_info_t *info) {
+    if (read_image_info(fd, file_size, info) != 0) {
+        return -1;
+    }
+    if (map_page_records(fd, file_size, info->records_offset, info->pages, info->page_count) != 0) {
+        free_image_info(info);
+        return -1;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Whether any segment covers part of the page at address                                      */
+/***************************************************************/
+static int in_segment(const image_info_t *info, uint32_t address) {
+    uint32_t i;
+
+    for (i = 0; i < info->segment_count; i++) {
+        if (info->segments[i].size > 0 &&
+            address <= info->segments[i].address + info->segments[i].size - 1 &&
+            info->segments[i].address <= address + PAGE_MASK) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Write the current address space as an image                                                       */
+/***************************************************************/
+int save_image(const char *path, const image_info_t *info) {
+    static const uint8_t zero[PAGE_SIZE];
+    image_header_t header;
+    mem_snapshot_t snap;
+    mem_page_copy_t *kept;
+    uint32_t *addresses;
+    uint32_t i, pages;
+    FILE *fp;
+    int error = 0;
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    mem_snapshot(&snap);
+    addresses = malloc((snap.count + 1) * sizeof(uint32_t));
+    kept = malloc((snap.count + 1) * sizeof(mem_page_copy_t));
+    if (addresses == NULL || kept == NULL) {
+        printf("Error: Out of memory writing an image\n");
+        exit(-1);
+    }
+    pages = 0;
+    for (i = 0; i < snap.count; i++) {
+        if (in_segment(info, snap.pages[i].address) && memcmp(snap.pages[i].data, zero, PAGE_SIZE) != 0) {
+            addresses[pages] = snap.pages[i].address;
+            kept[pages++] = snap.pages[i];
+        }
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.entry = info->entry;
+    header.segment_count = info->segment_count;
+    header.symbol_count = info->symbol_count;
+    header.strings_size = info->strings_size;
+    header.page_count = pages;
+    header.record_size = PAGE_RECORD_SIZE;
+    header.records_offset = (sizeof(header) + (uint64_t) info->segment_count * sizeof(image_segment_t) +
+                             (uint64_t) info->symbol_count * sizeof(image_symbol_t) + info->strings_size +
+                             (uint64_t) pages * sizeof(uint32_t) + PAGE_MASK) & ~(uint64_t) PAGE_MASK;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+        fwrite(info->segments, sizeof(image_segment_t), info->segment_count, fp) != info->segment_count ||
+        fwrite(info->symbols, sizeof(image_symbol_t), info->symbol_count, fp) != info->symbol_count ||
+        fwrite(info->strings, 1, info->strings_size, fp) != info->strings_size ||
+        fwrite(addresses, sizeof(uint32_t), pages, fp) != pages ||
+        fseek(fp, header.records_offset, SEEK_SET) != 0 ||
+        write_page_records(fp, kept, pages) != 0) {
+        error = errno != 0 ? errno : EIO;
+    }
+    free(addresses);
+    free(kept);
+    mem_snapshot_free(&snap);
+    if (fclose(fp) != 0 && error == 0) {
+        error = errno;
+    }
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* ELF fields in the file's byte order                                                                        */
+/***************************************************************/
+static uint32_t elf_32(const uint8_t *p, int big) {
+    return big ? ((uint32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]
+               : ((uint32_t) p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+static uint32_t elf_16(const uint8_t *p, int big) {
+    return big ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+}
+
+#define ELF_32(p, type, field) elf_32((p) + offsetof(type, field), big)
+#define ELF_16(p, type, field) elf_16((p) + offsetof(type, field), big)
+
+/***************************************************************/
+/* Whether [address, address + size) lies within one memory region                              */
+/***************************************************************/
+static int in_region(uint32_t address, uint32_t size) {
+    int i;
+
+    if (size == 0 || address + size - 1 < address) {
+        return size == 0;
+    }
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        if (address >= MEM_REGIONS[i].begin && address + size - 1 <= MEM_REGIONS[i].end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Copy segment data into memory, word swapped for a big-endian file                      */
+/***************************************************************/
+static void copy_segment(const uint8_t *data, uint32_t address, uint32_t length, int big) {
+    uint32_t offset, chunk, i;
+    uint8_t *page;
+
+    while (length > 0) {
+        offset = address & PAGE_MASK;
+        chunk = PAGE_SIZE - offset < length ? PAGE_SIZE - offset : length;
+        page = mem_page_for_write(address);
+        if (!big) {
+            memcpy(page + offset, data, chunk);
+        } else {
+            /* byte a of a big-endian word is byte a ^ 3 of the little-endian one */
+            for (i = 0; i < chunk; i++) {
+                page[(offset + i) ^ 3] = data[i];
+            }
+        }
+        address += chunk;
+        data += chunk;
+        length -= chunk;
+    }
+}
+
+/***************************************************************/
+/* Collect the defined function, object and plain symbols of the symbol table            */
+/* A missing or damaged table just leaves info without symbols.                                */
+/***************************************************************/
+static void read_elf_symbols(const uint8_t *file, size_t size, int big, image_info_t *info) {
+    uint32_t shoff = ELF_32(file, Elf32_Ehdr, e_shoff);
+    uint32_t shnum = ELF_16(file, Elf32_Ehdr, e_shnum);
+    uint32_t shentsize = ELF_16(file, Elf32_Ehdr, e_shentsize);
+    uint32_t i, j, link, symoff, symsize, entsize, stroff, strsize, name, type, count, bytes;
+    const uint8_t *sh, *sym;
+    const char *names;
+
+    if (shentsize < sizeof(Elf32_Shdr) || shoff > size || (size - shoff) / shentsize < shnum) {
+        return;
+    }
+    for (i = 0; i < shnum; i++) {
+        sh = file + shoff + i * shentsize;
+        if (ELF_32(sh, Elf32_Shdr, sh_type) != SHT_SYMTAB) {
+            continue;
+        }
+        symoff = ELF_32(sh, Elf32_Shdr, sh_offset);
+        symsize = ELF_32(sh, Elf32_Shdr, sh_size);
+        entsize = ELF_32(sh, Elf32_Shdr, sh_entsize);
+        link = ELF_32(sh, Elf32_Shdr, sh_link);
+        if (link >= shnum || entsize < sizeof(Elf32_Sym) || symoff > size || size - symoff < symsize) {
+            return;
+        }
+        sh = file + shoff + link * shentsize;
+        stroff = ELF_32(sh, Elf32_Shdr, sh_offset);
+        strsize = ELF_32(sh, Elf32_Shdr, sh_size);
+        if (stroff > size || size - stroff < strsize) {
+            return;
+        }
+        names = (const char *) file + stroff;
+
+        /* count, then copy */
+        for (count = bytes = 0, j = 0; j < 2; j++) {
+            for (sym = file + symoff; sym + entsize <= file + symoff + symsize; sym += entsize) {
+                name = ELF_32(sym, Elf32_Sym, st_name);
+                type = ELF32_ST_TYPE(sym[offsetof(Elf32_Sym, st_info)]);
+                if (name == 0 || name >= strsize || memchr(names + name, '\0', strsize - name) == NULL ||
+                    ELF_16(sym, Elf32_Sym, st_shndx) == SHN_UNDEF ||
+                    (type != STT_NOTYPE && type != STT_OBJECT && type != STT_FUNC)) {
+                    continue;
+                }
+                if (j == 1) {
+                    info->symbols[info->symbol_count].address = ELF_32(sym, Elf32_Sym, st_value);
+                    info->symbols[info->symbol_count].name = info->strings_size;
+                    strcpy(info->strings + info->strings_size, names + name);
+                    info->symbol_count++;
+                    info->strings_size += strlen(names + name) + 1;
+                } else {
+                    count++;
+                    bytes += strlen(names + name) + 1;
+                }
+            }
+            if (j == 0) {
+                info->symbols = malloc((count + 1) * sizeof(image_symbol_t));
+                info->strings = malloc(bytes + 1);
+                if (info->symbols == NULL || info->strings == NULL) {
+                    printf("Error: Out of memory reading symbols\n");
+                    exit(-1);
+                }
+            }
+        }
+        qsort(info->symbols, info->symbol_count, sizeof(image_symbol_t), compare_symbols);
+        return;
+    }
+}
+
+/***************************************************************/
+/* Load an ELF executable into the current address space                                        */
+/***************************************************************/
+int load_elf(const uint8_t *file, size_t size, image_info_t *info) {
+    uint32_t phoff, phnum, phentsize, offset, address, filesz, memsz, i;
+    image_segment_t *segment;
+    const uint8_t *ph;
+    int big;
+
+    memset(info, 0, sizeof(*info));
+    if (size < sizeof(Elf32_Ehdr) || memcmp(file, ELFMAG, SELFMAG) != 0 || file[EI_CLASS] != ELFCLASS32 ||
+        (file[EI_DATA] != ELFDATA2LSB && file[EI_DATA] != ELFDATA2MSB)) {
+        return -1;
+    }
+    big = file[EI_DATA] == ELFDATA2MSB;
+    phoff = ELF_32(file, Elf32_Ehdr, e_phoff);
+    phnum = ELF_16(file, Elf32_Ehdr, e_phnum);
+    phentsize = ELF_16(file, Elf32_Ehdr, e_phentsize);
+    if (ELF_16(file, Elf32_Ehdr, e_type) != ET_EXEC || ELF_16(file, Elf32_Ehdr, e_machine) != EM_MIPS ||
+        phentsize < sizeof(Elf32_Phdr) || phoff > size || (size - phoff) / phentsize < phnum) {
+        return -1;
+    }
+
+    /* check every segment before anything changes */
+    for (i = 0; i < phnum; i++) {
+        ph = file + phoff + i * phentsize;
+        if (ELF_32(ph, Elf32_Phdr, p_type) != PT_LOAD) {
+            continue;
+        }
+        offset = ELF_32(ph, Elf32_Phdr, p_offset);
+        filesz = ELF_32(ph, Elf32_Phdr, p_filesz);
+        memsz = ELF_32(ph, Elf32_Phdr, p_memsz);
+        if (filesz > memsz || offset > size || size - offset < filesz ||
+            !in_region(ELF_32(ph, Elf32_Phdr, p_vaddr), memsz)) {
+            return -1;
+        }
+        info->segment_count++;
+    }
+    info->segments = malloc((info->segment_count + 1) * sizeof(image_segment_t));
+    if (info->segments == NULL) {
+        printf("Error: Out of memory loading an executable\n");
+        exit(-1);
+    }
+    read_elf_symbols(file, size, big, info);
+
+    reset_memory();
+    flush_predecode();
+    segment = info->segments;
+    for (i = 0; i < phnum; i++) {
+        ph = file + phoff + i * phentsize;
+        if (ELF_32(ph, Elf32_Phdr, p_type) != PT_LOAD) {
+            continue;
+        }
+        address = ELF_32(ph, Elf32_Phdr, p_vaddr);
+        /* the rest of memsz is bss, which reads as zero without being stored */
+        copy_segment(file + ELF_32(ph, Elf32_Phdr, p_offset), address, ELF_32(ph, Elf32_Phdr, p_filesz), big);
+        segment->address = address;
+        segment->size = ELF_32(ph, Elf32_Phdr, p_memsz);
+        segment->flags = ELF_32(ph, Elf32_Phdr, p_flags) & PF_X ? SEGMENT_TEXT : SEGMENT_DATA;
+        segment->reserved = 0;
+        segment++;
+    }
+    info->entry = ELF_32(file, Elf32_Ehdr, e_entry);
+    return 0;
+}
+
+/***************************************************************/
+/* Release the tables of an image                                                                              */
+/***************************************************************/
+void free_image_info(image_info_t *info) {
+    free(info->segments);
+    free(info->symbols);
+    free(info->strings);
+    free(info->pages);
+    memset(info, 0, sizeof(*info));
+}
+
+/***************************************************************/
+/* Symbol at an address                                                                                                */
+/***************************************************************/
+const char *image_symbol(const image_info_t *info, uint32_t address) {
+    uint32_t low = 0, high = info->symbol_count, middle;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (info->symbols[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < info->symbol_count && info->symbols[low].address == address ? info->strings + info->symbols[low].name : NULL;
+}
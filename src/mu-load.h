@@ -0,0 +1,104 @@
+#ifndef MU_LOAD_H
+#define MU_LOAD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "mu-mem.h"
+
+/******************************************************************************/
+/* Program loaders                                                                                                                                       */
+/******************************************************************************/
+/* programs come as text (one 32-bit word per line in hex, as the lab's assembler writes it: any
+ * whitespace separates words, each word is hex digits with an optional 0x prefix), as images
+ * (below), as ELF executables from a MIPS cross toolchain or as assembly source (mu-asm.h). */
+
+/* store the words of a text program at consecutive addresses from address into the current
+ * address space; returns the number of words, -1 if the text holds anything else */
+int load_hex(const char *text, size_t length, uint32_t address);
+
+/******************************************************************************/
+/* Page records                                                                                                                                              */
+/******************************************************************************/
+/* images and checkpoints store memory as page records, a mem_page_header_t with mapped set
+ * followed by the page data, so that mapping the file is all it takes to load them */
+#define PAGE_RECORD_SIZE (sizeof(mem_page_header_t) + PAGE_SIZE)
+
+/* write a record for each page; returns 0, -1 on a write error */
+int write_page_records(FILE *fp, const mem_page_copy_t *pages, uint32_t count);
+/* replace the current address space with count records of fd from records_offset on, one for
+ * each of addresses; returns 0, -1 if the file can't be mapped (and then nothing changes) */
+int map_page_records(int fd, uint64_t file_size, uint64_t records_offset, const uint32_t *addresses, uint32_t count);
+
+/******************************************************************************/
+/* Program images                                                                                                                                          */
+/******************************************************************************/
+/* a binary program: an image_header_t, the image_segment_t table, the image_symbol_t table,
+ * the symbol names (NUL terminated, referenced by offset), the addresses of the pages held
+ * (ascending, one uint32_t each) and from records_offset their page records. Pages of a
+ * segment that are all zero are left out. Everything is little-endian.
+ * Loading maps the records; no program data is parsed or copied. mu-mips-image converts text
+ * programs to images. */
+#define IMAGE_MAGIC "MUIMAGE\n"
+#define IMAGE_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry;            /* initial PC */
+	uint32_t segment_count;
+	uint32_t symbol_count;
+	uint32_t strings_size;     /* bytes of symbol names */
+	uint32_t page_count;
+	uint32_t record_size;      /* PAGE_RECORD_SIZE */
+	uint32_t reserved;
+	uint64_t records_offset;   /* page aligned */
+} image_header_t;
+
+/* image_segment_t.flags */
+#define SEGMENT_TEXT 0x1
+#define SEGMENT_DATA 0x2
+
+typedef struct {
+	uint32_t address;
+	uint32_t size;             /* in bytes */
+	uint32_t flags;            /* SEGMENT_* */
+	uint32_t reserved;
+} image_segment_t;
+
+typedef struct {
+	uint32_t address;
+	uint32_t name;             /* offset into the names */
+} image_symbol_t;
+
+/* everything in an image but the page data */
+typedef struct {
+	uint32_t entry;
+	uint32_t segment_count, symbol_count, strings_size, page_count;
+	image_segment_t *segments;
+	image_symbol_t *symbols;   /* by address */
+	char *strings;
+	uint32_t *pages;           /* page addresses */
+	uint64_t records_offset;
+} image_info_t;
+
+/* read the tables of the image open on fd; returns 0, -1 if it is not a valid image */
+int read_image_info(int fd, uint64_t file_size, image_info_t *info);
+/* read the tables and map the pages into the current address space, replacing its contents;
+ * returns 0, -1 if fd is not a valid image (and then nothing changes) */
+int load_image(int fd, uint64_t file_size, image_info_t *info);
+/* write the pages of the current address space that info's segments cover, with info's entry,
+ * segments and symbols (info's pages and records_offset are ignored); returns 0, -1 with errno */
+int save_image(const char *path, const image_info_t *info);
+void free_image_info(image_info_t *info);
+/* load an ELF32 MIPS executable of either byte order from its contents, replacing the current
+ * address space. Every PT_LOAD segment must lie within one of MEM_REGIONS. Memory is little-endian
+ * word by word, so a big-endian file is stored with each word swapped and reads the same words.
+ * Fills info with the entry point, the segments and the symbol table (info's pages stay empty);
+ * returns 0, -1 if the file is not such an executable (and then nothing changes) */
+int load_elf(const uint8_t *file, size_t size, image_info_t *info);
+/* name of the symbol at address, NULL if there is none */
+const char *image_symbol(const image_info_t *info, uint32_t address);
+
+#endif
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "mu-mem.h"
+
+/***************************************************************/
+/* Memory access micro-benchmark                                                                             */
+/*                                                                                                                                    */
+/* Loads a program the same way load_program() does, then replays its                       */
+/* instruction-fetch stream and the data accesses of its loads/stores                            */
+/* (effective address = MEM_DATA_BEGIN + offset) many times over through two              */
+/* address translations:                                                                                                */
+/*   region scan     the old lookup: find the address's entry of MEM_REGIONS, then     */
+/*                   index that region's own page table                                                 */
+/*   page directory  the current mem_read_32 / mem_write_32 of mu-mem.h                   */
+/* reporting the best-of-5 average cost of one word access with each.                      */
+/***************************************************************/
+
+#define BENCH_ITERATIONS 2000
+#define BENCH_REPEATS 5
+#define MAX_PROGRAM_WORDS 65536
+/* short streams are replicated up to this length so loop overhead does not dominate */
+#define MIN_STREAM_LENGTH 8192
+
+static uint32_t fetch_addr[MAX_PROGRAM_WORDS + MIN_STREAM_LENGTH];
+static uint32_t data_addr[MAX_PROGRAM_WORDS + MIN_STREAM_LENGTH];
+
+static mem_space_t BENCH_MEM;
+
+/* the region scan's page tables, one per entry of MEM_REGIONS; NULL for a page never written */
+static uint8_t **SCAN_PAGES[NUM_MEM_REGION];
+static const uint8_t SCAN_ZERO_PAGE[PAGE_SIZE];
+
+typedef uint32_t (*read_word_t)(uint32_t address);
+typedef void (*write_word_t)(uint32_t address, uint32_t value);
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/***************************************************************/
+/* Region scan translation, as mu-mem.c had it before the page directory. Like those    */
+/* functions, these stay out of line.                                                                              */
+/***************************************************************/
+static uint32_t scan_pages(int region) {
+    return ((MEM_REGIONS[region].end - MEM_REGIONS[region].begin) >> PAGE_SHIFT) + 1;
+}
+
+static void scan_init() {
+    int i;
+
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        SCAN_PAGES[i] = calloc(scan_pages(i), sizeof(uint8_t *));
+        if (SCAN_PAGES[i] == NULL) {
+            printf("Error: Out of memory allocating page table\n");
+            exit(-1);
+        }
+    }
+}
+
+static void scan_reset() {
+    uint32_t p;
+    int i;
+
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        for (p = 0; p < scan_pages(i); p++) {
+            free(SCAN_PAGES[i][p]);
+        }
+        free(SCAN_PAGES[i]);
+        SCAN_PAGES[i] = NULL;
+    }
+}
+
+static int find_region(uint32_t address) {
+    int i;
+
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        if ((address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const uint8_t *scan_page_for_read(int region, uint32_t address) {
+    uint8_t *page = SCAN_PAGES[region][(address - MEM_REGIONS[region].begin) >> PAGE_SHIFT];
+    return page ? page : SCAN_ZERO_PAGE;
+}
+
+static uint8_t *scan_page_for_write(int region, uint32_t address) {
+    uint8_t **slot = &SCAN_PAGES[region][(address - MEM_REGIONS[region].begin) >> PAGE_SHIFT];
+    if (*slot == NULL) {
+        *slot = calloc(1, PAGE_SIZE);
+        if (*slot == NULL) {
+            printf("Error: Out of memory allocating page for address 0x%08x\n", address);
+            exit(-1);
+        }
+    }
+    return *slot;
+}
+
+static uint8_t scan_read_8(uint32_t address) {
+    int region = find_region(address);
+    if (region < 0) {
+        return 0;
+    }
+    return scan_page_for_read(region, address)[address & PAGE_MASK];
+}
+
+static void scan_write_8(uint32_t address, uint8_t value) {
+    int region = find_region(address);
+    if (region < 0) {
+        return;
+    }
+    scan_page_for_write(region, address)[address & PAGE_MASK] = value;
+}
+
+static __attribute__((noinline)) uint32_t scan_read_32(uint32_t address) {
+    uint32_t offset = address & PAGE_MASK;
+    const uint8_t *page;
+    int region;
+
+    if (offset > PAGE_SIZE - 4) {
+        return (scan_read_8(address + 3) << 24) |
+               (scan_read_8(address + 2) << 16) |
+               (scan_read_8(address + 1) << 8) |
+               (scan_read_8(address + 0) << 0);
+    }
+    region = find_region(address);
+    if (region < 0) {
+        return 0;
+    }
+    page = scan_page_for_read(region, address);
+    return (page[offset + 3] << 24) |
+           (page[offset + 2] << 16) |
+           (page[offset + 1] << 8) |
+           (page[offset + 0] << 0);
+}
+
+static __attribute__((noinline)) void scan_write_32(uint32_t address, uint32_t value) {
+    uint32_t offset = address & PAGE_MASK;
+    uint8_t *page;
+    int region;
+
+    if (offset > PAGE_SIZE - 4) {
+        scan_write_8(address + 3, (value >> 24) & 0xFF);
+        scan_write_8(address + 2, (value >> 16) & 0xFF);
+        scan_write_8(address + 1, (value >> 8) & 0xFF);
+        scan_write_8(address + 0, (value >> 0) & 0xFF);
+        return;
+    }
+    region = find_region(address);
+    if (region < 0) {
+        return;
+    }
+    page = scan_page_for_write(region, address);
+    page[offset + 3] = (value >> 24) & 0xFF;
+    page[offset + 2] = (value >> 16) & 0xFF;
+    page[offset + 1] = (value >> 8) & 0xFF;
+    page[offset + 0] = (value >> 0) & 0xFF;
+}
+
+/* the page directory, behind the same kind of call */
+static __attribute__((noinline)) uint32_t dir_read_32(uint32_t address) {
+    return mem_read_32(address);
+}
+
+static __attribute__((noinline)) void dir_write_32(uint32_t address, uint32_t value) {
+    mem_write_32(address, value);
+}
+
+static int replicate(uint32_t *stream, int length) {
+    int i = 0;
+    while (length < MIN_STREAM_LENGTH) {
+        stream[length++] = stream[i++];
+    }
+    return length;
+}
+
+static int is_load_store(uint32_t word) {
+    switch (word & 0xFC000000) {
+        case 0x8C000000: /* LW */
+        case 0x80000000: /* LB */
+        case 0x84000000: /* LH */
+        case 0xAC000000: /* SW */
+        case 0xA0000000: /* SB */
+        case 0xA4000000: /* SH */
+            return 1;
+    }
+    return 0;
+}
+
+/* best-of-BENCH_REPEATS ns per fetch, load and store through one translation */
+static void bench_accesses(read_word_t read_word, write_word_t write_word, int num_fetch, int num_data,
+                           double *fetch_ns, double *load_ns, double *store_ns, uint32_t *sink) {
+    double start, elapsed;
+    int i, j, r;
+
+    *fetch_ns = *load_ns = *store_ns = 1e30;
+    for (r = 0; r < BENCH_REPEATS; r++) {
+        start = now_ns();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            for (j = 0; j < num_fetch; j++) {
+                *sink += read_word(fetch_addr[j]);
+            }
+        }
+        elapsed = (now_ns() - start) / ((double) BENCH_ITERATIONS * num_fetch);
+        *fetch_ns = elapsed < *fetch_ns ? elapsed : *fetch_ns;
+
+        start = now_ns();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            for (j = 0; j < num_data; j++) {
+                write_word(data_addr[j], i + j);
+            }
+        }
+        elapsed = (now_ns() - start) / ((double) BENCH_ITERATIONS * num_data);
+        *store_ns = elapsed < *store_ns ? elapsed : *store_ns;
+
+        start = now_ns();
+        for (i = 0; i < BENCH_ITERATIONS; i++) {
+            for (j = 0; j < num_data; j++) {
+                *sink += read_word(data_addr[j]);
+            }
+        }
+        elapsed = (now_ns() - start) / ((double) BENCH_ITERATIONS * num_data);
+        *load_ns = elapsed < *load_ns ? elapsed : *load_ns;
+    }
+}
+
+static void bench_program(const char *path) {
+    FILE *fp;
+    uint32_t word;
+    int num_fetch = 0, num_data = 0, num_words;
+    uint32_t sink = 0;
+    double fetch_ns, load_ns, store_ns;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Error: Can't open program file %s\n", path);
+        exit(-1);
+    }
+    MEM = &BENCH_MEM;
+    init_memory();
+    scan_init();
+    while (num_fetch < MAX_PROGRAM_WORDS && fscanf(fp, "%x\n", &word) == 1) {
+        uint32_t address = MEM_TEXT_BEGIN + num_fetch * 4;
+        mem_write_32(address, word);
+        scan_write_32(address, word);
+        fetch_addr[num_fetch++] = address;
+        if (is_load_store(word)) {
+            data_addr[num_data++] = MEM_DATA_BEGIN + (word & 0x0000FFFC);
+        }
+    }
+    fclose(fp);
+    if (num_data == 0) {
+        data_addr[num_data++] = MEM_DATA_BEGIN;
+    }
+
+    num_words = num_fetch;
+    num_fetch = replicate(fetch_addr, num_fetch);
+    num_data = replicate(data_addr, num_data);
+
+    bench_accesses(scan_read_32, scan_write_32, num_fetch, num_data, &fetch_ns, &load_ns, &store_ns, &sink);
+    printf("%-24s region scan     fetch %6.2f ns  load %6.2f ns  store %6.2f ns\n",
+           path, fetch_ns, load_ns, store_ns);
+    bench_accesses(dir_read_32, dir_write_32, num_fetch, num_data, &fetch_ns, &load_ns, &store_ns, &sink);
+    printf("%-24s page directory  fetch %6.2f ns  load %6.2f ns  store %6.2f ns  (%d words, sink %08x)\n",
+           path, fetch_ns, load_ns, store_ns, num_words, sink);
+    scan_reset();
+    reset_memory();
+}
+
+int main(int argc, char *argv[]) {
+    int i;
+    if (argc < 2) {
+        printf("Usage: %s <input program>...\n", argv[0]);
+        exit(1);
+    }
+    for (i = 1; i < argc; i++) {
+        bench_program(argv[i]);
+    }
+    return 0;
+}
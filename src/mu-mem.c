@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "mu-mem.h"
+
+/* address ranges backed by memory, anything outside reads as zero and ignores writes */
+mem_region_t MEM_REGIONS[NUM_MEM_REGION] = {
+	{ MEM_TEXT_BEGIN, MEM_TEXT_END },
+	{ MEM_DATA_BEGIN, MEM_DATA_END },
+	{ MEM_KDATA_BEGIN, MEM_KDATA_END },
+	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END }
+};
+
+mem_write_fault_t MEM_WRITE_FAULT_HOOK;
+_Thread_local mem_space_t *MEM;
+
+/* shared by every address space, and never written */
+static const uint8_t ZERO_PAGE[PAGE_SIZE];
+static mem_pte_t EMPTY_TABLE[PTAB_ENTRIES] = {
+    [0 ... PTAB_ENTRIES - 1] = { ZERO_PAGE, NULL }
+};
+
+/* a page referenced by a snapshot as well as by an address space is copied on the next
+ * store to it */
+#define PAGE_HEADER(data) ((mem_page_header_t *) (data) - 1)
+#define PAGE_REFS(data) (PAGE_HEADER(data)->refs)
+
+/* file mappings mem_map_pages() took pages from; their pages count references here instead,
+ * since the headers are in read-only memory */
+typedef struct mem_mapping {
+    const uint8_t *base;
+    size_t length;
+    uint32_t refs;
+    struct mem_mapping *next;
+} mem_mapping_t;
+
+static mem_mapping_t *MAPPINGS;
+static char MAPPINGS_LOCK;
+
+/***************************************************************/
+/* Check whether an address belongs to one of the memory regions                           */
+/***************************************************************/
+static int is_mapped(uint32_t address) {
+    int i;
+    for (i = 0; i < NUM_MEM_REGION; i++) {
+        if ((address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Note the first store to a page since mem_save_pristine()                                          */
+/***************************************************************/
+static void mark_dirty(uint32_t address) {
+    uint32_t page = address >> PAGE_SHIFT;
+
+    if (MEM->dirty_map == NULL || (MEM->dirty_map[page >> 3] & (1 << (page & 7)))) {
+        return;
+    }
+    MEM->dirty_map[page >> 3] |= 1 << (page & 7);
+    if (MEM->dirty_pages == MEM->dirty_capacity) {
+        MEM->dirty_capacity = MEM->dirty_capacity ? 2 * MEM->dirty_capacity : 64;
+        MEM->dirty = realloc(MEM->dirty, MEM->dirty_capacity * sizeof(uint32_t));
+        if (MEM->dirty == NULL) {
+            printf("Error: Out of memory tracking written pages\n");
+            exit(-1);
+        }
+    }
+    MEM->dirty[MEM->dirty_pages++] = address & ~PAGE_MASK;
+}
+
+/***************************************************************/
+/* Allocate a zeroed page holding one reference                                                         */
+/***************************************************************/
+static uint8_t *page_alloc(uint32_t address) {
+    mem_page_header_t *header = calloc(1, sizeof(mem_page_header_t) + PAGE_SIZE);
+
+    if (header == NULL) {
+        printf("Error: Out of memory allocating page for address 0x%08x\n", address);
+        exit(-1);
+    }
+    header->refs = 1;
+    return (uint8_t *) (header + 1);
+}
+
+/***************************************************************/
+/* Mapping holding a mapped page, with MAPPINGS_LOCK held                                      */
+/***************************************************************/
+static mem_mapping_t **find_mapping(const uint8_t *data) {
+    mem_mapping_t **m;
+
+    for (m = &MAPPINGS; *m != NULL; m = &(*m)->next) {
+        if (data >= (*m)->base && data < (*m)->base + (*m)->length) {
+            return m;
+        }
+    }
+    printf("Error: Page at %p is not in any mapping\n", (void *) data);
+    exit(-1);
+}
+
+static void lock_mappings() {
+    while (__atomic_test_and_set(&MAPPINGS_LOCK, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static void unlock_mappings() {
+    __atomic_clear(&MAPPINGS_LOCK, __ATOMIC_RELEASE);
+}
+
+/* snapshots may be shared between threads, so the counts are updated atomically */
+static void page_hold(const uint8_t *data) {
+    if (PAGE_HEADER(data)->mapped) {
+        lock_mappings();
+        (*find_mapping(data))->refs++;
+        unlock_mappings();
+        return;
+    }
+    __atomic_add_fetch(&PAGE_REFS(data), 1, __ATOMIC_RELAXED);
+}
+
+static void page_release(const uint8_t *data) {
+    mem_mapping_t **m, *mapping;
+
+    if (PAGE_HEADER(data)->mapped) {
+        lock_mappings();
+        m = find_mapping(data);
+        mapping = *m;
+        if (--mapping->refs == 0) {
+            *m = mapping->next;
+            munmap((void *) mapping->base, mapping->length);
+            free(mapping);
+        }
+        unlock_mappings();
+        return;
+    }
+    if (__atomic_sub_fetch(&PAGE_REFS(data), 1, __ATOMIC_ACQ_REL) == 0) {
+        free(PAGE_HEADER(data));
+    }
+}
+
+/***************************************************************/
+/* Make the page behind pte private to this address space and writable                     */
+/***************************************************************/
+static uint8_t *page_own(mem_pte_t *pte, uint32_t address) {
+    uint8_t *copy;
+
+    if (pte->read == ZERO_PAGE) {
+        pte->read = page_alloc(address);
+        MEM_PAGES_ALLOCATED++;
+    } else if (PAGE_HEADER(pte->read)->mapped || __atomic_load_n(&PAGE_REFS(pte->read), __ATOMIC_ACQUIRE) > 1) {
+        /* read only, or still referenced by a snapshot */
+        copy = page_alloc(address);
+        memcpy(copy, pte->read, PAGE_SIZE);
+        page_release(pte->read);
+        pte->read = copy;
+    }
+    pte->write = (uint8_t *) pte->read;
+    return pte->write;
+}
+
+/***************************************************************/
+/* Entry for an address, giving its directory slot a table of its own                          */
+/***************************************************************/
+static mem_pte_t *pte_for_write(uint32_t address) {
+    mem_pte_t **table = &MEM_PAGE_DIR[address >> PDIR_SHIFT];
+    int i;
+
+    if (*table == EMPTY_TABLE) {
+        *table = malloc(PTAB_ENTRIES * sizeof(mem_pte_t));
+        if (*table == NULL) {
+            printf("Error: Out of memory allocating page table for address 0x%08x\n", address);
+            exit(-1);
+        }
+        for (i = 0; i < PTAB_ENTRIES; i++) {
+            (*table)[i].read = ZERO_PAGE;
+            (*table)[i].write = NULL;
+        }
+    }
+    return mem_pte(address);
+}
+
+/***************************************************************/
+/* Page holding an address for writing, allocated on first use                                */
+/* Returns NULL for addresses outside every region.                                                   */
+/***************************************************************/
+static uint8_t *page_for_write(uint32_t address) {
+    mem_pte_t *pte;
+
+    if (!is_mapped(address)) {
+        return NULL;
+    }
+    pte = pte_for_write(address);
+    if (pte->write == NULL) {
+        if (MEM_WRITE_FAULT_HOOK != NULL) {
+            MEM_WRITE_FAULT_HOOK(address & ~PAGE_MASK);
+        }
+        mark_dirty(address);
+        /* untouched, write protected or shared with a snapshot */
+        page_own(pte, address);
+    }
+    return pte->write;
+}
+
+/***************************************************************/
+/* Writable data of the page holding an address, for filling a page in bulk                */
+/***************************************************************/
+uint8_t *mem_page_for_write(uint32_t address) {
+    return page_for_write(address);
+}
+
+/***************************************************************/
+/* Route the next store to a page through the slow path (and MEM_WRITE_FAULT_HOOK) */
+/***************************************************************/
+void mem_write_protect(uint32_t address) {
+    mem_pte(address)->write = NULL;
+}
+
+/***************************************************************/
+/* Byte access, used for words straddling a page boundary                                         */
+/***************************************************************/
+static uint8_t mem_read_8(uint32_t address) {
+    return mem_pte(address)->read[address & PAGE_MASK];
+}
+
+static void mem_write_8(uint32_t address, uint8_t value) {
+    uint8_t *page = page_for_write(address);
+    if (page != NULL) {
+        page[address & PAGE_MASK] = value;
+    }
+}
+
+/***************************************************************/
+/* Read a word straddling a page boundary                                                              */
+/***************************************************************/
+uint32_t mem_read_32_slow(uint32_t address) {
+    return (mem_read_8(address + 3) << 24) |
+           (mem_read_8(address + 2) << 16) |
+           (mem_read_8(address + 1) << 8) |
+           (mem_read_8(address + 0) << 0);
+}
+
+/***************************************************************/
+/* Write a word to a page not yet allocated, or straddling a page boundary            */
+/***************************************************************/
+void mem_write_32_slow(uint32_t address, uint32_t value) {
+    uint32_t offset = address & PAGE_MASK;
+    uint8_t *page;
+
+    if (offset > PAGE_SIZE - 4) {
+        mem_write_8(address + 3, (value >> 24) & 0xFF);
+        mem_write_8(address + 2, (value >> 16) & 0xFF);
+        mem_write_8(address + 1, (value >> 8) & 0xFF);
+        mem_write_8(address + 0, (value >> 0) & 0xFF);
+        return;
+    }
+
+    page = page_for_write(address);
+    if (page == NULL) {
+        return;
+    }
+    page[offset + 3] = (value >> 24) & 0xFF;
+    page[offset + 2] = (value >> 16) & 0xFF;
+    page[offset + 1] = (value >> 8) & 0xFF;
+    page[offset + 0] = (value >> 0) & 0xFF;
+}
+
+/***************************************************************/
+/* Point the whole address space at the zero page                                                   */
+/***************************************************************/
+void init_memory() {
+    int i;
+    for (i = 0; i < PDIR_ENTRIES; i++) {
+        MEM_PAGE_DIR[i] = EMPTY_TABLE;
+    }
+    MEM_PAGES_ALLOCATED = 0;
+    MEM->pristine = NULL;
+    MEM->pristine_pages = 0;
+    MEM->dirty_map = NULL;
+    MEM->dirty = NULL;
+    MEM->dirty_pages = MEM->dirty_capacity = 0;
+}
+
+/***************************************************************/
+/* Forget the saved image                                                                                          */
+/***************************************************************/
+static void drop_pristine() {
+    uint32_t i;
+
+    for (i = 0; i < MEM->pristine_pages; i++) {
+        page_release(MEM->pristine[i].data);
+    }
+    free(MEM->pristine);
+    MEM->pristine = NULL;
+    MEM->pristine_pages = 0;
+    free(MEM->dirty_map);
+    free(MEM->dirty);
+    MEM->dirty_map = NULL;
+    MEM->dirty = NULL;
+    MEM->dirty_pages = MEM->dirty_capacity = 0;
+}
+
+/***************************************************************/
+/* Save the current contents as the image mem_restore_pristine() goes back to          */
+/***************************************************************/
+void mem_save_pristine() {
+    int i, p;
+    mem_page_copy_t *copy;
+
+    drop_pristine();
+    MEM->pristine = malloc((MEM_PAGES_ALLOCATED + 1) * sizeof(mem_page_copy_t));
+    MEM->dirty_map = calloc(NUM_PAGES / 8, 1);
+    if (MEM->pristine == NULL || MEM->dirty_map == NULL) {
+        printf("Error: Out of memory saving the memory image\n");
+        exit(-1);
+    }
+    /* directory order is address order, which find_pristine() relies on */
+    for (i = 0; i < PDIR_ENTRIES; i++) {
+        if (MEM_PAGE_DIR[i] == EMPTY_TABLE) {
+            continue;
+        }
+        for (p = 0; p < PTAB_ENTRIES; p++) {
+            if (MEM_PAGE_DIR[i][p].read == ZERO_PAGE) {
+                continue;
+            }
+            /* shared with the address space; the next store to the page marks it dirty and
+             * copies it */
+            copy = &MEM->pristine[MEM->pristine_pages++];
+            copy->address = ((uint32_t) i << PDIR_SHIFT) | ((uint32_t) p << PAGE_SHIFT);
+            copy->data = (uint8_t *) MEM_PAGE_DIR[i][p].read;
+            page_hold(copy->data);
+            MEM_PAGE_DIR[i][p].write = NULL;
+        }
+    }
+}
+
+/***************************************************************/
+/* Saved copy of the page at address, NULL if the page was not allocated then          */
+/***************************************************************/
+static const mem_page_copy_t *find_pristine(uint32_t address) {
+    uint32_t low = 0, high = MEM->pristine_pages, middle;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (MEM->pristine[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < MEM->pristine_pages && MEM->pristine[low].address == address ? &MEM->pristine[low] : NULL;
+}
+
+/***************************************************************/
+/* Put back the image of mem_save_pristine(), touching only the pages written since  */
+/***************************************************************/
+void mem_restore_pristine() {
+    const mem_page_copy_t *copy;
+    mem_pte_t *pte;
+    uint32_t i, address, page;
+
+    for (i = 0; i < MEM->dirty_pages; i++) {
+        address = MEM->dirty[i];
+        pte = mem_pte(address);
+        /* whatever was derived from the page (decoded instructions) goes with it */
+        if (MEM_WRITE_FAULT_HOOK != NULL) {
+            MEM_WRITE_FAULT_HOOK(address);
+        }
+        copy = find_pristine(address);
+        if (copy != NULL) {
+            if (pte->read != copy->data) {
+                if (pte->read == ZERO_PAGE) {
+                    MEM_PAGES_ALLOCATED++;
+                } else {
+                    page_release(pte->read);
+                }
+                page_hold(copy->data);
+                pte->read = copy->data;
+            }
+        } else if (pte->read != ZERO_PAGE) {
+            page_release(pte->read);
+            pte->read = ZERO_PAGE;
+            MEM_PAGES_ALLOCATED--;
+        }
+        pte->write = NULL;
+        page = address >> PAGE_SHIFT;
+        MEM->dirty_map[page >> 3] &= ~(1 << (page & 7));
+    }
+    MEM->dirty_pages = 0;
+}
+
+/***************************************************************/
+/* Release every allocated page, memory reads as zero again                                    */
+/***************************************************************/
+void reset_memory() {
+    int i, p;
+    for (i = 0; i < PDIR_ENTRIES; i++) {
+        if (MEM_PAGE_DIR[i] == EMPTY_TABLE) {
+            continue;
+        }
+        for (p = 0; p < PTAB_ENTRIES; p++) {
+            if (MEM_PAGE_DIR[i][p].read != ZERO_PAGE) {
+                page_release(MEM_PAGE_DIR[i][p].read);
+            }
+        }
+        free(MEM_PAGE_DIR[i]);
+        MEM_PAGE_DIR[i] = EMPTY_TABLE;
+    }
+    MEM_PAGES_ALLOCATED = 0;
+    drop_pristine();
+}
+
+/***************************************************************/
+/* Capture the address space, sharing its pages until either side writes them          */
+/***************************************************************/
+void mem_snapshot(mem_snapshot_t *snap) {
+    int i, p;
+    mem_page_copy_t *copy;
+
+    snap->pages = malloc((MEM_PAGES_ALLOCATED + 1) * sizeof(mem_page_copy_t));
+    snap->count = 0;
+    if (snap->pages == NULL) {
+        printf("Error: Out of memory taking a snapshot\n");
+        exit(-1);
+    }
+    /* directory order is address order, which find_snapshot() relies on */
+    for (i = 0; i < PDIR_ENTRIES; i++) {
+        if (MEM_PAGE_DIR[i] == EMPTY_TABLE) {
+            continue;
+        }
+        for (p = 0; p < PTAB_ENTRIES; p++) {
+            if (MEM_PAGE_DIR[i][p].read == ZERO_PAGE) {
+                continue;
+            }
+            copy = &snap->pages[snap->count++];
+            copy->address = ((uint32_t) i << PDIR_SHIFT) | ((uint32_t) p << PAGE_SHIFT);
+            copy->data = (uint8_t *) MEM_PAGE_DIR[i][p].read;
+            page_hold(copy->data);
+            /* the next store copies the page */
+            MEM_PAGE_DIR[i][p].write = NULL;
+        }
+    }
+}
+
+/***************************************************************/
+/* Page a snapshot holds for address, NULL if the page was not allocated then            */
+/***************************************************************/
+static const uint8_t *find_snapshot(const mem_snapshot_t *snap, uint32_t address) {
+    uint32_t low = 0, high = snap->count, middle;
+
+    while (low < high) {
+        middle = (low + high) / 2;
+        if (snap->pages[middle].address < address) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < snap->count && snap->pages[low].address == address ? snap->pages[low].data : NULL;
+}
+
+/***************************************************************/
+/* Point the address space back at a snapshot's pages                                                */
+/* Pages that did not change since the snapshot are left alone, so whatever was         */
+/* derived from them (decoded instructions) stays valid.                                              */
+/***************************************************************/
+void mem_restore(const mem_snapshot_t *snap) {
+    const uint8_t *data;
+    mem_pte_t *pte;
+    uint32_t address, i;
+    int d, p;
+
+    /* pages allocated since the snapshot go back to the zero page */
+    for (d = 0; d < PDIR_ENTRIES; d++) {
+        if (MEM_PAGE_DIR[d] == EMPTY_TABLE) {
+            continue;
+        }
+        for (p = 0; p < PTAB_ENTRIES; p++) {
+            pte = &MEM_PAGE_DIR[d][p];
+            address = ((uint32_t) d << PDIR_SHIFT) | ((uint32_t) p << PAGE_SHIFT);
+            if (pte->read == ZERO_PAGE || find_snapshot(snap, address) != NULL) {
+                continue;
+            }
+            if (MEM_WRITE_FAULT_HOOK != NULL) {
+                MEM_WRITE_FAULT_HOOK(address);
+            }
+            mark_dirty(address);
+            page_release(pte->read);
+            pte->read = ZERO_PAGE;
+            pte->write = NULL;
+            MEM_PAGES_ALLOCATED--;
+        }
+    }
+    for (i = 0; i < snap->count; i++) {
+        address = snap->pages[i].address;
+        data = snap->pages[i].data;
+        pte = pte_for_write(address);
+        if (pte->read != data) {
+            if (MEM_WRITE_FAULT_HOOK != NULL) {
+                MEM_WRITE_FAULT_HOOK(address);
+            }
+            /* it may no longer match the pristine image either */
+            mark_dirty(address);
+            if (pte->read == ZERO_PAGE) {
+                MEM_PAGES_ALLOCATED++;
+            } else {
+                page_release(pte->read);
+            }
+            page_hold(data);
+            pte->read = data;
+        }
+        pte->write = NULL;
+    }
+}
+
+/***************************************************************/
+/* Drop a snapshot's references to its pages                                                          */
+/***************************************************************/
+void mem_snapshot_free(mem_snapshot_t *snap) {
+    uint32_t i;
+
+    for (i = 0; i < snap->count; i++) {
+        page_release(snap->pages[i].data);
+    }
+    free(snap->pages);
+    snap->pages = NULL;
+    snap->count = 0;
+}
+
+/***************************************************************/
+/* Fill an empty address space with pages inside a read-only file mapping                  */
+/* Each page's data must follow a mem_page_header_t with mapped set. The pages are    */
+/* copied only when written; the mapping goes away with the last reference to them.    */
+/***************************************************************/
+void mem_map_pages(void *base, size_t length, const mem_page_copy_t *pages, uint32_t count) {
+    mem_mapping_t *mapping;
+    mem_pte_t *pte;
+    uint32_t i;
+
+    if (count == 0) {
+        munmap(base, length);
+        return;
+    }
+    mapping = malloc(sizeof(mem_mapping_t));
+    if (mapping == NULL) {
+        printf("Error: Out of memory mapping pages\n");
+        exit(-1);
+    }
+    mapping->base = base;
+    mapping->length = length;
+    mapping->refs = count;
+    lock_mappings();
+    mapping->next = MAPPINGS;
+    MAPPINGS = mapping;
+    unlock_mappings();
+
+    for (i = 0; i < count; i++) {
+        pte = pte_for_write(pages[i].address);
+        pte->read = pages[i].data;
+        pte->write = NULL;
+        MEM_PAGES_ALLOCATED++;
+    }
+}
@@ -0,0 +1,155 @@
+#ifndef MU_MEM_H
+#define MU_MEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/******************************************************************************/
+/* MIPS memory layout                                                                                                                                      */
+/******************************************************************************/
+#define MEM_TEXT_BEGIN  0x00400000
+#define MEM_TEXT_END      0x0FFFFFFF
+/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
+#define MEM_DATA_BEGIN  0x10010000
+#define MEM_DATA_END   0x7FFFFFFF
+
+#define MEM_KTEXT_BEGIN 0x80000000
+#define MEM_KTEXT_END  0x8FFFFFFF
+
+#define MEM_KDATA_BEGIN 0x90000000
+#define MEM_KDATA_END  0xFFFEFFFF
+
+/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
+#define MEM_STACK_BEGIN 0x7FFFFFFF
+#define MEM_STACK_END  0x10010000
+
+/******************************************************************************/
+/* Paged memory                                                                                                                                                  */
+/******************************************************************************/
+/* the 32-bit address space is split into 4KB pages reached through a two level table:
+ * address[31:22] indexes the page directory, address[21:12] the page table, address[11:0] the page.
+ * A page is only allocated the first time it is written; reads of a page that was never written
+ * are served from a single shared zero page. */
+#define PAGE_SHIFT 12
+#define PAGE_SIZE  (1u << PAGE_SHIFT)
+#define PAGE_MASK  (PAGE_SIZE - 1)
+#define PDIR_SHIFT 22
+#define PDIR_ENTRIES 1024
+#define PTAB_ENTRIES 1024
+
+typedef struct {
+	uint32_t begin, end;
+} mem_region_t;
+
+typedef struct {
+	const uint8_t *read; /* page data, the zero page while the page is untouched or unmapped */
+	uint8_t *write;      /* page data, NULL sends the store through mem_write_32_slow() */
+} mem_pte_t;
+
+/* called with the page address whenever a store finds the page's write pointer NULL,
+ * i.e. on the first write to a page and on the first write after mem_write_protect() */
+typedef void (*mem_write_fault_t)(uint32_t page_address);
+
+#define NUM_MEM_REGION 4
+
+/* the 16 bytes in front of every allocated page's data */
+typedef struct {
+	uint32_t refs;    /* address spaces and snapshots sharing the page */
+	uint32_t mapped;  /* the page lives in a read-only file mapping (mem_map_pages()) */
+	uint32_t pad[2];  /* keeps the page data 16 byte aligned */
+} mem_page_header_t;
+
+/* one page of a saved image, shared with whatever else holds it */
+typedef struct {
+	uint32_t address;
+	uint8_t *data;
+} mem_page_copy_t;
+
+#define NUM_PAGES (1u << (32 - PAGE_SHIFT))
+
+/* the allocated pages of an address space at one moment, by address. The pages are shared
+ * with the address space (and with other snapshots) and copied by whichever store reaches
+ * one of them first, so taking and restoring a snapshot never copies page data. */
+typedef struct {
+	mem_page_copy_t *pages;
+	uint32_t count;
+} mem_snapshot_t;
+
+/* one guest address space; directory slots without any written page share an empty table,
+ * so lookups never test for NULL.
+ * After mem_save_pristine() every page is write protected, so the first store to a page lands
+ * in mem_write_32_slow(), which adds it to the dirty list and copies the page; the saved image
+ * keeps the original. mem_restore_pristine() then only has to point the pages on that list back
+ * at the originals. */
+typedef struct {
+	mem_pte_t *page_dir[PDIR_ENTRIES];
+	uint32_t pages_allocated;
+	mem_page_copy_t *pristine;  /* allocated pages at mem_save_pristine(), by address */
+	uint32_t pristine_pages;
+	uint8_t *dirty_map;         /* one bit per page, NULL while nothing is saved */
+	uint32_t *dirty;            /* addresses of the pages set in dirty_map */
+	uint32_t dirty_pages, dirty_capacity;
+} mem_space_t;
+
+extern mem_region_t MEM_REGIONS[NUM_MEM_REGION];
+extern mem_write_fault_t MEM_WRITE_FAULT_HOOK;
+
+/* the address space this thread works on; every function below uses it */
+extern _Thread_local mem_space_t *MEM;
+#define MEM_PAGE_DIR (MEM->page_dir)
+#define MEM_PAGES_ALLOCATED (MEM->pages_allocated)
+
+void init_memory();   /* MEM starts out empty */
+void reset_memory();  /* release MEM's pages (and the saved image) */
+void mem_save_pristine();
+void mem_restore_pristine();
+void mem_snapshot(mem_snapshot_t *snap);
+void mem_restore(const mem_snapshot_t *snap);
+void mem_snapshot_free(mem_snapshot_t *snap); /* needs no current address space */
+void mem_map_pages(void *base, size_t length, const mem_page_copy_t *pages, uint32_t count);
+void mem_write_protect(uint32_t address);
+/* data of the page holding address, allocated and made writable as a store would, NULL
+ * outside every region; the next mem_save_pristine()/mem_snapshot() protects it again */
+uint8_t *mem_page_for_write(uint32_t address);
+uint32_t mem_read_32_slow(uint32_t address);
+void mem_write_32_slow(uint32_t address, uint32_t value);
+
+static inline mem_pte_t *mem_pte(uint32_t address) {
+	return &MEM_PAGE_DIR[address >> PDIR_SHIFT][(address >> PAGE_SHIFT) & (PTAB_ENTRIES - 1)];
+}
+
+/***************************************************************/
+/* Read a 32-bit word from memory                                                                            */
+/***************************************************************/
+static inline uint32_t mem_read_32(uint32_t address) {
+	uint32_t offset = address & PAGE_MASK;
+	const uint8_t *page;
+
+	if (offset > PAGE_SIZE - 4) {
+		return mem_read_32_slow(address);
+	}
+	page = mem_pte(address)->read;
+	return (page[offset + 3] << 24) |
+	       (page[offset + 2] << 16) |
+	       (page[offset + 1] << 8) |
+	       (page[offset + 0] << 0);
+}
+
+/***************************************************************/
+/* Write a 32-bit word to memory                                                                                */
+/***************************************************************/
+static inline void mem_write_32(uint32_t address, uint32_t value) {
+	uint32_t offset = address & PAGE_MASK;
+	uint8_t *page = mem_pte(address)->write;
+
+	if (page == NULL || offset > PAGE_SIZE - 4) {
+		mem_write_32_slow(address, value);
+		return;
+	}
+	page[offset + 3] = (value >> 24) & 0xFF;
+	page[offset + 2] = (value >> 16) & 0xFF;
+	page[offset + 1] = (value >> 8) & 0xFF;
+	page[offset + 0] = (value >> 0) & 0xFF;
+}
+
+#endif
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#include "mu-sim.h"
+
+/***************************************************************/
+/* Parallel batch runner                                                                                                   */
+/*                                                                                                                                    */
+/*   mu-mips-batch [-j <threads>] [-m <max instructions>] [-e <engine>] [-o <results>] <manifest> */
+/*                                                                                                                                    */
+/* The manifest lists one job per line: a program file followed by optional initial   */
+/* values, as the input/high/low commands set them:                                                 */
+/*   inputs/test1.in r4=10 r5=0x20 hi=1 lo=2                                                         */
+/* Blank lines and lines starting with # are skipped.                                               */
+/*                                                                                                                                    */
+/* Every worker thread owns one simulator, reused from job to job, and a deque of     */
+/* jobs: a contiguous range of the manifest. A worker takes jobs from the back of its   */
+/* own range; once that is empty it steals the front half of the largest range left.     */
+/* The results file gets one line per job, in manifest order:                                       */
+/*   <job> <program> <halted|limit|error> <instructions> <seconds> <pc> <hi> <lo> <r0> ... <r31> */
+/* with the values in hex. The programs' own output is discarded.                               */
+/***************************************************************/
+
+#define MAX_LINE 1024
+
+typedef struct {
+	char *program;
+	uint32_t set_mask;          /* bit i: REGS[i] has an initial value */
+	uint32_t regs[MIPS_REGS];
+	int set_hi, set_lo;
+	uint32_t hi, lo;
+	/* results */
+	int status;                 /* JOB_* */
+	uint32_t instructions;
+	double seconds;
+	CPU_State state;
+} job_t;
+
+#define JOB_HALTED 0
+#define JOB_LIMIT  1
+#define JOB_ERROR  2
+
+static const char *STATUS_NAMES[] = { "halted", "limit", "error" };
+
+/* a worker's share of the manifest: jobs [front, back) */
+typedef struct {
+	pthread_mutex_t lock;
+	uint32_t front, back;
+} deque_t;
+
+typedef struct {
+	pthread_t thread;
+	uint32_t id;
+	uint32_t steals;
+	uint32_t jobs_run;
+} worker_t;
+
+static job_t *JOBS;
+static uint32_t NUM_JOBS;
+static deque_t *DEQUES;
+static worker_t *WORKERS;
+static uint32_t NUM_WORKERS;
+static uint32_t MAX_INSTRUCTIONS = UINT32_MAX;
+static int ENGINE = ENGINE_BLOCK;
+
+static double wall_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void usage(const char *program) {
+    printf("Usage: %s [-j <threads>] [-m <max instructions>] [-e <interp|block|jit>] [-o <results>] <manifest>\n", program);
+    exit(1);
+}
+
+/***************************************************************/
+/* Parse one "rN=value", "hi=value" or "lo=value" field of a manifest line                */
+/***************************************************************/
+static int parse_setting(job_t *job, const char *field) {
+    unsigned int reg;
+    char *end;
+    uint32_t value;
+    const char *equals = strchr(field, '=');
+
+    if (equals == NULL) {
+        return 0;
+    }
+    value = strtoul(equals + 1, &end, 0);
+    if (*end != '\0' || end == equals + 1) {
+        return 0;
+    }
+    if (strncmp(field, "hi=", 3) == 0) {
+        job->set_hi = 1;
+        job->hi = value;
+    } else if (strncmp(field, "lo=", 3) == 0) {
+        job->set_lo = 1;
+        job->lo = value;
+    } else if (sscanf(field, "r%u=", &reg) == 1 && reg < MIPS_REGS) {
+        job->set_mask |= 1u << reg;
+        job->regs[reg] = value;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/***************************************************************/
+/* Read the manifest into JOBS                                                                                */
+/***************************************************************/
+static void read_manifest(const char *path) {
+    FILE *fp;
+    char line[MAX_LINE];
+    char *field;
+    uint32_t capacity = 0, line_no = 0;
+    job_t *job;
+
+    fp = fopen(path, "r");
+    if (fp == NULL) {
+        printf("Error: Can't open manifest %s\n", path);
+        exit(-1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_no++;
+        field = strtok(line, " \t\r\n");
+        if (field == NULL || field[0] == '#') {
+            continue;
+        }
+        if (NUM_JOBS == capacity) {
+            capacity = capacity ? 2 * capacity : 1024;
+            JOBS = realloc(JOBS, capacity * sizeof(job_t));
+            if (JOBS == NULL) {
+                printf("Error: Out of memory reading the manifest\n");
+                exit(-1);
+            }
+        }
+        job = &JOBS[NUM_JOBS++];
+        memset(job, 0, sizeof(job_t));
+        if (strlen(field) >= sizeof(((mips_sim_t *) 0)->program_file)) {
+            printf("Error: %s:%u: program file name too long\n", path, line_no);
+            exit(-1);
+        }
+        job->program = strdup(field);
+        while ((field = strtok(NULL, " \t\r\n")) != NULL) {
+            if (!parse_setting(job, field)) {
+                printf("Error: %s:%u: bad initial value %s\n", path, line_no, field);
+                exit(-1);
+            }
+        }
+    }
+    fclose(fp);
+}
+
+/***************************************************************/
+/* Next job for worker w: the back of its own deque, else half of the fullest other  */
+/* deque. Returns NUM_JOBS once every deque is empty.                                             */
+/***************************************************************/
+static uint32_t next_job(worker_t *w) {
+    deque_t *own = &DEQUES[w->id], *victim;
+    uint32_t job = NUM_JOBS, i, size, best, half;
+
+    pthread_mutex_lock(&own->lock);
+    if (own->front < own->back) {
+        job = --own->back;
+    }
+    pthread_mutex_unlock(&own->lock);
+    if (job != NUM_JOBS) {
+        return job;
+    }
+
+    for (;;) {
+        /* pick the victim without locking; the size is checked again under its lock */
+        best = 0;
+        victim = NULL;
+        for (i = 0; i < NUM_WORKERS; i++) {
+            size = DEQUES[i].back - DEQUES[i].front;
+            if (i != w->id && DEQUES[i].front < DEQUES[i].back && size > best) {
+                best = size;
+                victim = &DEQUES[i];
+            }
+        }
+        if (victim == NULL) {
+            return NUM_JOBS;
+        }
+
+        pthread_mutex_lock(&victim->lock);
+        size = victim->back > victim->front ? victim->back - victim->front : 0;
+        if (size == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        half = (size + 1) / 2;
+        i = victim->front;
+        victim->front += half;
+        pthread_mutex_unlock(&victim->lock);
+
+        /* run the first stolen job now and keep the rest where others can steal it back */
+        w->steals++;
+        pthread_mutex_lock(&own->lock);
+        own->front = i + 1;
+        own->back = i + half;
+        pthread_mutex_unlock(&own->lock);
+        return i;
+    }
+}
+
+/***************************************************************/
+/* Run one job on the worker's simulator                                                                 */
+/***************************************************************/
+static void run_job(mips_sim_t *sim, job_t *job) {
+    double start = wall_time();
+    uint32_t executed = 0;
+    int i;
+
+    /* start from the state a freshly started simulator would have; a run of jobs on the
+     * same program only has to put back the pages the previous one wrote */
+    if (strcmp(sim->program_file, job->program) == 0) {
+        mips_sim_reset(sim);
+        sim->prev_instruction = 0;
+    } else if (mips_sim_load(sim, job->program) < 0) {
+        job->status = JOB_ERROR;
+        return;
+    }
+    for (i = 0; i < MIPS_REGS; i++) {
+        if (job->set_mask & (1u << i)) {
+            sim->state.REGS[i] = job->regs[i];
+        }
+    }
+    if (job->set_hi) {
+        sim->state.HI = job->hi;
+    }
+    if (job->set_lo) {
+        sim->state.LO = job->lo;
+    }
+
+    while (sim->run_flag && executed < MAX_INSTRUCTIONS) {
+        executed += mips_sim_run(sim, MAX_INSTRUCTIONS - executed);
+    }
+
+    job->status = sim->run_flag ? JOB_LIMIT : JOB_HALTED;
+    job->instructions = sim->instruction_count;
+    job->state = sim->state;
+    job->seconds = wall_time() - start;
+}
+
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    mips_sim_t *sim = mips_sim_new();
+    uint32_t job;
+
+    sim->engine = ENGINE;
+    while ((job = next_job(w)) != NUM_JOBS) {
+        run_job(sim, &JOBS[job]);
+        w->jobs_run++;
+    }
+    mips_sim_free(sim);
+    return NULL;
+}
+
+/***************************************************************/
+/* Write one results line per job                                                                             */
+/***************************************************************/
+static void write_results(FILE *out) {
+    uint32_t j;
+    int i;
+
+    fprintf(out, "# job program status instructions seconds pc hi lo r0..r31\n");
+    for (j = 0; j < NUM_JOBS; j++) {
+        job_t *job = &JOBS[j];
+        fprintf(out, "%u %s %s %u %.6f %08x %08x %08x", j, job->program, STATUS_NAMES[job->status],
+                job->instructions, job->seconds, job->state.PC, job->state.HI, job->state.LO);
+        for (i = 0; i < MIPS_REGS; i++) {
+            fprintf(out, " %08x", job->state.REGS[i]);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *manifest = NULL, *results = NULL;
+    FILE *out;
+    double start, elapsed;
+    uint64_t total_instructions = 0;
+    uint32_t i, steals = 0, failed = 0;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int a, null_fd;
+
+    NUM_WORKERS = cores > 0 ? cores : 1;
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-j") == 0 && a + 1 < argc) {
+            NUM_WORKERS = strtoul(argv[++a], NULL, 0);
+        } else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc) {
+            MAX_INSTRUCTIONS = strtoul(argv[++a], NULL, 0);
+        } else if (strcmp(argv[a], "-e") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "interp") == 0) {
+                ENGINE = ENGINE_INTERP;
+            } else if (strcmp(argv[a], "block") == 0) {
+                ENGINE = ENGINE_BLOCK;
+            } else if (strcmp(argv[a], "jit") == 0) {
+                ENGINE = ENGINE_JIT;
+            } else {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            results = argv[++a];
+        } else if (manifest == NULL && argv[a][0] != '-') {
+            manifest = argv[a];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (manifest == NULL || NUM_WORKERS == 0) {
+        usage(argv[0]);
+    }
+
+    read_manifest(manifest);
+    if (NUM_WORKERS > NUM_JOBS) {
+        NUM_WORKERS = NUM_JOBS > 0 ? NUM_JOBS : 1;
+    }
+
+    /* results go to the real stdout; the guests' puts() output goes nowhere */
+    out = results != NULL ? fopen(results, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL) {
+        printf("Error: Can't open results file %s\n", results);
+        exit(-1);
+    }
+    fflush(stdout);
+    null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+
+    /* deal the manifest out in contiguous ranges, one per worker */
+    DEQUES = calloc(NUM_WORKERS, sizeof(deque_t));
+    WORKERS = calloc(NUM_WORKERS, sizeof(worker_t));
+    if (DEQUES == NULL || WORKERS == NULL) {
+        fprintf(stderr, "Error: Out of memory starting the workers\n");
+        exit(-1);
+    }
+    for (i = 0; i < NUM_WORKERS; i++) {
+        pthread_mutex_init(&DEQUES[i].lock, NULL);
+        DEQUES[i].front = (uint64_t) NUM_JOBS * i / NUM_WORKERS;
+        DEQUES[i].back = (uint64_t) NUM_JOBS * (i + 1) / NUM_WORKERS;
+        WORKERS[i].id = i;
+    }
+
+    start = wall_time();
+    for (i = 0; i < NUM_WORKERS; i++) {
+        if (pthread_create(&WORKERS[i].thread, NULL, worker_main, &WORKERS[i]) != 0) {
+            fprintf(stderr, "Error: Can't start worker %u\n", i);
+            exit(-1);
+        }
+    }
+    for (i = 0; i < NUM_WORKERS; i++) {
+        pthread_join(WORKERS[i].thread, NULL);
+        steals += WORKERS[i].steals;
+    }
+    elapsed = wall_time() - start;
+
+    write_results(out);
+    fclose(out);
+
+    for (i = 0; i < NUM_JOBS; i++) {
+        total_instructions += JOBS[i].instructions;
+        failed += JOBS[i].status == JOB_ERROR;
+    }
+    fprintf(stderr, "%u jobs (%u failed) on %u threads in %.3f s, %llu instructions (%.3f million instructions/s), %u steals\n",
+            NUM_JOBS, failed, NUM_WORKERS, elapsed, (unsigned long long) total_instructions,
+            elapsed > 0 ? total_instructions / elapsed / 1e6 : 0.0, steals);
+    return failed ? 1 : 0;
+}
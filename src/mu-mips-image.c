@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <elf.h>
+
+#include "mu-mem.h"
+#include "mu-decode.h"
+#include "mu-load.h"
+#include "mu-asm.h"
+
+/***************************************************************/
+/* Program image converter                                                                                      */
+/*                                                                                                                                    */
+/* Converts text programs (one hex word per line), assembly source (mu-asm.h) and ELF   */
+/* executables to the binary image format the simulator maps straight into memory:      */
+/*   mu-mips-image [-e <entry>] [-s <symbols>] [-d <address>:<data file>]... -o <image> <program>  */
+/*     a text program is loaded at MEM_TEXT_BEGIN, each -d file at <address> (hex);    */
+/*     the entry point defaults to MEM_TEXT_BEGIN, or the source's or executable's.      */
+/*     Labels of the source become symbols. A symbol file                                          */
+/*     has one "<address> <name>" line per symbol, address in hex, # starts a comment. */
+/*   mu-mips-image -l <image>   list an image's entry point, segments and symbols      */
+/***************************************************************/
+
+#define MAX_DATA_FILES 16
+
+static mem_space_t SPACE;
+static predecode_t DECODE;
+
+static void usage(const char *program) {
+    printf("Usage: %s [-e <entry>] [-s <symbols>] [-d <address>:<data file>]... -o <image> <program>\n", program);
+    printf("       %s -l <image>\n", program);
+    exit(1);
+}
+
+/***************************************************************/
+/* Whole file in a NUL terminated buffer                                                                     */
+/***************************************************************/
+static char *read_file(const char *path, size_t *length) {
+    FILE *fp = fopen(path, "rb");
+    char *text;
+    long size;
+
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        printf("Error: Can't read %s\n", path);
+        exit(-1);
+    }
+    text = malloc(size + 1);
+    if (text == NULL || fread(text, 1, size, fp) != (size_t) size) {
+        printf("Error: Can't read %s\n", path);
+        exit(-1);
+    }
+    text[size] = '\0';
+    fclose(fp);
+    *length = size;
+    return text;
+}
+
+/***************************************************************/
+/* Add a segment to the image's table                                                                       */
+/***************************************************************/
+static void append_segment(image_info_t *info, uint32_t address, uint32_t size, uint32_t flags) {
+    image_segment_t *segment;
+
+    info->segments = realloc(info->segments, (info->segment_count + 1) * sizeof(image_segment_t));
+    if (info->segments == NULL) {
+        printf("Error: Out of memory adding a segment\n");
+        exit(-1);
+    }
+    segment = &info->segments[info->segment_count++];
+    segment->address = address;
+    segment->size = size;
+    segment->flags = flags;
+    segment->reserved = 0;
+}
+
+/***************************************************************/
+/* Load a text file as a segment                                                                                  */
+/***************************************************************/
+static void add_segment(image_info_t *info, const char *path, uint32_t address, uint32_t flags) {
+    size_t length;
+    char *text = read_file(path, &length);
+    int words;
+
+    if ((address & 3) != 0) {
+        printf("Error: Segment address 0x%08x is not word aligned\n", address);
+        exit(-1);
+    }
+    words = load_hex(text, length, address);
+    if (words < 0) {
+        printf("Error: %s is not a program of hex words, or does not fit at 0x%08x\n", path, address);
+        exit(-1);
+    }
+    append_segment(info, address, 4 * words, flags);
+    free(text);
+}
+
+/***************************************************************/
+/* Load a text program: hex words, else assembly source                                         */
+/***************************************************************/
+static void add_program(image_info_t *info, const char *path) {
+    size_t length;
+    char *text = read_file(path, &length), error[128];
+    int words = load_hex(text, length, MEM_TEXT_BEGIN);
+
+    if (words >= 0) {
+        info->entry = MEM_TEXT_BEGIN;
+        append_segment(info, MEM_TEXT_BEGIN, 4 * words, SEGMENT_TEXT);
+    } else if (assemble(text, length, info, error, sizeof(error)) != 0) {
+        printf("Error: %s, %s\n", path, error);
+        exit(-1);
+    }
+    free(text);
+}
+
+/***************************************************************/
+/* Load an executable, taking its entry point, segments and symbols                          */
+/***************************************************************/
+static void add_executable(image_info_t *info, const char *path) {
+    size_t length;
+    char *file = read_file(path, &length);
+
+    if (load_elf((const uint8_t *) file, length, info) != 0) {
+        printf("Error: %s is not an ELF32 MIPS executable that fits the memory regions\n", path);
+        exit(-1);
+    }
+    free(file);
+}
+
+/***************************************************************/
+/* Read a symbol file                                                                                                   */
+/***************************************************************/
+static void read_symbols(image_info_t *info, const char *path) {
+    size_t length, name_length;
+    char *text = read_file(path, &length);
+    char *line, *next, name[256];
+    uint32_t address;
+
+    for (line = text; line != NULL && *line != '\0'; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        if (line[strspn(line, " \t\r")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%x %255s", &address, name) != 2) {
+            printf("Error: Bad symbol line in %s: %s\n", path, line);
+            exit(-1);
+        }
+        name_length = strlen(name) + 1;
+        info->symbols = realloc(info->symbols, (info->symbol_count + 1) * sizeof(image_symbol_t));
+        info->strings = realloc(info->strings, info->strings_size + name_length);
+        if (info->symbols == NULL || info->strings == NULL) {
+            printf("Error: Out of memory reading symbols\n");
+            exit(-1);
+        }
+        info->symbols[info->symbol_count].address = address;
+        info->symbols[info->symbol_count].name = info->strings_size;
+        info->symbol_count++;
+        memcpy(info->strings + info->strings_size, name, name_length);
+        info->strings_size += name_length;
+    }
+    free(text);
+}
+
+/***************************************************************/
+/* List an image                                                                                                            */
+/***************************************************************/
+static int list_image(const char *path) {
+    image_info_t info;
+    struct stat st;
+    uint32_t i;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || read_image_info(fd, st.st_size, &info) != 0) {
+        printf("Error: %s is not a version %d image\n", path, IMAGE_VERSION);
+        exit(-1);
+    }
+    close(fd);
+    printf("entry 0x%08x\n", info.entry);
+    for (i = 0; i < info.segment_count; i++) {
+        printf("segment 0x%08x-0x%08x %s%s\n", info.segments[i].address,
+               info.segments[i].address + info.segments[i].size - 1,
+               info.segments[i].flags & SEGMENT_TEXT ? "text" : "",
+               info.segments[i].flags & SEGMENT_DATA ? "data" : "");
+    }
+    printf("pages %u\n", info.page_count);
+    for (i = 0; i < info.symbol_count; i++) {
+        printf("symbol 0x%08x %s\n", info.symbols[i].address, info.strings + info.symbols[i].name);
+    }
+    free_image_info(&info);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    image_info_t info;
+    const char *output = NULL, *program = NULL, *symbols = NULL;
+    const char *data[MAX_DATA_FILES];
+    uint32_t data_address[MAX_DATA_FILES], entry = 0;
+    char *end, magic[SELFMAG];
+    FILE *fp;
+    int a, i, datas = 0, set_entry = 0;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-l") == 0 && a + 1 < argc) {
+            return list_image(argv[a + 1]);
+        } else if (strcmp(argv[a], "-o") == 0 && a + 1 < argc) {
+            output = argv[++a];
+        } else if (strcmp(argv[a], "-e") == 0 && a + 1 < argc) {
+            entry = strtoul(argv[++a], &end, 16);
+            set_entry = 1;
+            if (*end != '\0') {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            symbols = argv[++a];
+        } else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc && datas < MAX_DATA_FILES) {
+            data_address[datas] = strtoul(argv[++a], &end, 16);
+            if (*end != ':' || end[1] == '\0') {
+                usage(argv[0]);
+            }
+            data[datas++] = end + 1;
+        } else if (program == NULL && argv[a][0] != '-') {
+            program = argv[a];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (output == NULL || program == NULL) {
+        usage(argv[0]);
+    }
+
+    MEM = &SPACE;
+    PREDECODE = &DECODE;
+    init_memory();
+    init_predecode();
+    memset(&info, 0, sizeof(info));
+    fp = fopen(program, "rb");
+    if (fp != NULL && fread(magic, 1, SELFMAG, fp) == SELFMAG && memcmp(magic, ELFMAG, SELFMAG) == 0) {
+        add_executable(&info, program);
+    } else {
+        add_program(&info, program);
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (set_entry) {
+        info.entry = entry;
+    }
+    for (i = 0; i < datas; i++) {
+        add_segment(&info, data[i], data_address[i], SEGMENT_DATA);
+    }
+    if (symbols != NULL) {
+        read_symbols(&info, symbols);
+    }
+    if (save_image(output, &info) != 0) {
+        printf("Error: Can't write %s: %s\n", output, strerror(errno));
+        exit(-1);
+    }
+    free_image_info(&info);
+    reset_memory();
+    return 0;
+}
@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "mu-bbv.h"
+
+/***************************************************************/
+/* Simulation point picker                                                                                       */
+/*                                                                                                                                    */
+/* Reads a profile written by the simulator's bbv command, groups its intervals into    */
+/* phases with k-means and prints, for each phase, the interval closest to its center */
+/* and the share of the run's instructions the phase holds, one line per point:          */
+/*   interval  first instruction  instructions  weight  phase  intervals in the phase       */
+/* Timing just those intervals and weighting the results estimates the whole run.      */
+/*   -k <n>      use n phases instead of choosing with the BIC                                  */
+/*   -m <max>    try 1 to max phases and use the fewest scoring within 90% of the    */
+/*               best BIC (default 10)                                                                             */
+/*   -d <dims>   dimensions the vectors are randomly projected down to (default 15) */
+/*   -s <seed>   seed of the projection and the initial centers                                  */
+/***************************************************************/
+
+#define READ_ENTRIES 4096
+#define DEFAULT_MAX_PHASES 10
+#define DEFAULT_DIMENSIONS 15
+#define TRIES 5                 /* k-means runs per phase count; the tightest is kept */
+#define MAX_ITERATIONS 100
+#define BIC_THRESHOLD 0.9
+#define MIN_VARIANCE 1e-12
+#define TWO_PI 6.28318530717958647692
+
+static bbv_entry_t entries[READ_ENTRIES];
+
+static uint32_t DIMS = DEFAULT_DIMENSIONS;
+static uint64_t SEED = 1;
+static uint64_t RANDOM_STATE;
+
+/* the intervals: their place in the run and their projected vectors */
+static uint32_t COUNT;
+static uint64_t *STARTS;
+static uint32_t *LENGTHS;
+static double *POINTS;          /* COUNT * DIMS */
+
+static void usage(const char *program) {
+    printf("Usage: %s [-k <phases> | -m <max phases>] [-d <dimensions>] [-s <seed>] <profile file>\n", program);
+    exit(1);
+}
+
+static void *allocate(size_t size) {
+    void *p = malloc(size);
+
+    if (p == NULL) {
+        printf("Error: Out of memory\n");
+        exit(-1);
+    }
+    return p;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/* the projection matrix's entry for a block and a dimension, uniform in [-1, 1) */
+static double projection(uint32_t leader, uint32_t dim) {
+    uint64_t x = mix(SEED * 0x9E3779B97F4A7C15ull + ((uint64_t) leader << 8) + dim);
+
+    return (x >> 11) * (2.0 / 9007199254740992.0) - 1;
+}
+
+/* uniform in [0, 1) */
+static double random_fraction() {
+    RANDOM_STATE = mix(RANDOM_STATE + 0x9E3779B97F4A7C15ull);
+    return (RANDOM_STATE >> 11) / 9007199254740992.0;
+}
+
+/************************************************************/
+/* Read the profile, projecting each interval's vector as it goes                               */
+/* Each vector is first scaled to sum to 1, so intervals compare by where they spent */
+/* their time and not by how long they were.                                                              */
+/************************************************************/
+static void read_profile(const char *path, bbv_header_t *header) {
+    FILE *fp = fopen(path, "rb");
+    bbv_interval_t interval;
+    uint32_t capacity = 0, left, chunk, i, j;
+    uint64_t start;
+    double *point, share;
+
+    if (fp == NULL) {
+        printf("Error: Can't open profile file %s\n", path);
+        exit(-1);
+    }
+    if (fread(header, sizeof(*header), 1, fp) != 1 || memcmp(header->magic, BBV_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BBV_VERSION) {
+        printf("Error: %s is not a version %d profile file\n", path, BBV_VERSION);
+        exit(-1);
+    }
+    start = header->start;
+    while (fread(&interval, sizeof(interval), 1, fp) == 1) {
+        if (COUNT == capacity) {
+            capacity = capacity == 0 ? 256 : 2 * capacity;
+            STARTS = realloc(STARTS, capacity * sizeof(uint64_t));
+            LENGTHS = realloc(LENGTHS, capacity * sizeof(uint32_t));
+            POINTS = realloc(POINTS, (size_t) capacity * DIMS * sizeof(double));
+            if (STARTS == NULL || LENGTHS == NULL || POINTS == NULL) {
+                printf("Error: Out of memory reading %u intervals\n", COUNT);
+                exit(-1);
+            }
+        }
+        point = &POINTS[(size_t) COUNT * DIMS];
+        memset(point, 0, DIMS * sizeof(double));
+        for (left = interval.blocks; left > 0; left -= chunk) {
+            chunk = left < READ_ENTRIES ? left : READ_ENTRIES;
+            if (fread(entries, sizeof(bbv_entry_t), chunk, fp) != chunk) {
+                printf("Error: %s ends in the middle of an interval\n", path);
+                exit(-1);
+            }
+            for (i = 0; i < chunk; i++) {
+                share = (double) entries[i].instructions / interval.instructions;
+                for (j = 0; j < DIMS; j++) {
+                    point[j] += share * projection(entries[i].leader, j);
+                }
+            }
+        }
+        STARTS[COUNT] = start;
+        LENGTHS[COUNT] = interval.instructions;
+        start += interval.instructions;
+        COUNT++;
+    }
+    fclose(fp);
+}
+
+static double distance(const double *a, const double *b) {
+    double sum = 0, d;
+    uint32_t j;
+
+    for (j = 0; j < DIMS; j++) {
+        d = a[j] - b[j];
+        sum += d * d;
+    }
+    return sum;
+}
+
+/************************************************************/
+/* k-means with k-means++ seeding                                                                       */
+/* Fills centers (k * DIMS) and assign; returns the sum of the squared distances of   */
+/* the points to their centers.                                                                               */
+/************************************************************/
+static double kmeans(uint32_t k, double *centers, uint32_t *assign) {
+    double *nearest = allocate(COUNT * sizeof(double));
+    uint32_t *sizes = allocate(k * sizeof(uint32_t));
+    double total, pick, d, distortion = 0;
+    uint32_t c, i, j, iteration, best, changed = 1;
+
+    /* each next center is a point picked with odds in proportion to its squared
+     * distance from the centers so far */
+    memcpy(centers, &POINTS[(size_t) (random_fraction() * COUNT) * DIMS], DIMS * sizeof(double));
+    for (i = 0; i < COUNT; i++) {
+        nearest[i] = distance(&POINTS[(size_t) i * DIMS], centers);
+    }
+    for (c = 1; c < k; c++) {
+        total = 0;
+        for (i = 0; i < COUNT; i++) {
+            total += nearest[i];
+        }
+        pick = random_fraction() * total;
+        for (i = 0; i + 1 < COUNT && (pick -= nearest[i]) >= 0; i++) {
+        }
+        memcpy(&centers[c * DIMS], &POINTS[(size_t) i * DIMS], DIMS * sizeof(double));
+        for (i = 0; i < COUNT; i++) {
+            d = distance(&POINTS[(size_t) i * DIMS], &centers[c * DIMS]);
+            if (d < nearest[i]) {
+                nearest[i] = d;
+            }
+        }
+    }
+
+    for (i = 0; i < COUNT; i++) {
+        assign[i] = k;
+    }
+    for (iteration = 0; iteration < MAX_ITERATIONS && changed; iteration++) {
+        changed = 0;
+        distortion = 0;
+        for (i = 0; i < COUNT; i++) {
+            best = 0;
+            nearest[i] = distance(&POINTS[(size_t) i * DIMS], centers);
+            for (c = 1; c < k; c++) {
+                d = distance(&POINTS[(size_t) i * DIMS], &centers[c * DIMS]);
+                if (d < nearest[i]) {
+                    nearest[i] = d;
+                    best = c;
+                }
+            }
+            changed |= assign[i] != best;
+            assign[i] = best;
+            distortion += nearest[i];
+        }
+        if (!changed) {
+            break;
+        }
+        /* move each center to the mean of its points; an empty one stays put */
+        memset(sizes, 0, k * sizeof(uint32_t));
+        for (i = 0; i < COUNT; i++) {
+            if (sizes[assign[i]]++ == 0) {
+                memset(&centers[assign[i] * DIMS], 0, DIMS * sizeof(double));
+            }
+            for (j = 0; j < DIMS; j++) {
+                centers[assign[i] * DIMS + j] += POINTS[(size_t) i * DIMS + j];
+            }
+        }
+        for (c = 0; c < k; c++) {
+            for (j = 0; sizes[c] > 0 && j < DIMS; j++) {
+                centers[c * DIMS + j] /= sizes[c];
+            }
+        }
+    }
+    free(nearest);
+    free(sizes);
+    return distortion;
+}
+
+/************************************************************/
+/* Bayesian information criterion of a clustering, taken as a mixture of spherical      */
+/* Gaussians with one variance (Pelleg and Moore's X-means); higher is better                 */
+/************************************************************/
+static double bic(uint32_t k, const uint32_t *assign, double distortion) {
+    uint32_t *sizes = calloc(k, sizeof(uint32_t));
+    double variance, likelihood, parameters;
+    uint32_t c, i;
+
+    if (sizes == NULL) {
+        printf("Error: Out of memory\n");
+        exit(-1);
+    }
+    for (i = 0; i < COUNT; i++) {
+        sizes[assign[i]]++;
+    }
+    variance = COUNT > k ? distortion / ((double) DIMS * (COUNT - k)) : 0;
+    if (variance < MIN_VARIANCE) {
+        variance = MIN_VARIANCE;
+    }
+    likelihood = -0.5 * COUNT * DIMS * log(TWO_PI * variance) - 0.5 * DIMS * (COUNT > k ? COUNT - k : 0);
+    for (c = 0; c < k; c++) {
+        if (sizes[c] > 0) {
+            likelihood += sizes[c] * log((double) sizes[c] / COUNT);
+        }
+    }
+    parameters = (k - 1) + (double) k * DIMS + 1;
+    free(sizes);
+    return likelihood - 0.5 * parameters * log(COUNT);
+}
+
+/* the tightest of TRIES clusterings into k phases */
+static double best_kmeans(uint32_t k, double *centers, uint32_t *assign) {
+    double *try_centers = allocate((size_t) k * DIMS * sizeof(double));
+    uint32_t *try_assign = allocate(COUNT * sizeof(uint32_t));
+    double best = -1, distortion;
+    int t;
+
+    RANDOM_STATE = mix(SEED + k);
+    for (t = 0; t < TRIES; t++) {
+        distortion = kmeans(k, try_centers, try_assign);
+        if (best < 0 || distortion < best) {
+            best = distortion;
+            memcpy(centers, try_centers, (size_t) k * DIMS * sizeof(double));
+            memcpy(assign, try_assign, COUNT * sizeof(uint32_t));
+        }
+    }
+    free(try_centers);
+    free(try_assign);
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    bbv_header_t header;
+    const char *path = NULL;
+    uint32_t phases = 0, max_phases = DEFAULT_MAX_PHASES, k, c, i, size;
+    uint32_t *assign, *point_of;
+    double *centers, *scores, distortion, low, high, d, best_distance;
+    uint64_t total = 0, in_phase;
+    char *end;
+    int a;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-k") == 0 && a + 1 < argc) {
+            phases = strtoul(argv[++a], &end, 0);
+        } else if (strcmp(argv[a], "-m") == 0 && a + 1 < argc) {
+            max_phases = strtoul(argv[++a], &end, 0);
+        } else if (strcmp(argv[a], "-d") == 0 && a + 1 < argc) {
+            DIMS = strtoul(argv[++a], &end, 0);
+        } else if (strcmp(argv[a], "-s") == 0 && a + 1 < argc) {
+            SEED = strtoull(argv[++a], &end, 0);
+        } else if (path == NULL && argv[a][0] != '-') {
+            path = argv[a];
+            continue;
+        } else {
+            usage(argv[0]);
+        }
+        if (*end != '\0') {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL || max_phases == 0 || DIMS == 0) {
+        usage(argv[0]);
+    }
+
+    read_profile(path, &header);
+    if (COUNT == 0) {
+        printf("Error: %s holds no intervals\n", path);
+        exit(-1);
+    }
+    for (i = 0; i < COUNT; i++) {
+        total += LENGTHS[i];
+    }
+    if (max_phases > COUNT) {
+        max_phases = COUNT;
+    }
+    if (phases > COUNT) {
+        phases = COUNT;
+    }
+
+    centers = allocate((size_t) (phases > max_phases ? phases : max_phases) * DIMS * sizeof(double));
+    assign = allocate(COUNT * sizeof(uint32_t));
+    printf("# %u intervals of %u instructions from instruction %u, %llu instructions in all\n", COUNT,
+           header.interval, header.start, (unsigned long long) total);
+    if (phases == 0) {
+        /* score every phase count, then cluster again with the one chosen */
+        scores = allocate((max_phases + 1) * sizeof(double));
+        low = high = 0;
+        for (k = 1; k <= max_phases; k++) {
+            distortion = best_kmeans(k, centers, assign);
+            scores[k] = bic(k, assign, distortion);
+            if (k == 1 || scores[k] < low) {
+                low = scores[k];
+            }
+            if (k == 1 || scores[k] > high) {
+                high = scores[k];
+            }
+        }
+        for (phases = 1; phases < max_phases && scores[phases] < low + BIC_THRESHOLD * (high - low); phases++) {
+        }
+        printf("# %u phases, the fewest of 1 to %u within %.0f%% of the best BIC\n", phases, max_phases,
+               100 * BIC_THRESHOLD);
+        free(scores);
+    } else {
+        printf("# %u phases\n", phases);
+    }
+    best_kmeans(phases, centers, assign);
+
+    /* each phase's point is the interval nearest its center */
+    point_of = allocate(phases * sizeof(uint32_t));
+    for (c = 0; c < phases; c++) {
+        point_of[c] = COUNT;
+        best_distance = 0;
+        for (i = 0; i < COUNT; i++) {
+            if (assign[i] != c) {
+                continue;
+            }
+            d = distance(&POINTS[(size_t) i * DIMS], &centers[c * DIMS]);
+            if (point_of[c] == COUNT || d < best_distance) {
+                point_of[c] = i;
+                best_distance = d;
+            }
+        }
+    }
+    printf("# interval  first instruction  instructions    weight  phase  intervals\n");
+    for (i = 0; i < COUNT; i++) {
+        for (c = 0; c < phases && point_of[c] != i; c++) {
+        }
+        if (c == phases) {
+            continue;
+        }
+        in_phase = 0;
+        size = 0;
+        for (k = 0; k < COUNT; k++) {
+            if (assign[k] == c) {
+                in_phase += LENGTHS[k];
+                size++;
+            }
+        }
+        printf("%10u  %17llu  %12u  %8.6f  %5u  %9u\n", i, (unsigned long long) STARTS[i], LENGTHS[i],
+               (double) in_phase / total, c, size);
+    }
+    free(point_of);
+    free(centers);
+    free(assign);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mu-decode.h"
+#include "mu-disasm.h"
+#include "mu-btrace.h"
+
+/***************************************************************/
+/* Binary trace decoder                                                                                              */
+/*                                                                                                                                    */
+/* Prints the records of a trace written by the simulator's btrace command, one line */
+/* per instruction:  pc  word  mnemonic  result  [memory access]                                */
+/*   -r <start>:<end>  only instructions with start <= pc <= end (hex)                        */
+/*   -d                follow each line with the print_instruction() listing                     */
+/***************************************************************/
+
+#define READ_RECORDS 4096
+
+static btrace_record_t records[READ_RECORDS];
+
+static void usage(const char *program) {
+    printf("Usage: %s [-d] [-r <start>:<end>] <trace file>\n", program);
+    exit(1);
+}
+
+static void print_record(const btrace_record_t *r, int listing) {
+    decoded_insn_t d;
+
+    decode_instruction(r->ins, r->pc, &d);
+    printf("%08x  %08x  %s", r->pc, r->ins, OP_NAMES[d.op]);
+    if (r->dest != BTRACE_DEST_NONE || r->flags != 0) {
+        printf("%*s", 8 - (int) strlen(OP_NAMES[d.op]), "");
+    }
+    if (r->dest < 32) {
+        printf(" r%-2u = 0x%08x", r->dest, r->value);
+    } else if (r->dest == BTRACE_DEST_HI) {
+        printf(" HI  = 0x%08x", r->value);
+    } else if (r->dest == BTRACE_DEST_LO) {
+        printf(" LO  = 0x%08x", r->value);
+    }
+    if (r->flags & BTRACE_LOAD) {
+        printf("  load [0x%08x]", r->address);
+    } else if (r->flags & BTRACE_STORE) {
+        printf(" [0x%08x] = 0x%08x", r->address, r->value);
+    }
+    printf("\n");
+    if (listing) {
+        fprint_instruction(stdout, r->ins);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    FILE *fp;
+    btrace_header_t header;
+    uint32_t start = 0, end = 0xFFFFFFFF;
+    const char *path = NULL;
+    int listing = 0;
+    size_t count, i;
+    int a;
+
+    for (a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-d") == 0) {
+            listing = 1;
+        } else if (strcmp(argv[a], "-r") == 0 && a + 1 < argc) {
+            if (sscanf(argv[++a], "%x:%x", &start, &end) != 2) {
+                usage(argv[0]);
+            }
+        } else if (path == NULL && argv[a][0] != '-') {
+            path = argv[a];
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (path == NULL) {
+        usage(argv[0]);
+    }
+
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        printf("Error: Can't open trace file %s\n", path);
+        exit(-1);
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, BTRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BTRACE_VERSION || header.record_size != sizeof(btrace_record_t)) {
+        printf("Error: %s is not a version %d trace file\n", path, BTRACE_VERSION);
+        exit(-1);
+    }
+
+    while ((count = fread(records, sizeof(btrace_record_t), READ_RECORDS, fp)) > 0) {
+        for (i = 0; i < count; i++) {
+            if (records[i].pc >= start && records[i].pc <= end) {
+                print_record(&records[i], listing);
+            }
+        }
+    }
+    fclose(fp);
+    return 0;
+}
@@ -3,21 +3,35 @@
 #include <string.h>
 #include <stdint.h>
 #include <assert.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
 
 #include "mu-mips.h"
+#include "mu-disasm.h"
+#include "mu-btrace.h"
+#include "mu-bbv.h"
+#include "mu-checkpoint.h"
 
-uint32_t prevInstruction;
+int HEADLESS;
 
+static const char *TRACE_NAMES[] = { "off", "mnemonic", "full" };
+#ifdef MU_THREADED_CORE
+static const char *ENGINE_NAMES[] = { "threaded interp", "block", "jit", "pipeline" };
+#else
+static const char *ENGINE_NAMES[] = { "interp", "block", "jit", "pipeline" };
+#endif
 
-uint32_t extend_sign(uint32_t im) {
-    uint32_t data = (im & 0x0000FFFF);
-    uint32_t mask = 0x00008000;
-    if (mask & data) {
-        data = data | 0xFFFF0000;
-    }
+/* taken with the snapshot command, numbered from 0 */
+#define MAX_SNAPSHOTS 16
+static mips_snapshot_t *SNAPSHOTS[MAX_SNAPSHOTS];
+static int SNAPSHOT_COUNT;
+
+/* periodic checkpoints, set with the checkpoint command or --checkpoint */
+static char CHECKPOINT_FILE[256];
+static uint32_t CHECKPOINT_INTERVAL;    /* instructions between checkpoints, 0 for none */
+static uint32_t NEXT_CHECKPOINT;        /* INSTRUCTION_COUNT due for the next one */
 
-    return data;
-}
 
 /***************************************************************/
 /* Print out a list of commands available                                                                  */
@@ -29,58 +43,340 @@ void help() {
     printf("run <n>\t-- simulate program for <n> instructions\n");
     printf("rdump\t-- dump register values\n");
     printf("reset\t-- clears all registers/memory and re-loads the program\n");
+    printf("snapshot\t-- save registers, counters and memory, numbered from 0\n");
+    printf("restore <n>\t-- return to snapshot <n>\n");
+    printf("checkpoint <file> <n>\t-- save the machine to <file> now and, if <n> > 0, every <n> instructions\n");
+    printf("checkpoint off\t-- stop writing checkpoints\n");
+    printf("resume <file>\t-- continue from a checkpoint file\n");
     printf("input <reg> <val>\t-- set GPR <reg> to <val>\n");
     printf("mdump <start> <stop>\t-- dump memory from <start> to <stop> address\n");
     printf("high <val>\t-- set the HI register to <val>\n");
     printf("low <val>\t-- set the LO register to <val>\n");
     printf("print\t-- print the program loaded into memory\n");
+    printf("engine <interp|block>\t-- execute one instruction at a time, or whole basic blocks\n");
+    printf("engine <jit|jit-verify>\t-- compile hot blocks to native code (and check them against the interpreter)\n");
+    printf("engine pipeline\t-- time the program on a five-stage pipeline (cycles, CPI and stalls after sim)\n");
+    printf("cache <on|off|stats>\t-- time the pipeline's fetches, loads and stores on the cache hierarchy\n");
+    printf("cache <l1i|l1d|l2>:<bytes>:<ways>:<line>:<lru|plru|random>:<wb|wt>:<alloc|noalloc>:<cycles>\t-- configure a level (<level>:off removes it)\n");
+    printf("cache memory:<cycles>\t-- set the memory latency\n");
+    printf("bpred <on|off|stats>\t-- predict branches (the pipeline fetches down the predicted path; accuracy after sim)\n");
+    printf("bpred <static|bimodal|gshare|tournament>\t-- turn the predictor on with a scheme\n");
+    printf("bpred <table|history|btb|ras>:<n>\t-- counters per table (log2), history bits, BTB entries, return stack depth\n");
+    printf("sample <on|off>\t-- time sampled units on the pipeline and fast-forward in between (estimated CPI after sim)\n");
+    printf("sample <period>:<unit>:<detail>:<warm>\t-- a <unit>-instruction unit every <period>, after <detail> pipeline and <warm> warming instructions\n");
+    printf("trace <off|mnemonic|full>\t-- select the execution trace level\n");
+    printf("btrace <file|off>\t-- record every executed instruction to a binary trace file (see mu-mips-trace)\n");
+    printf("bbv <file> <n>\t-- record a basic-block vector for every <n> instructions (see mu-mips-simpoint)\n");
+    printf("bbv off\t-- stop recording basic-block vectors\n");
     printf("?\t-- display help menu\n");
     printf("quit\t-- exit the simulator\n\n");
     printf("------------------------------------------------------------------\n\n");
 }
 
 /***************************************************************/
-/* Read a 32-bit word from memory                                                                            */
+/* Seconds on a monotonic clock, for run statistics                                              */
+/***************************************************************/
+static double wall_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/***************************************************************/
+/* Write CHECKPOINT_FILE                                                                                          */
 /***************************************************************/
-uint32_t mem_read_32(uint32_t address) {
+static void write_checkpoint() {
+    if (mips_sim_checkpoint(SIM, CHECKPOINT_FILE) != 0) {
+        printf("Error: Can't write checkpoint %s: %s\n", CHECKPOINT_FILE, strerror(errno));
+    }
+}
+
+/***************************************************************/
+/* Run up to max_instructions, stopping every CHECKPOINT_INTERVAL to save the machine */
+/* Returns the number of instructions executed.                                                      */
+/***************************************************************/
+static uint32_t run_checkpointed(uint32_t max_instructions) {
+    uint32_t executed = 0, chunk;
+
+    if (CHECKPOINT_INTERVAL == 0) {
+        return mips_sim_run(SIM, max_instructions);
+    }
+    /* the engines run on across chunk boundaries exactly as in one call, and the write
+     * costs about as much as touching the guest's pages, so the interval bounds the overhead */
+    while (RUN_FLAG && executed < max_instructions) {
+        if ((int32_t) (INSTRUCTION_COUNT - NEXT_CHECKPOINT) >= 0) {
+            write_checkpoint();
+            NEXT_CHECKPOINT = INSTRUCTION_COUNT + CHECKPOINT_INTERVAL;
+        }
+        chunk = NEXT_CHECKPOINT - INSTRUCTION_COUNT;
+        if (chunk > max_instructions - executed) {
+            chunk = max_instructions - executed;
+        }
+        executed += mips_sim_run(SIM, chunk);
+    }
+    return executed;
+}
+
+/***************************************************************/
+/* Report simulation speed                                                                                        */
+/***************************************************************/
+static void print_run_stats(uint32_t instructions, double seconds) {
+    printf("%u instructions in %.6f s", instructions, seconds);
+    if (seconds > 0) {
+        printf(" (%.3f million instructions/s)", instructions / seconds / 1e6);
+    }
+    printf(" [%s engine%s%s%s]\n\n", ENGINE_NAMES[SIM_ENGINE], BTRACE_ACTIVE ? ", binary trace on cycle()" : "",
+           BPRED.enabled && SIM_ENGINE != ENGINE_PIPE && !SAMPLE.enabled ? ", branch prediction on cycle()" : "",
+           SAMPLE.enabled ? ", sampled on the pipeline" : "");
+}
+
+/***************************************************************/
+/* Report what the pipeline engine counted since the program was loaded              */
+/***************************************************************/
+static void print_pipeline_stats() {
+    const pipe_stats_t *s = &PIPE_STATS;
+
+    printf("Pipeline: %llu cycles, %llu instructions", (unsigned long long) s->cycles,
+           (unsigned long long) s->instructions);
+    if (s->instructions > 0) {
+        printf(", CPI %.3f", (double) s->cycles / s->instructions);
+    }
+    printf("\n  load-use stalls\t: %llu cycles\n", (unsigned long long) s->load_use_stalls);
+    printf("  branch flushes\t: %llu (%llu instructions squashed)\n", (unsigned long long) s->flushes,
+           (unsigned long long) s->flushed);
+    if (CACHES.enabled) {
+        printf("  fetch stalls\t\t: %llu cycles\n", (unsigned long long) s->fetch_stalls);
+        printf("  memory stalls\t\t: %llu cycles\n", (unsigned long long) s->memory_stalls);
+    }
+    printf("  forwarded operands\t: %llu from EX/MEM, %llu from MEM/WB\n\n", (unsigned long long) s->forward_ex_mem,
+           (unsigned long long) s->forward_mem_wb);
+}
+
+/***************************************************************/
+/* Report each cache level's configuration and counts                                              */
+/***************************************************************/
+static void print_cache_stats() {
+    static const char *REPLACEMENT_NAMES[] = { "LRU", "PLRU", "random" };
+    const cache_t *c;
+    uint64_t accesses, misses;
     int i;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        if ((address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end)) {
-            uint32_t offset = address - MEM_REGIONS[i].begin;
-            return (MEM_REGIONS[i].mem[offset + 3] << 24) |
-                   (MEM_REGIONS[i].mem[offset + 2] << 16) |
-                   (MEM_REGIONS[i].mem[offset + 1] << 8) |
-                   (MEM_REGIONS[i].mem[offset + 0] << 0);
+
+    printf("Caches (%s, memory %u cycles):\n", CACHES.enabled ? "on" : "off", CACHES.memory_latency);
+    for (i = 0; i < CACHE_LEVELS; i++) {
+        c = &CACHES.level[i];
+        if (c->config.size == 0) {
+            printf("  %s\t: none\n", CACHE_NAMES[i]);
+            continue;
         }
+        accesses = c->stats.reads + c->stats.writes;
+        misses = c->stats.read_misses + c->stats.write_misses;
+        printf("  %s\t: %u bytes, %u-way, %u byte lines, %s, %s, %s, %u cycles\n", CACHE_NAMES[i], c->config.size,
+               c->config.ways, c->config.line_size, REPLACEMENT_NAMES[c->config.replacement],
+               c->config.write_back ? "write-back" : "write-through",
+               c->config.write_allocate ? "write-allocate" : "no write-allocate", c->config.latency);
+        printf("\t  %llu accesses, %llu hits, %llu misses", (unsigned long long) accesses,
+               (unsigned long long) (accesses - misses), (unsigned long long) misses);
+        if (accesses > 0) {
+            printf(" (%.2f%%)", 100.0 * misses / accesses);
+        }
+        printf(", %llu evictions, %llu writebacks\n", (unsigned long long) c->stats.evictions,
+               (unsigned long long) c->stats.writebacks);
     }
-    return 0;
+    printf("\n");
+}
+
+/***************************************************************/
+/* Report the branch predictor's accuracy and the branches it got wrong most          */
+/***************************************************************/
+#define WORST_BRANCHES 10
+
+static void print_bpred_stats() {
+    const bpred_config_t *c = &BPRED.config;
+    const bpred_stats_t *s = &BPRED.stats;
+    bpred_site_t worst[WORST_BRANCHES];
+    uint32_t i, n;
+
+    printf("Branch predictor (%s", BPRED_SCHEME_NAMES[c->scheme]);
+    if (c->scheme != BPRED_STATIC) {
+        printf(", %u-counter tables", 1u << c->table_bits);
+    }
+    if (c->scheme == BPRED_GSHARE || c->scheme == BPRED_TOURNAMENT) {
+        printf(", %u history bits", c->history_bits);
+    }
+    printf(", %u-entry BTB, %u-deep return stack; %llu bytes):\n", c->btb_entries, c->ras_depth,
+           (unsigned long long) (bpred_budget(&BPRED) + 7) / 8);
+    printf("  branches\t\t: %llu in %llu instructions, %llu conditional, %llu taken\n",
+           (unsigned long long) s->branches, (unsigned long long) s->instructions,
+           (unsigned long long) s->conditional, (unsigned long long) s->taken);
+    printf("  mispredicts\t\t: %llu", (unsigned long long) s->mispredicts);
+    if (s->branches > 0) {
+        printf(" (%.2f%% accurate, %.3f MPKI)", 100.0 - 100.0 * s->mispredicts / s->branches,
+               1000.0 * s->mispredicts / s->instructions);
+    }
+    printf("\n  wrong direction\t: %llu\n", (unsigned long long) s->direction_mispredicts);
+    printf("  BTB misses\t\t: %llu\n", (unsigned long long) s->btb_misses);
+    printf("  wrong returns\t\t: %llu\n", (unsigned long long) s->ras_mispredicts);
+    n = bpred_worst_sites(worst, WORST_BRANCHES);
+    if (n > 0 && worst[0].mispredicts > 0) {
+        printf("  most mispredicted:\n");
+    }
+    for (i = 0; i < n && worst[i].mispredicts > 0; i++) {
+        printf("\t0x%08x: %u executed, %u taken, %u mispredicted (%.2f%% accurate)\n", worst[i].pc,
+               worst[i].executed, worst[i].taken, worst[i].mispredicts,
+               100.0 - 100.0 * worst[i].mispredicts / worst[i].executed);
+    }
+    printf("\n");
 }
 
 /***************************************************************/
-/* Write a 32-bit word to memory                                                                                */
+/* Carry out a branch predictor setting:                                                               */
+/*   on | off | <static|bimodal|gshare|tournament> | <table|history|btb|ras>:<n>  */
+/* Returns 0, -1 (with a message) if the setting is not understood.                       */
 /***************************************************************/
-void mem_write_32(uint32_t address, uint32_t value) {
+static int set_bpred(const char *setting) {
+    bpred_config_t config = BPRED.config;
+    uint32_t n;
     int i;
-    uint32_t offset;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        if ((address >= MEM_REGIONS[i].begin) && (address <= MEM_REGIONS[i].end)) {
-            offset = address - MEM_REGIONS[i].begin;
-
-            MEM_REGIONS[i].mem[offset + 3] = (value >> 24) & 0xFF;
-            MEM_REGIONS[i].mem[offset + 2] = (value >> 16) & 0xFF;
-            MEM_REGIONS[i].mem[offset + 1] = (value >> 8) & 0xFF;
-            MEM_REGIONS[i].mem[offset + 0] = (value >> 0) & 0xFF;
+
+    if (strcmp(setting, "on") == 0 || strcmp(setting, "off") == 0) {
+        BPRED.enabled = strcmp(setting, "on") == 0;
+        return 0;
+    }
+    for (i = 0; i < BPRED_SCHEMES; i++) {
+        if (strcmp(setting, BPRED_SCHEME_NAMES[i]) == 0) {
+            config.scheme = i;
+            break;
         }
     }
+    if (i == BPRED_SCHEMES) {
+        if (sscanf(setting, "table:%u", &n) == 1) {
+            config.table_bits = n > 255 ? 255 : n;
+        } else if (sscanf(setting, "history:%u", &n) == 1) {
+            config.history_bits = n > 255 ? 255 : n;
+        } else if (sscanf(setting, "btb:%u", &n) == 1) {
+            config.btb_entries = n;
+        } else if (sscanf(setting, "ras:%u", &n) == 1) {
+            config.ras_depth = n;
+        } else {
+            printf("Unknown branch predictor setting %s\n", setting);
+            return -1;
+        }
+    }
+    if (bpred_configure(&BPRED, &config) != 0) {
+        printf("Can't build the predictor: tables of 2 to 2^24 counters, at most 32 history bits, "
+               "a power of two BTB entries and a return stack at most 4096 deep\n");
+        return -1;
+    }
+    if (i < BPRED_SCHEMES) {
+        BPRED.enabled = 1;
+    }
+    return 0;
+}
+
+/***************************************************************/
+/* Report the CPI the sampled units estimate for the whole run                               */
+/***************************************************************/
+static void print_sample_stats() {
+    const sample_config_t *c = &SAMPLE.config;
+    const uint64_t *ran = SAMPLE.stats.instructions;
+    uint64_t total = ran[SAMPLE_FAST] + ran[SAMPLE_WARM] + ran[SAMPLE_DETAIL] + ran[SAMPLE_MEASURE];
+    double cpi, half_width;
+
+    printf("Sampling: a %u-instruction unit every %u, after %u pipeline and %u warming instructions\n",
+           c->interval, c->period, c->detail_warmup, c->warmup);
+    printf("  instructions\t\t: %llu fast, %llu warming, %llu on the pipeline", (unsigned long long) ran[SAMPLE_FAST],
+           (unsigned long long) ran[SAMPLE_WARM], (unsigned long long) (ran[SAMPLE_DETAIL] + ran[SAMPLE_MEASURE]));
+    if (total > 0) {
+        printf(" (%.3f%%)", 100.0 * (ran[SAMPLE_DETAIL] + ran[SAMPLE_MEASURE]) / total);
+    }
+    if (sample_estimate(&cpi, &half_width) == 0) {
+        printf("\n  no unit was measured: the run is shorter than a period\n\n");
+        return;
+    }
+    printf("\n  units measured\t: %llu\n", (unsigned long long) SAMPLE.stats.samples);
+    printf("  estimated CPI\t\t: %.4f", cpi);
+    if (SAMPLE.stats.samples > 1) {
+        printf(" +/- %.4f (%.2f%%, %.0f%% confidence)", half_width, 100.0 * half_width / cpi, 95.0);
+    }
+    printf("\n  estimated cycles\t: %.0f for %llu instructions\n\n", cpi * total, (unsigned long long) total);
+}
+
+/***************************************************************/
+/* Carry out a sampling setting: on | off | <period>:<unit>:<detail>:<warm>         */
+/* Returns 0, -1 (with a message) if the setting is not understood.                       */
+/***************************************************************/
+static int set_sample(const char *setting) {
+    sample_config_t config;
+
+    if (strcmp(setting, "on") == 0 || strcmp(setting, "off") == 0) {
+        SAMPLE.enabled = strcmp(setting, "on") == 0;
+        return 0;
+    }
+    if (sscanf(setting, "%u:%u:%u:%u", &config.period, &config.interval, &config.detail_warmup,
+               &config.warmup) != 4) {
+        printf("Sampling settings are on, off or <period>:<unit>:<detail>:<warm>\n");
+        return -1;
+    }
+    if (sample_configure(&SAMPLE, &config) != 0) {
+        printf("Can't sample: the unit must not be empty, and the unit and both warm-ups must fit in the period\n");
+        return -1;
+    }
+    SAMPLE.enabled = 1;
+    return 0;
 }
 
 /***************************************************************/
-/* Execute one cycle                                                                                                              */
+/* Carry out a cache setting:                                                                                    */
+/*   on | off | <level>:off | memory:<cycles>                                                              */
+/*   <level>:<bytes>:<ways>:<line>:<lru|plru|random>:<wb|wt>:<alloc|noalloc>:<cycles>  */
+/* Returns 0, -1 (with a message) if the setting is not understood.                       */
 /***************************************************************/
-void cycle() {
-    handle_instruction();
-    CURRENT_STATE = NEXT_STATE;
-    INSTRUCTION_COUNT++;
+static int set_cache(const char *setting) {
+    static const char *REPLACEMENTS[] = { "lru", "plru", "random" };
+    char level[8], replacement[8], write[8], allocate[8];
+    cache_config_t config;
+    int i, r;
+
+    if (strcmp(setting, "on") == 0 || strcmp(setting, "off") == 0) {
+        CACHES.enabled = strcmp(setting, "on") == 0;
+        return 0;
+    }
+    if (sscanf(setting, "memory:%u", &CACHES.memory_latency) == 1) {
+        return 0;
+    }
+    if (sscanf(setting, "%7[^:]:", level) != 1) {
+        printf("Unknown cache setting %s\n", setting);
+        return -1;
+    }
+    for (i = 0; i < CACHE_LEVELS && strcmp(level, CACHE_NAMES[i]) != 0; i++) {
+    }
+    if (i == CACHE_LEVELS) {
+        printf("Unknown cache level %s\n", level);
+        return -1;
+    }
+    memset(&config, 0, sizeof(config));
+    if (strcmp(setting + strlen(level), ":off") != 0) {
+        if (sscanf(setting + strlen(level), ":%u:%u:%u:%7[^:]:%7[^:]:%7[^:]:%u", &config.size, &config.ways,
+                   &config.line_size, replacement, write, allocate, &config.latency) != 7) {
+            printf("Cache settings are <level>:<bytes>:<ways>:<line>:<lru|plru|random>:<wb|wt>:<alloc|noalloc>:<cycles>\n");
+            return -1;
+        }
+        for (r = 0; r < 3 && strcmp(replacement, REPLACEMENTS[r]) != 0; r++) {
+        }
+        config.replacement = r;
+        config.write_back = strcmp(write, "wb") == 0;
+        config.write_allocate = strcmp(allocate, "alloc") == 0;
+        if (r == 3 || (!config.write_back && strcmp(write, "wt") != 0) ||
+            (!config.write_allocate && strcmp(allocate, "noalloc") != 0)) {
+            printf("Unknown cache policy in %s\n", setting);
+            return -1;
+        }
+    }
+    if (cache_configure(&CACHES.level[i], &config) != 0) {
+        printf("Can't build %s: sizes must be powers of two with room for a set, at most 64 ways with PLRU\n", level);
+        return -1;
+    }
+    return 0;
 }
 
 /***************************************************************/
@@ -94,13 +390,8 @@ void run(int num_cycles) {
     }
 
     printf("Running simulator for %d cycles...\n\n", num_cycles);
-    int i;
-    for (i = 0; i < num_cycles; i++) {
-        if (RUN_FLAG == FALSE) {
-            printf("Simulation Stopped.\n\n");
-            break;
-        }
-        cycle();
+    if (num_cycles > 0 && run_checkpointed(num_cycles) < (uint32_t) num_cycles) {
+        printf("Simulation Stopped.\n\n");
     }
 }
 
@@ -113,11 +404,27 @@ void runAll() {
         return;
     }
 
+    uint32_t start_count = INSTRUCTION_COUNT;
+    double start_time = wall_time();
+
     printf("Simulation Started...\n\n");
     while (RUN_FLAG) {
-        cycle();
+        run_checkpointed(UINT32_MAX);
     }
     printf("Simulation Finished.\n\n");
+    print_run_stats(INSTRUCTION_COUNT - start_count, wall_time() - start_time);
+    if (SIM_ENGINE == ENGINE_PIPE || SAMPLE.enabled) {
+        print_pipeline_stats();
+        if (CACHES.enabled) {
+            print_cache_stats();
+        }
+    }
+    if (BPRED.enabled) {
+        print_bpred_stats();
+    }
+    if (SAMPLE.enabled) {
+        print_sample_stats();
+    }
 }
 
 /***************************************************************/
@@ -167,6 +474,8 @@ void handle_command() {
     uint32_t register_no;
     int register_value;
     int hi_reg_value, lo_reg_value;
+    int level;
+    char path[256];
 
     printf("MU-MIPS SIM:> ");
 
@@ -177,7 +486,15 @@ void handle_command() {
     switch (buffer[0]) {
         case 'S':
         case 's':
-            runAll();
+            if (strcmp(buffer, "snapshot") == 0) {
+                snapshot();
+            } else if (strcmp(buffer, "sample") == 0) {
+                if (scanf("%255s", path) == 1 && set_sample(path) == 0) {
+                    printf("Sampling: %s\n", SAMPLE.enabled ? "on" : "off");
+                }
+            } else {
+                runAll();
+            }
             break;
         case 'M':
         case 'm':
@@ -199,6 +516,16 @@ void handle_command() {
         case 'r':
             if (buffer[1] == 'd' || buffer[1] == 'D') {
                 rdump();
+            } else if (strcmp(buffer, "resume") == 0) {
+                if (scanf("%255s", path) != 1) {
+                    break;
+                }
+                resume(path);
+            } else if (strcmp(buffer, "restore") == 0) {
+                if (scanf("%d", &level) != 1) {
+                    break;
+                }
+                restore(level);
             } else if (buffer[1] == 'e' || buffer[1] == 'E') {
                 reset();
             } else {
@@ -214,7 +541,6 @@ void handle_command() {
                 break;
             }
             CURRENT_STATE.REGS[register_no] = register_value;
-            NEXT_STATE.REGS[register_no] = register_value;
             break;
         case 'H':
         case 'h':
@@ -222,7 +548,6 @@ void handle_command() {
                 break;
             }
             CURRENT_STATE.HI = hi_reg_value;
-            NEXT_STATE.HI = hi_reg_value;
             break;
         case 'L':
         case 'l':
@@ -230,483 +555,451 @@ void handle_command() {
                 break;
             }
             CURRENT_STATE.LO = lo_reg_value;
-            NEXT_STATE.LO = lo_reg_value;
             break;
         case 'P':
         case 'p':
             print_program();
             break;
+        case 'C':
+        case 'c':
+            if (scanf("%255s", path) != 1) {
+                break;
+            }
+            if (strcmp(buffer, "cache") == 0) {
+                if (strcmp(path, "stats") == 0) {
+                    print_cache_stats();
+                } else if (set_cache(path) == 0) {
+                    printf("Caches: %s\n", CACHES.enabled ? "on" : "off");
+                }
+                break;
+            }
+            if (strcmp(path, "off") == 0) {
+                CHECKPOINT_INTERVAL = 0;
+                printf("Checkpoints: off\n");
+                break;
+            }
+            if (scanf("%u", &cycles) != 1) {
+                break;
+            }
+            checkpoint(path, cycles);
+            break;
+        case 'E':
+        case 'e':
+            if (scanf("%19s", buffer) != 1) {
+                break;
+            }
+            if (strcmp(buffer, "interp") == 0) {
+                SIM_ENGINE = ENGINE_INTERP;
+            } else if (strcmp(buffer, "block") == 0) {
+                SIM_ENGINE = ENGINE_BLOCK;
+            } else if (strcmp(buffer, "jit") == 0 || strcmp(buffer, "jit-verify") == 0) {
+                if (!jit_available()) {
+                    printf("The JIT is not available on this host\n");
+                    break;
+                }
+                SIM_ENGINE = ENGINE_JIT;
+                JIT_VERIFY = strcmp(buffer, "jit-verify") == 0;
+            } else if (strcmp(buffer, "pipeline") == 0) {
+                SIM_ENGINE = ENGINE_PIPE;
+            } else {
+                printf("Unknown engine %s\n", buffer);
+                break;
+            }
+            printf("Engine: %s\n", ENGINE_NAMES[SIM_ENGINE]);
+            break;
+        case 'B':
+        case 'b':
+            if (scanf("%255s", path) != 1) {
+                break;
+            }
+            if (strcmp(buffer, "bbv") == 0) {
+                if (strcmp(path, "off") == 0) {
+                    bbv_close();
+                    printf("Basic-block vectors: off\n");
+                } else if (scanf("%u", &cycles) == 1 && bbv_open(path, cycles)) {
+                    printf("Basic-block vectors: %s, every %u instructions\n", path, cycles);
+                }
+                break;
+            }
+            if (strcmp(buffer, "bpred") == 0) {
+                if (strcmp(path, "stats") == 0) {
+                    print_bpred_stats();
+                } else if (set_bpred(path) == 0) {
+                    printf("Branch predictor: %s\n", BPRED.enabled ? BPRED_SCHEME_NAMES[BPRED.config.scheme] : "off");
+                }
+                break;
+            }
+            if (strcmp(path, "off") == 0) {
+                btrace_close();
+                printf("Binary trace: off\n");
+                break;
+            }
+            if (MU_TRACE_MAX == TRACE_OFF) {
+                printf("Tracing is not compiled into this build (TRACE=off)\n");
+                break;
+            }
+            if (btrace_open(path)) {
+                printf("Binary trace: %s\n", path);
+            }
+            break;
+        case 'T':
+        case 't':
+            if (scanf("%19s", buffer) != 1) {
+                break;
+            }
+            for (level = TRACE_OFF; level <= TRACE_FULL; level++) {
+                if (strcmp(buffer, TRACE_NAMES[level]) == 0) {
+                    break;
+                }
+            }
+            if (level > TRACE_FULL) {
+                printf("Unknown trace level %s\n", buffer);
+                break;
+            }
+            if (level > MU_TRACE_MAX) {
+                printf("Trace level %s is not compiled into this build (TRACE=%s)\n", buffer, TRACE_NAMES[MU_TRACE_MAX]);
+                break;
+            }
+            TRACE_LEVEL = level;
+            printf("Trace: %s\n", TRACE_NAMES[TRACE_LEVEL]);
+            break;
         default:
             printf("Invalid Command.\n");
             break;
     }
 }
 
-/***************************************************************/
-/* reset registers/memory and reload program                                                    */
-/***************************************************************/
-void reset() {
-    int i;
-    /*reset registers*/
-    for (i = 0; i < MIPS_REGS; i++) {
-        CURRENT_STATE.REGS[i] = 0;
+/**************************************************************/
+/* Save the machine state as the next snapshot                                                         */
+/**************************************************************/
+void snapshot() {
+    if (SNAPSHOT_COUNT == MAX_SNAPSHOTS) {
+        printf("All %d snapshots are taken\n", MAX_SNAPSHOTS);
+        return;
     }
-    CURRENT_STATE.HI = 0;
-    CURRENT_STATE.LO = 0;
+    SNAPSHOTS[SNAPSHOT_COUNT] = mips_sim_snapshot(SIM);
+    printf("Snapshot %d: PC 0x%08x after %u instructions, %u pages\n", SNAPSHOT_COUNT,
+           CURRENT_STATE.PC, INSTRUCTION_COUNT, SNAPSHOTS[SNAPSHOT_COUNT]->mem.count);
+    SNAPSHOT_COUNT++;
+}
 
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-        memset(MEM_REGIONS[i].mem, 0, region_size);
+/**************************************************************/
+/* Return to a snapshot                                                                                               */
+/**************************************************************/
+void restore(int n) {
+    if (n < 0 || n >= SNAPSHOT_COUNT) {
+        printf("No snapshot %d\n", n);
+        return;
     }
+    mips_sim_restore(SIM, SNAPSHOTS[n]);
+    printf("Restored snapshot %d: PC 0x%08x after %u instructions\n", n, CURRENT_STATE.PC, INSTRUCTION_COUNT);
+}
 
-    /*load program*/
-    load_program();
+/**************************************************************/
+/* Save the machine to path now and every interval instructions from now on            */
+/**************************************************************/
+void checkpoint(const char *path, uint32_t interval) {
+    strcpy(CHECKPOINT_FILE, path);
+    CHECKPOINT_INTERVAL = interval;
+    NEXT_CHECKPOINT = INSTRUCTION_COUNT + interval;
+    if (mips_sim_checkpoint(SIM, path) != 0) {
+        printf("Error: Can't write checkpoint %s: %s\n", path, strerror(errno));
+        CHECKPOINT_INTERVAL = 0;
+        return;
+    }
+    printf("Checkpoint %s: PC 0x%08x after %u instructions", path, CURRENT_STATE.PC, INSTRUCTION_COUNT);
+    if (interval > 0) {
+        printf(", again every %u instructions", interval);
+    }
+    printf("\n");
+}
 
-    /*reset PC*/
-    INSTRUCTION_COUNT = 0;
-    CURRENT_STATE.PC = MEM_TEXT_BEGIN;
-    NEXT_STATE = CURRENT_STATE;
-    RUN_FLAG = TRUE;
+/**************************************************************/
+/* Continue from a checkpoint file                                                                              */
+/**************************************************************/
+void resume(const char *path) {
+    if (mips_sim_resume(SIM, path) != 0) {
+        printf("Error: %s is not a checkpoint this simulator can read\n", path);
+        return;
+    }
+    NEXT_CHECKPOINT = INSTRUCTION_COUNT + CHECKPOINT_INTERVAL;
+    printf("Resumed %s (%s): PC 0x%08x after %u instructions\n", path, prog_file, CURRENT_STATE.PC, INSTRUCTION_COUNT);
+}
+
+/**************************************************************/
+/* Report what the loader wrote, and how long it took when seconds >= 0               */
+/**************************************************************/
+static void report_load(double seconds) {
+    if (HEADLESS) {
+        return;
+    }
+    printf("Program loaded into memory.\n%d words written into memory", PROGRAM_SIZE);
+    if (PROGRAM_SIZE > 0) {
+        printf(" at 0x%08x-0x%08x", MEM_TEXT_BEGIN, MEM_TEXT_BEGIN + 4 * PROGRAM_SIZE - 1);
+    }
+    if (seconds >= 0) {
+        printf(" in %.3f ms", seconds * 1e3);
+        if (seconds > 0) {
+            printf(" (%.1f million words/s)", PROGRAM_SIZE / seconds / 1e6);
+        }
+    }
+    printf(".\n\n");
 }
 
 /***************************************************************/
-/* Allocate and set memory to zero                                                                            */
+/* reset registers/memory and reload program                                                    */
 /***************************************************************/
-void init_memory() {
-    int i;
-    for (i = 0; i < NUM_MEM_REGION; i++) {
-        uint32_t region_size = MEM_REGIONS[i].end - MEM_REGIONS[i].begin + 1;
-        MEM_REGIONS[i].mem = malloc(region_size);
-        memset(MEM_REGIONS[i].mem, 0, region_size);
-    }
+void reset() {
+    mips_sim_reset(SIM);
+    report_load(-1);
 }
 
 /**************************************************************/
 /* load program into memory                                                                                      */
 /**************************************************************/
 void load_program() {
-    FILE *fp;
-    int i, word;
-    uint32_t address;
+    double start = wall_time();
 
-    /* Open program file. */
-    fp = fopen(prog_file, "r");
-    if (fp == NULL) {
-        printf("Error: Can't open program file %s\n", prog_file);
+    if (mips_sim_load(SIM, prog_file) < 0) {
+        if (SIM->load_error[0] != '\0') {
+            printf("Error: %s, %s\n", prog_file, SIM->load_error);
+            exit(-1);
+        }
+        printf("Error: Can't load program file %s\n", prog_file);
         exit(-1);
     }
-
-    /* Read in the program. */
-
-    i = 0;
-    while (fscanf(fp, "%x\n", &word) != EOF) {
-        address = MEM_TEXT_BEGIN + i;
-        mem_write_32(address, word);
-        printf("writing 0x%08x into address 0x%08x (%d)\n", word, address, address);
-        i += 4;
-    }
-    PROGRAM_SIZE = i / 4;
-    printf("Program loaded into memory.\n%d words written into memory.\n\n", PROGRAM_SIZE);
-    fclose(fp);
+    report_load(wall_time() - start);
 }
 
 /************************************************************/
-/* decode and execute instruction                                                                     */
+/* Create the simulator the front end runs                                                             */
 /************************************************************/
-void handle_instruction() {
-    /*IMPLEMENT THIS*/
-    /* execute one instruction at a time. Use/update CURRENT_STATE and and NEXT_STATE, as necessary.*/
-
-    uint32_t ins = mem_read_32(CURRENT_STATE.PC);
-    printf("\nInstruction: %08x ", ins);
-    uint32_t opcode = (0xFC000000 & ins);
-    uint32_t jump = 0x4;
-
-    printf("\nOpcode: %0x8\n", opcode);
-    switch (opcode) {
-        //R statement
-        case 0x00000000: {
-            //rs mask
-            uint32_t rs = (0x03E00000 & ins) >> 21;
-            //rt mask
-            uint32_t rt = (0x001F0000 & ins) >> 16;
-            //rd mask
-            uint32_t rd = (0x0000F800 & ins) >> 11;
-            //sa mask
-            uint32_t sa = (0x000007C0 & ins) >> 6;
-            //func mask
-            uint32_t func = (0x0000003F & ins);
-
-            printf("\nR type instruction\n"
-                   "rs : %x\n"
-                   "rt : %x\n"
-                   "rd : %x\n"
-                   "sa : %x\n"
-                   "func : %x\n", rs, rt, rd, sa, func);
-            switch (func) {
-                //Add
-                case 0x00000020: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-                    break;
-
-                }
-                    //ADDU add unsigned
-                case 0x00000021: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] + CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //Sub
-                case 0x00000022: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //Subu
-                case 0x00000023: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] - CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //MUlT
-                case 0x00000018: {
-
-                    if (prevInstruction == 0x0000012 || prevInstruction == 0x0000011) {
-                        puts("Result is undefined");
-                        break;
-                    }
-                    uint64_t tempResult = CURRENT_STATE.REGS[rs] * CURRENT_STATE.REGS[rt];
-
-                    NEXT_STATE.LO = tempResult & 0xFFFFFFFF; //get low 32-bits
-                    NEXT_STATE.HI = tempResult >> 32; //get high 32-bits
-                    break;
-                }
-                    //Multu
-                case 0x00000019: {
-
-
-                    //if either of the 2 preceding instructions were MFLO or MFHI, result is undefined
-                    if (prevInstruction == 0x0000012 || prevInstruction == 0x0000011) {
-                        puts("Result is undefined");
-                        break;
-                    }
-
-                    uint64_t tempResult = CURRENT_STATE.REGS[rs] * CURRENT_STATE.REGS[rt];
+void initialize() {
+    mips_sim_new();
+}
 
-                    NEXT_STATE.LO = tempResult & 0xFFFFFFFF; //get low 32-bits
-                    NEXT_STATE.HI = tempResult >> 32; //get high 32-bits
-                    break;
-                }
-                    //DIV
-                case 0x0000001A: {
+/************************************************************/
+/* Headless batch mode                                                                                          */
+/*                                                                                                                               */
+/*   mu-mips --run <input program> [--max <n>] [--engine <name>] [--mem <start>:<end>]...  */
+/*                 [--cache <setting>]... [--bpred <setting>]... [--sample <setting>]       */
+/*                 [--bbv <file> [--bbv-interval <n>]] [--checkpoint <file> [--every <n>]]  */
+/*                 [--jit-cache <bytes>]                                                                      */
+/*                                                                                                                               */
+/* Loads the program, runs it until SYSCALL or <n> instructions and prints the final   */
+/* state as "key value" lines, one per line, in this order:                                    */
+/*   status halted|limit                                                                                     */
+/*   instructions <count>                                                                                 */
+/*   cycles <count>                  with --engine pipeline, then its stall counts:        */
+/*   load_use_stalls <cycles>                                                                           */
+/*   flushes <count>                                                                                          */
+/*   fetch_stalls <cycles>         and with --cache on, these and for each cache level:  */
+/*   memory_stalls <cycles>                                                                              */
+/*   <level>_accesses <count>  <level>_misses <count>  <level>_writebacks <count>     */
+/*   branches <count>               with --bpred on (or a scheme), on any engine              */
+/*   branch_mispredicts <count>                                                                      */
+/*   samples <count>                 with --sample, the units measured and the CPI they     */
+/*   sampled_cpi <cpi>               estimate, +/- sampled_cpi_error at 95% confidence    */
+/*   sampled_cpi_error <cpi>                                                                            */
+/*   jit_blocks <count>              with --engine jit or jit-verify, the blocks compiled     */
+/*   jit_flushes <count>             and how often the full code cache was emptied           */
+/*   pc 0x........                                                                                                */
+/*   r0 0x........  ...  r31 0x........                                                                  */
+/*   hi 0x........                                                                                                 */
+/*   lo 0x........                                                                                                 */
+/*   mem 0x<address> 0x<word>        one line per word of every --mem range           */
+/* Nothing else is printed apart from the program's own output ("Terminate", ...)   */
+/* and jit-verify's mismatch reports, which come before the state. Exits 0 when the  */
+/* program halted and 2 when the instruction limit stopped it.                              */
+/* With --checkpoint the machine is saved to <file> every <n> instructions (default     */
+/* DEFAULT_CHECKPOINT_INTERVAL), and a run that finds <file> already there resumes   */
+/* from it instead of loading the program, so a preempted job is simply started again. */
+/* --max counts the instructions run before the checkpoint too.                                */
+/* --bbv records a basic-block vector for every <n> instructions from the start (or   */
+/* the checkpoint), DEFAULT_BBV_INTERVAL unless --bbv-interval says otherwise.           */
+/************************************************************/
+#define MAX_DUMP_RANGES 16
+#define DEFAULT_CHECKPOINT_INTERVAL 100000000
+#define DEFAULT_BBV_INTERVAL 10000000
 
-                    //if either of the 2 preceding instructions were MFLO or MFHI, result is undefined
-                    if (prevInstruction == 0x0000012 || prevInstruction == 0x0000011 || CURRENT_STATE.REGS[rt] == 0) {
-                        puts("Result is undefined");
-                        break;
-                    }
+/* a count: digits only (decimal, 0x hex or 0 octal), no sign, and within 32 bits */
+static int parse_count(const char *text, uint32_t *count) {
+    unsigned long value;
+    char *end;
 
-                    NEXT_STATE.LO = CURRENT_STATE.REGS[rs] / CURRENT_STATE.REGS[rt]; //get quotient
-                    NEXT_STATE.HI = CURRENT_STATE.REGS[rs] % CURRENT_STATE.REGS[rt];  //get remainder
-                    break;
-                }
-                    //DIVU
-                case 0x0000001B: {
+    if (text[0] < '0' || text[0] > '9') {
+        return -1;
+    }
+    errno = 0;
+    value = strtoul(text, &end, 0);
+    if (*end != '\0' || errno == ERANGE || value > UINT32_MAX) {
+        return -1;
+    }
+    *count = value;
+    return 0;
+}
 
+static void headless_usage(const char *program) {
+    printf("Usage: %s --run <input program> [--max <n>] [--engine <interp|block|jit|jit-verify|pipeline>] [--mem <start>:<end>]...\n"
+           "       [--cache <setting>]... [--bpred <setting>]... [--sample <setting>]\n"
+           "       [--bbv <file> [--bbv-interval <n>]] [--checkpoint <file> [--every <n>]] [--jit-cache <bytes>]\n", program);
+    exit(1);
+}
 
-                    //if either of the 2 preceding instructions were MFLO or MFHI, result is undefined
-                    if (prevInstruction == 0x0000012 || prevInstruction == 0x0000011 || CURRENT_STATE.REGS[rt] == 0) {
-                        puts("Result is undefined");
-                        break;
-                    }
+int run_headless(int argc, char *argv[]) {
+    uint32_t dump_start[MAX_DUMP_RANGES], dump_stop[MAX_DUMP_RANGES];
+    int dumps = 0;
+    uint32_t max_instructions = UINT32_MAX;
+    uint32_t interval = DEFAULT_CHECKPOINT_INTERVAL, bbv_interval = DEFAULT_BBV_INTERVAL;
+    uint32_t address, jit_cache_size;
+    const char *program = NULL, *checkpoint_file = NULL, *bbv_file = NULL;
+    int a, i;
 
-                    NEXT_STATE.LO = CURRENT_STATE.REGS[rs] / CURRENT_STATE.REGS[rt]; //get quotient
-                    NEXT_STATE.HI = CURRENT_STATE.REGS[rs] % CURRENT_STATE.REGS[rt];  //get remainder
-                    break;
-                }
-                    //AND
-                case 0x00000024: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] & CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //or
-                case 0x00000025: {
+    HEADLESS = 1;
+    initialize();
 
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] || CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //xor
-                case 0x00000026: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.REGS[rs] ^ CURRENT_STATE.REGS[rt];
-                    break;
-                }
-                    //NOR
-                case 0x00000027: {
-                    NEXT_STATE.REGS[rd] = ~(CURRENT_STATE.REGS[rs] | CURRENT_STATE.REGS[rt]);
-                    break;
-                }
-                    //SLT
-                case 0x0000002A: {
-                    if (CURRENT_STATE.REGS[rs] < CURRENT_STATE.REGS[rt]) {
-                        NEXT_STATE.REGS[rd] = 0x00000001;
-                    } else {
-                        NEXT_STATE.REGS[rd] = 0x00000000;
-                    }
-                    break;
-                }
-                    //SLL
-                case 0x00000000: {
-                    uint32_t temp = CURRENT_STATE.REGS[rt] << sa;
-                    NEXT_STATE.REGS[rd] = temp;
-                    break;
-                }
-                    //SRL
-                case 0x00000002: {
-                    uint32_t temp = CURRENT_STATE.REGS[rt] >> sa;
-                    NEXT_STATE.REGS[rd] = temp;
-                    break;
-                }
-                    //SRA
-                case 0x00000003: {
-                    uint32_t temp;
-                    int x;
-                    uint32_t hiBit = CURRENT_STATE.REGS[rt] & 0x80000000;
-                    if (hiBit == 1) {
-                        temp = CURRENT_STATE.REGS[rt];
-                        for (x = 0; x < sa; x++) {
-                            temp = ((temp >> 1) | 0x80000000);
-                        }
-                    } else {
-                        temp = CURRENT_STATE.REGS[rt] >> sa;
-                    }
-                    NEXT_STATE.REGS[rd] = temp;
-                    break;
-                }
-                    //JR
-                case 0x00000008: {
-                    uint32_t temp = CURRENT_STATE.REGS[rs];
-                    jump = temp - CURRENT_STATE.PC;
-                    break;
-                }
-                    //JALR
-                case 0x00000009: {
-                    uint32_t temp = CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.PC + 0x8;
-                    jump = temp - CURRENT_STATE.PC;
-                    break;
-                }
-                    //MTLO
-                case 0x00000013: {
-                    NEXT_STATE.LO = CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                    //MTHI
-                case 0x00000011: {
-                    NEXT_STATE.HI = CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                    //MFLO
-                case 0x00000012: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.LO;
-                    break;
-                }
-                    //MFHI
-                case 0x00000010: {
-                    NEXT_STATE.REGS[rd] = CURRENT_STATE.HI;
-                    break;
-                }
-                    //SYSCALL
-                case 0x0000000C: {
-                    //SYSCALL - System Call, exit the program.
-                    NEXT_STATE.REGS[0] = 0xA;
-                    puts("Terminate");
-                    RUN_FLAG = FALSE;
-                    break;
-                }
+    for (a = 2; a < argc; a++) {
+        if (strcmp(argv[a], "--max") == 0 && a + 1 < argc) {
+            if (parse_count(argv[++a], &max_instructions) != 0) {
+                headless_usage(argv[0]);
             }
-            break;
+        } else if (strcmp(argv[a], "--engine") == 0 && a + 1 < argc) {
+            a++;
+            if (strcmp(argv[a], "interp") == 0) {
+                SIM_ENGINE = ENGINE_INTERP;
+            } else if (strcmp(argv[a], "block") == 0) {
+                SIM_ENGINE = ENGINE_BLOCK;
+            } else if ((strcmp(argv[a], "jit") == 0 || strcmp(argv[a], "jit-verify") == 0) && jit_available()) {
+                SIM_ENGINE = ENGINE_JIT;
+                JIT_VERIFY = strcmp(argv[a], "jit-verify") == 0;
+            } else if (strcmp(argv[a], "pipeline") == 0) {
+                SIM_ENGINE = ENGINE_PIPE;
+            } else {
+                printf("Error: Engine %s is not available\n", argv[a]);
+                exit(1);
+            }
+        } else if (strcmp(argv[a], "--mem") == 0 && a + 1 < argc) {
+            if (dumps == MAX_DUMP_RANGES ||
+                sscanf(argv[++a], "%x:%x", &dump_start[dumps], &dump_stop[dumps]) != 2) {
+                headless_usage(argv[0]);
+            }
+            dumps++;
+        } else if (strcmp(argv[a], "--cache") == 0 && a + 1 < argc) {
+            /* the settings of the cache command */
+            if (set_cache(argv[++a]) != 0) {
+                exit(1);
+            }
+        } else if (strcmp(argv[a], "--bpred") == 0 && a + 1 < argc) {
+            /* the settings of the bpred command */
+            if (set_bpred(argv[++a]) != 0) {
+                exit(1);
+            }
+        } else if (strcmp(argv[a], "--sample") == 0 && a + 1 < argc) {
+            /* the settings of the sample command */
+            if (set_sample(argv[++a]) != 0) {
+                exit(1);
+            }
+        } else if (strcmp(argv[a], "--jit-cache") == 0 && a + 1 < argc) {
+            /* only the first <bytes> of the code cache, to see it fill up */
+            if (parse_count(argv[++a], &jit_cache_size) != 0) {
+                headless_usage(argv[0]);
+            }
+            if (jit_set_cache_size(jit_cache_size) != 0) {
+                exit(1);
+            }
+        } else if (strcmp(argv[a], "--checkpoint") == 0 && a + 1 < argc) {
+            checkpoint_file = argv[++a];
+        } else if (strcmp(argv[a], "--bbv") == 0 && a + 1 < argc) {
+            bbv_file = argv[++a];
+        } else if (strcmp(argv[a], "--bbv-interval") == 0 && a + 1 < argc) {
+            if (parse_count(argv[++a], &bbv_interval) != 0 || bbv_interval == 0) {
+                headless_usage(argv[0]);
+            }
+        } else if (strcmp(argv[a], "--every") == 0 && a + 1 < argc) {
+            if (parse_count(argv[++a], &interval) != 0 || interval == 0) {
+                headless_usage(argv[0]);
+            }
+        } else if (program == NULL && argv[a][0] != '-') {
+            program = argv[a];
+        } else {
+            headless_usage(argv[0]);
         }
+    }
+    if (program == NULL || strlen(program) >= sizeof(prog_file) ||
+        (checkpoint_file != NULL && strlen(checkpoint_file) >= sizeof(CHECKPOINT_FILE))) {
+        headless_usage(argv[0]);
+    }
 
-            //I-type statement
-        default : {
-            //rs mask
-            uint32_t rs = (0x03E00000 & ins) >> 21;
-            //rt mask
-            uint32_t rt = (0x001F0000 & ins) >> 16;
-            //im mask
-            uint32_t im = (0x00000FFFF & ins);
-
-            printf("\nI-type instruction\n"
-                   "rs : %x\n"
-                   "rt : %x\n"
-                   "im : %x\n", rs, rt, im);
-
-            switch (opcode) {
-                case 0x20000000: {
-                    //ADDI
-                    puts("ADDI");
-                    NEXT_STATE.REGS[rt] = extend_sign(im) + CURRENT_STATE.REGS[rs];
-                    break;
-
-                }
-                case 0x24000000: {
-                    //ADDIU
-                    puts("ADDIU");
-                    NEXT_STATE.REGS[rt] = extend_sign(im) + CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0x30000000: {
-                    //ANDI
-                    puts("ANDI");
-                    NEXT_STATE.REGS[rt] = (im & 0x0000FFFF) & CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0x34000000: {
-                    //ORI
-                    puts("ORI");
-                    NEXT_STATE.REGS[rt] = (im & 0x0000FFFF) | CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0x38000000: {
-                    //XORI
-                    puts("XORI");
-                    NEXT_STATE.REGS[rt] = (im & 0x0000FFFF) ^ CURRENT_STATE.REGS[rs];
-                    break;
-                }
-                case 0x28000000: {
-                    //Set On Less Than Immediate
-                    puts("SLTI");
-                    if (CURRENT_STATE.REGS[rs] < extend_sign(im)) {
-                        NEXT_STATE.REGS[rt] = 1;
-                    } else {
-                        NEXT_STATE.REGS[rt] = 0;
-                    }
-                }
-                case 0x8C000000: {
-                    //load word
-                    puts("LW");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.REGS[rt] = mem_read_32(eAddr);
-                    break;
-                }
-                case 0x80000000: {
-                    //Load Byte
-                    puts("LB");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.REGS[rt] = 0x0000000F | mem_read_32(eAddr);
-                    break;
+    if (checkpoint_file == NULL || mips_sim_resume(SIM, checkpoint_file) != 0) {
+        if (checkpoint_file != NULL && access(checkpoint_file, F_OK) == 0) {
+            printf("Error: %s is not a checkpoint this simulator can read\n", checkpoint_file);
+            exit(1);
+        }
+        strcpy(prog_file, program);
+        load_program();
+    }
+    if (checkpoint_file != NULL) {
+        strcpy(CHECKPOINT_FILE, checkpoint_file);
+        CHECKPOINT_INTERVAL = interval;
+        NEXT_CHECKPOINT = INSTRUCTION_COUNT + interval;
+    }
+    if (bbv_file != NULL && !bbv_open(bbv_file, bbv_interval)) {
+        exit(1);
+    }
 
-                }
-                case 0x84000000: {
-                    //Load Halfword
-                    puts("LH");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    NEXT_STATE.REGS[rt] = 0x000000FF | mem_read_32(eAddr);
-                    break;
-                }
-                case 0x3C000000: {
-                    //Load Upper Immediate
-                    puts("LUI");
-                    NEXT_STATE.REGS[rt] = (im << 16);
-                    break;
-                }
-                case 0xAC000000: {
-                    //Store word
-                    puts("SW");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    mem_write_32(eAddr, CURRENT_STATE.REGS[rt]);
-                    break;
-                }
-                case 0xA000000: {
-                    //Store byte
-                    puts("SB");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    mem_write_32(eAddr, CURRENT_STATE.REGS[rt]);
-                    break;
-                }
-                case 0xA4000000: {
-                    //Store Halfwood
-                    puts("SH");
-                    uint32_t offset = extend_sign(im);
-                    uint32_t eAddr = offset + CURRENT_STATE.REGS[rs];
-                    mem_write_32(eAddr, CURRENT_STATE.REGS[rt]);
-                    break;
-                }
-                case 0x10000000: {
-                    //BEQ
-                    uint32_t tar = extend_sign(im) << 2;
-                    if (CURRENT_STATE.REGS[rs] == CURRENT_STATE.REGS[rt]) {
-                        jump = tar;
-                    }
-                    break;
-                }
-                case 0x14000000: {
-                    //Branch on Not Equal
-                    puts("BNE");
-                    uint32_t tar = extend_sign(im) << 2;
-                    if (CURRENT_STATE.REGS[rs] != CURRENT_STATE.REGS[rt]) {
-                        jump = tar;
-                    }
-                    break;
-                }
-                case 0x18000000: {
-                    //Branch on Less Than or Equal to Zero
-                    puts("BLEZ");
-                    uint32_t tar = extend_sign(im) << 2;
-                    if ((CURRENT_STATE.REGS[rs] & 0x80000000) || (CURRENT_STATE.REGS[rt] == 0)) {
-                        jump = tar;
-                    }
-                    break;
-                }
-                case 0x1C000000: {
-                    //Branch on Greater Than Zero
-                    puts("BGTZ");
-                    uint32_t tar = extend_sign(im) << 2;
-                    if (!(CURRENT_STATE.REGS[rs] & 0x80000000) || (CURRENT_STATE.REGS[rt] != 0)) {
-                        jump = tar;
-                    }
-                    break;
-                }
-                case 0x04000000: {
-                    //REGIMM
-                    switch (rt) {
-                        case 0x00000000: {
-                            //Branch On Less Than Zer0
-                            puts("BLTZ");
-                            uint32_t tar = (extend_sign(im) << 2);
-                            if ((CURRENT_STATE.REGS[rs] & 0x80000000)) {
-                                jump = tar;
-                            }
-                            break;
-                        }
-                        case 0x00000001: {
-                            //BGEZ - Branch on Greater Than or Equal to Zero
-                            uint32_t tar = (extend_sign(im) << 2);
-                            if (!(CURRENT_STATE.REGS[rs] & 0x80000000)) {
-                                jump = tar;
-                            }
-                            break;
-                        }
-                    }
-                }
+    while (RUN_FLAG && INSTRUCTION_COUNT < max_instructions) {
+        run_checkpointed(max_instructions - INSTRUCTION_COUNT);
+    }
+    bbv_close();
+
+    printf("status %s\n", RUN_FLAG ? "limit" : "halted");
+    printf("instructions %u\n", INSTRUCTION_COUNT);
+    if (SIM_ENGINE == ENGINE_PIPE) {
+        printf("cycles %llu\n", (unsigned long long) PIPE_STATS.cycles);
+        printf("load_use_stalls %llu\n", (unsigned long long) PIPE_STATS.load_use_stalls);
+        printf("flushes %llu\n", (unsigned long long) PIPE_STATS.flushes);
+        if (CACHES.enabled) {
+            printf("fetch_stalls %llu\n", (unsigned long long) PIPE_STATS.fetch_stalls);
+            printf("memory_stalls %llu\n", (unsigned long long) PIPE_STATS.memory_stalls);
+            for (i = 0; i < CACHE_LEVELS; i++) {
+                const cache_stats_t *cs = &CACHES.level[i].stats;
+
+                if (CACHES.level[i].config.size == 0) {
+                    continue;
+                }
+                printf("%s_accesses %llu\n", CACHE_NAMES[i], (unsigned long long) (cs->reads + cs->writes));
+                printf("%s_misses %llu\n", CACHE_NAMES[i], (unsigned long long) (cs->read_misses + cs->write_misses));
+                printf("%s_writebacks %llu\n", CACHE_NAMES[i], (unsigned long long) cs->writebacks);
             }
-            break;
         }
     }
-    NEXT_STATE.PC = CURRENT_STATE.PC + jump;
-}
-
+    if (BPRED.enabled) {
+        printf("branches %llu\n", (unsigned long long) BPRED.stats.branches);
+        printf("branch_mispredicts %llu\n", (unsigned long long) BPRED.stats.mispredicts);
+    }
+    if (SAMPLE.enabled) {
+        double cpi, half_width;
 
-/************************************************************/
-/* Initialize Memory                                                                                                    */
-/************************************************************/
-void initialize() {
-    init_memory();
-    CURRENT_STATE.PC = MEM_TEXT_BEGIN;
-    NEXT_STATE = CURRENT_STATE;
-    RUN_FLAG = TRUE;
+        printf("samples %llu\n", (unsigned long long) sample_estimate(&cpi, &half_width));
+        printf("sampled_cpi %.4f\n", cpi);
+        printf("sampled_cpi_error %.4f\n", half_width);
+    }
+    if (SIM_ENGINE == ENGINE_JIT) {
+        printf("jit_blocks %u\n", SIM->jit.compiled);
+        printf("jit_flushes %u\n", SIM->jit.flushes);
+    }
+    printf("pc 0x%08x\n", CURRENT_STATE.PC);
+    for (i = 0; i < MIPS_REGS; i++) {
+        printf("r%d 0x%08x\n", i, CURRENT_STATE.REGS[i]);
+    }
+    printf("hi 0x%08x\n", CURRENT_STATE.HI);
+    printf("lo 0x%08x\n", CURRENT_STATE.LO);
+    for (i = 0; i < dumps; i++) {
+        for (address = dump_start[i]; address <= dump_stop[i] && address >= dump_start[i]; address += 4) {
+            printf("mem 0x%08x 0x%08x\n", address, mem_read_32(address));
+        }
+    }
+    return RUN_FLAG ? 2 : 0;
 }
 
 /************************************************************/
@@ -715,9 +1008,15 @@ void initialize() {
 void print_program() {
     int i;
     uint32_t addr;
+    const char *label;
 
     for (i = 0; i < PROGRAM_SIZE; i++) {
         addr = MEM_TEXT_BEGIN + (i * 4);
+        /* images can name addresses */
+        label = image_symbol(&SIM->program, addr);
+        if (label != NULL) {
+            printf("%s:\n", label);
+        }
         printf("[0x%x]\t", addr);
         print_instruction(addr);
     }
@@ -728,458 +1027,38 @@ void print_program() {
 /************************************************************/
 void print_instruction(uint32_t addr) {
     uint32_t ins = mem_read_32(addr);
-    uint32_t opcode = (0xFC000000 & ins);
-    switch (opcode) {
-        //R-Type statement
-        case 0x00000000: {
-            //rs MASK: 0000 0011 1110 0000 4x0000 = 03E00000
-            uint32_t rs = (0x03E00000 & ins) >> 21;
-            //rt MASK: 0000 0000 0001 1111 4x0000 = 001F0000;
-            uint32_t rt = (0x001F0000 & ins) >> 16;
-            //rd MASK: 4x0000 1111 1000 0000 0000 = 0000F800;
-            uint32_t rd = (0x0000F800 & ins) >> 11;
-            //sa MASK: 4X0000 0000 0111 1100 0000 = 000007C0;
-            uint32_t sa = (0x000007C0 & ins) >> 6;
-            //func MASK: 6x0000 0001 1111 = 0000001F
-            uint32_t func = (0x0000003F & ins);
-
-            switch (func) {
-                case 0x00000020:
-                    //ADD
-                    printf("\n\nADD Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000021:
-                    //ADDU
-                    printf("\n\nADDU Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000022:
-                    //SUB
-                    printf("\n\nSUB Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000023:
-                    //SUBU
-                    puts("Subtract Unsigned Function");
-                    printf("\n\nSUBU Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000018: {
-                    //MULT
-                    printf("\n\nMULT Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                }
-
-                case 0x00000019: {
-                    //MULTU
-                    printf("\n\nMULTU Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                }
-
-                case 0x0000001A:
-                    //DIV
-                    printf("\n\nDIV Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x0000001B:
-                    //DIVU
-                    printf("\n\nDIVU Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0X00000024:
-                    //AND
-                    printf("\n\nAND Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0X00000025:
-                    //OR
-                    printf("\n\nOR Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0X00000026:
-                    //XOR
-                    printf("\n\nXOR Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000027:
-                    //NOR
-                    printf("\n\nNOR Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x0000002A:
-                    //SLT
-                    printf("\n\nSLTs Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000000: {
-                    //SLL
-                    printf("\n\nSLL Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                }
-
-                case 0x00000002: {
-                    //SRL
-                    printf("\n\nSRL Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                }
-
-                case 0x00000003: {
-                    //SRA
-                    printf("\n\nSRA Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                }
-                case 0x0000000C:
-                    //SYSCALL - System Call, exit the program.
-                    printf("\n\nSYSCALL(exit) Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000008:
-                    //JR
-                    printf("\n\nJR Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-                case 0x00000009:
-                    //JALR
-                    printf("\n\nJALR Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x00000013:
-                    //MTLO
-                    printf("\n\nMTLO Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x0000011:
-                    //MTHI
-                    printf("\n\nMTHI Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x0000012:
-                    //MFLO
-                    printf("\n\nMFLO Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-
-                case 0x0000010:
-                    //MFHI
-                    printf("\n\nMFHI Instruction:"
-                           "\n-> OC: %x"
-                           "\n-> rs: %x"
-                           "\n-> rt: %x"
-                           "\n-> rd: %x"
-                           "\n-> shamt: %x"
-                           "\n-> func: %x\n",
-                           opcode, rs, rt, rd, sa, func);
-                    break;
-            }
-            prevInstruction = func;
-            break;
 
-        }
-        case 0x08000000: {
-            //JL
-            uint32_t target = (0x03FFFFFF & ins);
-            printf("\n\nJL Instruction:"
-                   "\n-> OC: %x"
-                   "\n-> target: %x\n",
-                   opcode, target);
-            break;
-        }
-
-        case 0x0C000000: {
-            //JAL-Jump and Link Instruction
-            uint32_t target = (0x03FFFFFF & ins);
-            printf("\n\nJAL Instruction:"
-                   "\n-> OC: %x"
-                   "\n-> target: %x\n",
-                   opcode, target);
-            break;
-        }
-
-
-            //I-type statement
-        default : {
-            //rs mask
-            uint32_t rs = (0x03E00000 & ins) >> 21;
-            //rt mask
-            uint32_t rt = (0x001F0000 & ins) >> 16;
-            //im mask
-            uint32_t im = (0x00000FFFF & ins);
-            switch (opcode) {
-                case 0x20000000: {
-                    //ADDI
-                    printf("\nADDI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x24000000: {
-                    //ADDIU
-                    printf("\nADDIU Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x30000000: {
-                    //ANDI
-                    printf("\nANDI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x34000000: {
-                    //ORI
-                    printf("\nORI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x38000000: {
-                    //XORI
-                    printf("\nXORI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x28000000: {
-                    //SLTI
-                    printf("\nSLTI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x8C000000: {
-                    //LW
-                    printf("\nLW Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x80000000: {
-                    //LB
-                    printf("\nLB Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x84000000: {
-                    //LH
-                    printf("\nLH Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x3C000000: {
-                    //LUI
-                    printf("\nLUI Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0xAC000000: {
-                    //SW
-                    printf("\nSW Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0xA000000: {
-                    //SB
-                    printf("\nSB Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0xA4000000: {
-                    //SH
-                    printf("\nSH Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x10000000: {
-                    //BEQ
-                    printf("\nBEQ Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x14000000: {
-                    //BNE
-                    printf("\nBNE Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x18000000: {
-                    //BLEZ
-                    printf("\nBLEZ Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x1C000000: {
-                    //BGTZ
-                    printf("\nBGTZ Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                    break;
-                }
-                case 0x04000000: {
-                    //REGIMM
-                    switch (rt) {
-                        case 0x00000000: {
-                            //BLTZ
-                            printf("\nBLTZ Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                            break;
-                        }
-                        case 0x00000001: {
-                            //BGEZ
-                            printf("\nBGEZ Instruction:\nOpcode: %x \nrs: %x\nrt: %x\nImmediate: %x\n", opcode, rs, rt, im);
-                            break;
-                        }
-                            break;
-                    }
-                }
-            }
-        }
+    fprint_instruction(stdout, ins);
+    if ((0xFC000000 & ins) == 0x00000000) {
+        prevInstruction = 0x0000003F & ins;
     }
-
 }
 
 /***************************************************************/
 /* main                                                                                                                                   */
 /***************************************************************/
 int main(int argc, char *argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "--run") == 0) {
+        return run_headless(argc, argv);
+    }
+
     printf("\n**************************\n");
     printf("Welcome to MU-MIPS SIM...\n");
     printf("**************************\n\n");
 
     if (argc < 2) {
         printf("Error: You should provide input file.\nUsage: %s <input program> \n\n", argv[0]);
+        printf("       %s --run <input program> [options]   (run without the command prompt)\n\n", argv[0]);
+        exit(1);
+    }
+    if (strlen(argv[1]) >= sizeof(prog_file)) {
+        printf("Error: Program file name too long\n");
         exit(1);
     }
 
-    strcpy(prog_file, argv[1]);
+    TRACE_LEVEL = MU_TRACE_MAX;
     initialize();
+    strcpy(prog_file, argv[1]);
     load_program();
     help();
     while (1) {
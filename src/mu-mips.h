@@ -1,81 +1,32 @@
 #include <stdint.h>
 
-#define FALSE 0
-#define TRUE  1
-
-/******************************************************************************/
-/* MIPS memory layout                                                                                                                                      */
-/******************************************************************************/
-#define MEM_TEXT_BEGIN  0x00400000
-#define MEM_TEXT_END      0x0FFFFFFF
-/*Memory address 0x10000000 to 0x1000FFFF access by $gp*/
-#define MEM_DATA_BEGIN  0x10010000
-#define MEM_DATA_END   0x7FFFFFFF
-
-#define MEM_KTEXT_BEGIN 0x80000000
-#define MEM_KTEXT_END  0x8FFFFFFF
-
-#define MEM_KDATA_BEGIN 0x90000000
-#define MEM_KDATA_END  0xFFFEFFFF
-
-/*stack and data segments occupy the same memory space. Stack grows backward (from higher address to lower address) */
-#define MEM_STACK_BEGIN 0x7FFFFFFF
-#define MEM_STACK_END  0x10010000
-
-typedef struct {
-	uint32_t begin, end;
-	uint8_t *mem;
-} mem_region_t;
-
-/* memory will be dynamically allocated at initialization */
-mem_region_t MEM_REGIONS[] = {
-	{ MEM_TEXT_BEGIN, MEM_TEXT_END, NULL },
-	{ MEM_DATA_BEGIN, MEM_DATA_END, NULL },
-	{ MEM_KDATA_BEGIN, MEM_KDATA_END, NULL },
-	{ MEM_KTEXT_BEGIN, MEM_KTEXT_END, NULL }
-};
-
-#define NUM_MEM_REGION 4
-#define MIPS_REGS 32
-
-typedef struct CPU_State_Struct {
-
-  uint32_t PC;		                   /* program counter */
-  uint32_t REGS[MIPS_REGS]; /* register file. */
-  uint32_t HI, LO;                          /* special regs for mult/div. */
-} CPU_State;
-
-
+#include "mu-sim.h"
 
 /***************************************************************/
-/* CPU State info.                                                                                                               */
+/* Command line front end                                                                                                 */
 /***************************************************************/
+/* runs one simulator, created by initialize() and current from then on */
 
-CPU_State CURRENT_STATE, NEXT_STATE;
-int RUN_FLAG;	/* run flag*/
-uint32_t INSTRUCTION_COUNT;
-uint32_t PROGRAM_SIZE; /*in words*/
-
-char prog_file[32];
+/* set by --run: no banner, loader or command chatter */
+extern int HEADLESS;
 
 
 /***************************************************************/
 /* Function Declerations.                                                                                                */
 /***************************************************************/
 void help();
-uint32_t mem_read_32(uint32_t address);
-void mem_write_32(uint32_t address, uint32_t value);
-void cycle();
 void run(int num_cycles);
 void runAll();
 void mdump(uint32_t start, uint32_t stop) ;
 void rdump();
 void handle_command();
 void reset();
-void init_memory();
+void snapshot();
+void restore(int n);
+void checkpoint(const char *path, uint32_t interval);
+void resume(const char *path);
 void load_program();
-void handle_instruction(); /*IMPLEMENT THIS*/
 void initialize();
 void print_program(); /*IMPLEMENT THIS*/
 void print_instruction(uint32_t);
-
+int run_headless(int argc, char *argv[]);
@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mu-sim.h"
+#include "mu-pipe.h"
+#include "mu-cache.h"
+#include "mu-bpred.h"
+
+/************************************************************/
+/* Pipeline engine                                                                                                      */
+/*                                                                                                                               */
+/* Each call of clock_pipeline() is one cycle: every instruction moves one stage on   */
+/* unless the hazard unit holds IF and ID, the instruction entering EX runs, and a      */
+/* redirect from it squashes what IF and ID hold.                                                  */
+/************************************************************/
+
+/* the current simulator's pipeline */
+#define PIPE (SIM->pipe)
+#define STAGE (SIM->pipe.stage)
+
+/************************************************************/
+/* Fill a pipeline register with the instruction at pc                                              */
+/************************************************************/
+static void fetch_latch(pipe_latch_t *l, uint32_t pc) {
+    const decoded_insn_t *d = predecode_fetch(pc);
+    uint8_t rs = d->rs, rt = d->rt, rd = d->rd;
+
+    l->pc = pc;
+    l->valid = 1;
+    l->load = 0;
+    l->store = 0;
+    l->mem_cycles = 1;
+    l->dest = PIPE_NO_REG;
+    l->src[0] = l->src[1] = PIPE_NO_REG;
+    switch (d->op) {
+        case OP_ADD: case OP_ADDU: case OP_SUB: case OP_SUBU:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_NOR: case OP_SLT:
+            l->src[0] = rs;
+            l->src[1] = rt;
+            l->dest = rd;
+            break;
+        case OP_MULT: case OP_MULTU: case OP_DIV: case OP_DIVU:
+            l->src[0] = rs;
+            l->src[1] = rt;
+            l->dest = PIPE_REG_HILO;
+            break;
+        case OP_SLL: case OP_SRL: case OP_SRA:
+            l->src[0] = rt;
+            l->dest = rd;
+            break;
+        case OP_JR:
+            l->src[0] = rs;
+            break;
+        case OP_JALR:
+            l->src[0] = rs;
+            l->dest = rd;
+            break;
+        case OP_MTLO: case OP_MTHI:
+            l->src[0] = rs;
+            l->dest = PIPE_REG_HILO;
+            break;
+        case OP_MFLO: case OP_MFHI:
+            l->src[0] = PIPE_REG_HILO;
+            l->dest = rd;
+            break;
+        case OP_ADDI: case OP_ADDIU: case OP_ANDI: case OP_ORI: case OP_XORI:
+            l->src[0] = rs;
+            l->dest = rt;
+            break;
+        case OP_SLTI:   /* runs LW's handler */
+        case OP_LW: case OP_LB: case OP_LH:
+            l->src[0] = rs;
+            l->dest = rt;
+            l->load = 1;
+            break;
+        case OP_LUI:
+            l->dest = rt;
+            break;
+        case OP_SW: case OP_SB: case OP_SH:
+            l->src[0] = rs;
+            l->src[1] = rt;
+            l->store = 1;
+            break;
+        case OP_BEQ: case OP_BNE:
+        case OP_BLEZ: case OP_BGTZ:     /* these look at rt as well */
+            l->src[0] = rs;
+            l->src[1] = rt;
+            break;
+        case OP_BLTZ: case OP_BGEZ:
+            l->src[0] = rs;
+            break;
+    }
+    if (l->dest == 0) {
+        l->dest = PIPE_NO_REG;
+    }
+}
+
+/* whether l reads register r */
+static int reads(const pipe_latch_t *l, uint8_t r) {
+    return r != PIPE_NO_REG && (l->src[0] == r || l->src[1] == r);
+}
+
+/************************************************************/
+/* Address of the next instruction to execute, as far as the pipeline knows          */
+/************************************************************/
+static uint32_t next_pc_in_flight() {
+    if (STAGE[PIPE_ID].valid) {
+        return STAGE[PIPE_ID].pc;
+    }
+    if (STAGE[PIPE_IF].valid) {
+        return STAGE[PIPE_IF].pc;
+    }
+    return PIPE.fetch_pc;
+}
+
+/************************************************************/
+/* Drop what IF and ID hold and fetch from pc next                                               */
+/************************************************************/
+static void squash_front(uint32_t pc) {
+    PIPE.stats.flushed += STAGE[PIPE_IF].valid + STAGE[PIPE_ID].valid;
+    STAGE[PIPE_IF].valid = 0;
+    STAGE[PIPE_ID].valid = 0;
+    PIPE.fetch_pc = pc;
+    PIPE.fetch_wait = 0;
+}
+
+/************************************************************/
+/* Run the instruction that just entered EX                                                            */
+/************************************************************/
+static void execute_stage() {
+    pipe_latch_t *ex = &STAGE[PIPE_EX];
+    const decoded_insn_t *d;
+    uint32_t address;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (ex->src[i] == PIPE_NO_REG) {
+            continue;
+        }
+        if (STAGE[PIPE_MEM].valid && STAGE[PIPE_MEM].dest == ex->src[i]) {
+            PIPE.stats.forward_ex_mem++;
+        } else if (STAGE[PIPE_WB].valid && STAGE[PIPE_WB].dest == ex->src[i]) {
+            PIPE.stats.forward_mem_wb++;
+        }
+    }
+    if ((ex->load || ex->store) && CACHES.enabled) {
+        /* the address, before the instruction can change its base register */
+        d = predecode_fetch(CURRENT_STATE.PC);
+        address = CURRENT_STATE.REGS[d->rs] + d->imm;
+        ex->mem_cycles = ex->load ? cache_load(address) : cache_store(address);
+    }
+    cycle();
+    PIPE.stats.instructions++;
+    if (BPRED.enabled) {
+        bpred_resolve(ex->pc, &ex->prediction, CURRENT_STATE.PC);
+    }
+    if (RUN_FLAG == FALSE) {
+        /* SYSCALL: nothing behind it runs */
+        STAGE[PIPE_IF].valid = 0;
+        STAGE[PIPE_ID].valid = 0;
+        PIPE.fetch_pc = CURRENT_STATE.PC;
+        PIPE.fetch_wait = 0;
+    } else if (CURRENT_STATE.PC != next_pc_in_flight()) {
+        PIPE.stats.flushes++;
+        squash_front(CURRENT_STATE.PC);
+    }
+}
+
+/************************************************************/
+/* One clock cycle                                                                                                      */
+/* Returns whether an instruction executed.                                                             */
+/************************************************************/
+static int clock_pipeline() {
+    const pipe_latch_t *id = &STAGE[PIPE_ID];
+    const pipe_latch_t *ex = &STAGE[PIPE_EX];
+    int stall = id->valid && ex->valid && ex->load && reads(id, ex->dest);
+    int fetching = PIPE.fetch_wait > 0;
+
+    PIPE.stats.cycles++;
+    /* a fetch goes on while the stages behind it are held */
+    if (fetching) {
+        PIPE.fetch_wait--;
+    }
+    if (PIPE.mem_wait > 0) {
+        PIPE.mem_wait--;
+        STAGE[PIPE_WB].valid = 0;
+        PIPE.stats.memory_stalls++;
+        return 0;
+    }
+    STAGE[PIPE_WB] = STAGE[PIPE_MEM];
+    STAGE[PIPE_MEM] = STAGE[PIPE_EX];
+    PIPE.mem_wait = STAGE[PIPE_MEM].valid ? STAGE[PIPE_MEM].mem_cycles - 1 : 0;
+    if (stall) {
+        /* load-use: a bubble goes into EX while IF and ID hold */
+        STAGE[PIPE_EX].valid = 0;
+        PIPE.stats.load_use_stalls++;
+        return 0;
+    }
+    STAGE[PIPE_EX] = STAGE[PIPE_ID];
+    if (fetching) {
+        STAGE[PIPE_ID].valid = 0;
+        PIPE.stats.fetch_stalls++;
+    } else {
+        STAGE[PIPE_ID] = STAGE[PIPE_IF];
+        fetch_latch(&STAGE[PIPE_IF], PIPE.fetch_pc);
+        if (CACHES.enabled) {
+            PIPE.fetch_wait = cache_fetch(PIPE.fetch_pc) - 1;
+        }
+        PIPE.fetch_pc = BPRED.enabled ? bpred_predict(PIPE.fetch_pc, &STAGE[PIPE_IF].prediction) : PIPE.fetch_pc + 4;
+        STAGE[PIPE_IF].predicted = PIPE.fetch_pc;
+    }
+    if (!STAGE[PIPE_EX].valid) {
+        return 0;
+    }
+    execute_stage();
+    return 1;
+}
+
+/************************************************************/
+/* Let the instructions past EX finish                                                                      */
+/************************************************************/
+static void drain_pipeline() {
+    while (STAGE[PIPE_EX].valid || STAGE[PIPE_MEM].valid) {
+        PIPE.stats.cycles++;
+        if (PIPE.mem_wait > 0) {
+            PIPE.mem_wait--;
+            PIPE.stats.memory_stalls++;
+            continue;
+        }
+        STAGE[PIPE_WB] = STAGE[PIPE_MEM];
+        STAGE[PIPE_MEM] = STAGE[PIPE_EX];
+        PIPE.mem_wait = STAGE[PIPE_MEM].valid ? STAGE[PIPE_MEM].mem_cycles - 1 : 0;
+        STAGE[PIPE_EX].valid = 0;
+    }
+    STAGE[PIPE_WB].valid = 0;
+}
+
+/************************************************************/
+/* Empty the pipeline and zero its statistics                                                          */
+/************************************************************/
+void pipe_reset() {
+    memset(&PIPE, 0, sizeof(PIPE));
+    PIPE.fetch_pc = CURRENT_STATE.PC;
+}
+
+/************************************************************/
+/* Execute up to max_instructions cycle by cycle, stopping early at SYSCALL         */
+/* Returns the number of instructions executed.                                                      */
+/************************************************************/
+uint32_t run_pipeline(uint32_t max_instructions) {
+    uint32_t executed = 0;
+
+    if (max_instructions == 0 || RUN_FLAG == FALSE) {
+        return 0;
+    }
+    /* instructions fetched for a PC the machine has since left (a restore, an engine switch,
+     * a reset) are dropped without counting as a flush */
+    if (next_pc_in_flight() != CURRENT_STATE.PC) {
+        STAGE[PIPE_IF].valid = 0;
+        STAGE[PIPE_ID].valid = 0;
+        PIPE.fetch_pc = CURRENT_STATE.PC;
+        PIPE.fetch_wait = 0;
+    }
+    while (executed < max_instructions && RUN_FLAG) {
+        executed += clock_pipeline();
+    }
+    if (RUN_FLAG == FALSE) {
+        drain_pipeline();
+    }
+    return executed;
+}
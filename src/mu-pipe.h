@@ -0,0 +1,74 @@
+#ifndef MU_PIPE_H
+#define MU_PIPE_H
+
+#include <stdint.h>
+
+#include "mu-decode.h"
+#include "mu-bpred.h"
+
+/******************************************************************************/
+/* Five-stage pipeline model                                                                                                                               */
+/******************************************************************************/
+/* the pipeline engine clocks instructions through IF, ID, EX, MEM and WB, one stage per cycle:
+ *   forwarding  EX takes its operands from the EX/MEM and MEM/WB registers, so only a load
+ *               followed right away by a user of its result stalls (one cycle, in ID)
+ *   control     fetch goes on at PC + 4, or where the branch predictor (mu-bpred.h) says when
+ *               it is on; branches and jumps resolve in EX, and one that goes elsewhere
+ *               flushes the two instructions fetched behind it
+ * An instruction does its work (cycle(), so traces and the binary trace see it) as it enters
+ * EX. That is program order, so the machine state is exactly what the other engines produce;
+ * the pipeline registers only keep time. HI and LO count as one register.
+ * With the cache hierarchy on (mu-cache.h), a fetch holds IF and a load or store holds MEM,
+ * and everything behind it, for as many cycles as the access takes. */
+#define PIPE_IF  0
+#define PIPE_ID  1
+#define PIPE_EX  2
+#define PIPE_MEM 3
+#define PIPE_WB  4
+#define PIPE_STAGES 5
+
+/* register numbers of the hazard logic: the GPRs, then HI/LO */
+#define PIPE_REG_HILO 32
+#define PIPE_NO_REG 0xFF
+
+/* pipeline register: the instruction in a stage */
+typedef struct {
+	uint32_t pc;
+	uint8_t valid;              /* 0 for a bubble */
+	uint8_t load;               /* its result comes out of MEM */
+	uint8_t store;
+	uint8_t dest;               /* register written, PIPE_NO_REG for none ($0 included) */
+	uint8_t src[2];             /* registers read, PIPE_NO_REG for none */
+	uint32_t mem_cycles;        /* cycles it spends in MEM */
+	uint32_t predicted;         /* PC fetched after it */
+	bpred_prediction_t prediction; /* how the predictor (when on) came to predicted */
+} pipe_latch_t;
+
+typedef struct {
+	uint64_t cycles;
+	uint64_t instructions;      /* executed by the pipeline engine */
+	uint64_t load_use_stalls;   /* cycles a load's user waited in ID */
+	uint64_t fetch_stalls;      /* cycles ID got a bubble because IF was waiting on the cache */
+	uint64_t memory_stalls;     /* cycles MEM held the pipeline waiting on the cache */
+	uint64_t flushes;           /* instructions that went somewhere fetch did not */
+	uint64_t flushed;           /* instructions fetched on the wrong path and dropped */
+	uint64_t forward_ex_mem;    /* operands taken from EX/MEM */
+	uint64_t forward_mem_wb;    /* operands taken from MEM/WB */
+} pipe_stats_t;
+
+typedef struct {
+	pipe_latch_t stage[PIPE_STAGES];  /* indexed by PIPE_* */
+	uint32_t fetch_pc;
+	uint32_t fetch_wait;        /* cycles before IF's instruction can move on */
+	uint32_t mem_wait;          /* cycles before MEM's instruction can move on */
+	pipe_stats_t stats;
+} pipe_t;
+
+/* the current simulator's pipeline statistics */
+#define PIPE_STATS (SIM->pipe.stats)
+
+uint32_t run_pipeline(uint32_t max_instructions);
+/* empty the pipeline and zero its statistics */
+void pipe_reset();
+
+#endif
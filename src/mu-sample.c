@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "mu-sim.h"
+#include "mu-sample.h"
+
+/************************************************************/
+/* Sampled simulation                                                                                                  */
+/*                                                                                                                               */
+/* SAMPLE.phase and SAMPLE.left say where in the period the machine is, so a run      */
+/* can stop and go on anywhere.                                                                                */
+/************************************************************/
+
+/************************************************************/
+/* Sampling the sample on command turns on                                                            */
+/************************************************************/
+void sample_defaults(sample_t *s) {
+    static const sample_config_t defaults = { 1000000, 1000, 2000, 100000 };
+
+    memset(s, 0, sizeof(*s));
+    sample_configure(s, &defaults);
+}
+
+int sample_configure(sample_t *s, const sample_config_t *config) {
+    if (config->interval == 0 ||
+        (uint64_t) config->interval + config->detail_warmup + config->warmup > config->period) {
+        return -1;
+    }
+    s->config = *config;
+    s->phase = SAMPLE_FAST;
+    s->left = config->period - config->interval - config->detail_warmup - config->warmup;
+    return 0;
+}
+
+/************************************************************/
+/* Start again with a fast phase and zero the statistics                                         */
+/************************************************************/
+void sample_reset() {
+    sample_configure(&SAMPLE, &SAMPLE.config);
+    memset(&SAMPLE.stats, 0, sizeof(SAMPLE.stats));
+}
+
+/* the instructions in a phase */
+static uint32_t phase_length(int phase) {
+    const sample_config_t *c = &SAMPLE.config;
+
+    switch (phase) {
+        case SAMPLE_FAST:
+            return c->period - c->interval - c->detail_warmup - c->warmup;
+        case SAMPLE_WARM:
+            return c->warmup;
+        case SAMPLE_DETAIL:
+            return c->detail_warmup;
+        default:
+            return c->interval;
+    }
+}
+
+/************************************************************/
+/* Functional warming: run instructions one at a time, showing the caches and the  */
+/* predictor what each does                                                                                     */
+/************************************************************/
+static uint32_t run_warming(uint32_t max_instructions) {
+    const decoded_insn_t *d;
+    uint32_t executed = 0, pc;
+    bpred_prediction_t prediction;
+
+    while (executed < max_instructions && RUN_FLAG) {
+        pc = CURRENT_STATE.PC;
+        d = predecode_fetch(pc);
+        if (CACHES.enabled) {
+            cache_fetch(pc);
+            switch (d->op) {
+                case OP_SLTI:   /* runs LW's handler */
+                case OP_LW: case OP_LB: case OP_LH:
+                    cache_load(CURRENT_STATE.REGS[d->rs] + d->imm);
+                    break;
+                case OP_SW: case OP_SB: case OP_SH:
+                    cache_store(CURRENT_STATE.REGS[d->rs] + d->imm);
+                    break;
+            }
+        }
+        if (BPRED.enabled) {
+            bpred_predict(pc, &prediction);
+        }
+        cycle();
+        if (BPRED.enabled) {
+            bpred_resolve(pc, &prediction, CURRENT_STATE.PC);
+        }
+        executed++;
+    }
+    return executed;
+}
+
+/************************************************************/
+/* Run up to max_instructions through the phases, stopping early at SYSCALL       */
+/* Returns the number of instructions executed.                                                      */
+/************************************************************/
+uint32_t run_sampled(uint32_t max_instructions) {
+    uint32_t executed = 0, chunk, ran;
+    int predicting;
+    double cpi;
+
+    while (executed < max_instructions && RUN_FLAG) {
+        while (SAMPLE.left == 0) {
+            SAMPLE.phase = (SAMPLE.phase + 1) % SAMPLE_PHASES;
+            SAMPLE.left = phase_length(SAMPLE.phase);
+            SAMPLE.unit_cycles = PIPE_STATS.cycles;
+        }
+        chunk = SAMPLE.left < max_instructions - executed ? SAMPLE.left : max_instructions - executed;
+        switch (SAMPLE.phase) {
+            case SAMPLE_FAST:
+                /* with the predictor off, the functional engines keep their full speed */
+                predicting = BPRED.enabled;
+                BPRED.enabled = 0;
+                ran = run_engine(SIM_ENGINE == ENGINE_PIPE ? ENGINE_BLOCK : SIM_ENGINE, chunk);
+                BPRED.enabled = predicting;
+                break;
+            case SAMPLE_WARM:
+                ran = run_warming(chunk);
+                break;
+            default:
+                ran = run_pipeline(chunk);
+                break;
+        }
+        SAMPLE.stats.instructions[SAMPLE.phase] += ran;
+        SAMPLE.left -= ran;
+        executed += ran;
+        if (SAMPLE.phase == SAMPLE_MEASURE && SAMPLE.left == 0) {
+            cpi = (double) (PIPE_STATS.cycles - SAMPLE.unit_cycles) / SAMPLE.config.interval;
+            SAMPLE.stats.samples++;
+            SAMPLE.stats.cpi_sum += cpi;
+            SAMPLE.stats.cpi_squares += cpi * cpi;
+        }
+    }
+    return executed;
+}
+
+/************************************************************/
+/* The CPI the samples estimate, with its confidence interval                               */
+/************************************************************/
+uint64_t sample_estimate(double *cpi, double *half_width) {
+    const sample_stats_t *s = &SAMPLE.stats;
+    double mean, variance;
+
+    *cpi = 0;
+    *half_width = 0;
+    if (s->samples == 0) {
+        return 0;
+    }
+    mean = s->cpi_sum / s->samples;
+    *cpi = mean;
+    if (s->samples > 1) {
+        variance = (s->cpi_squares - s->samples * mean * mean) / (s->samples - 1);
+        *half_width = variance > 0 ? SAMPLE_Z * sqrt(variance / s->samples) : 0;
+    }
+    return s->samples;
+}
@@ -0,0 +1,70 @@
+#ifndef MU_SAMPLE_H
+#define MU_SAMPLE_H
+
+#include <stdint.h>
+
+/******************************************************************************/
+/* Sampled simulation                                                                                                                                    */
+/******************************************************************************/
+/* SMARTS-style sampling: instead of timing a whole run on the pipeline engine, every period
+ * instructions go through four phases:
+ *   fast        the functional engine (the selected one, or the block engine instead of the
+ *               pipeline) runs with no timing at all
+ *   warm        instructions step through cycle() while the caches and the branch predictor
+ *               see their fetches, loads, stores and branches, so they are not cold
+ *   detail      the pipeline engine runs, filling the pipeline, but is not measured
+ *   measure     the pipeline engine runs one unit of interval instructions, and the unit's CPI
+ *               is one sample
+ * The samples' mean estimates the CPI of the whole run, and their spread gives the confidence
+ * interval. The phases carry on across mips_sim_run() calls, and a unit cut short by SYSCALL
+ * is not counted. */
+#define SAMPLE_FAST    0
+#define SAMPLE_WARM    1
+#define SAMPLE_DETAIL  2
+#define SAMPLE_MEASURE 3
+#define SAMPLE_PHASES  4
+
+/* a two-sided 95% confidence interval */
+#define SAMPLE_Z 1.96
+
+typedef struct {
+	uint32_t period;            /* instructions from one unit to the next */
+	uint32_t interval;          /* instructions in a measured unit */
+	uint32_t detail_warmup;     /* unmeasured pipeline instructions before each unit */
+	uint32_t warmup;            /* functional warming instructions before that */
+} sample_config_t;
+
+typedef struct {
+	uint64_t samples;
+	double cpi_sum;
+	double cpi_squares;         /* sum of the squares */
+	uint64_t instructions[SAMPLE_PHASES];   /* run in each phase */
+} sample_stats_t;
+
+typedef struct {
+	int enabled;
+	sample_config_t config;
+	int phase;
+	uint32_t left;              /* instructions before the next phase */
+	uint64_t unit_cycles;       /* pipeline cycles when the unit began */
+	sample_stats_t stats;
+} sample_t;
+
+/* the current simulator's sampling */
+#define SAMPLE (SIM->sample)
+
+/* a 1000-instruction unit every million, after 2000 pipeline and 100000 warming instructions */
+void sample_defaults(sample_t *s);
+/* returns 0, -1 (and changes nothing) if the interval is 0 or the phases don't fit the period */
+int sample_configure(sample_t *s, const sample_config_t *config);
+/* start again with a fast phase and zero the statistics */
+void sample_reset();
+
+/* run up to max_instructions through the phases, stopping early at SYSCALL;
+ * returns the number of instructions executed */
+uint32_t run_sampled(uint32_t max_instructions);
+/* the estimated CPI and the half-width of its confidence interval (0 with fewer than two
+ * samples); returns the number of samples */
+uint64_t sample_estimate(double *cpi, double *half_width);
+
+#endif
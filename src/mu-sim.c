@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mu-sim.h"
+#include "mu-load.h"
+#include "mu-asm.h"
+#include "mu-btrace.h"
+#include "mu-bbv.h"
+
+/************************************************************/
+/* Simulator core                                                                                                       */
+/*                                                                                                                               */
+/* Creates and runs simulator contexts. Nothing here prints except the trace and  */
+/* the program's own output; the command line front end lives in mu-mips.c.         */
+/************************************************************/
+
+_Thread_local mips_sim_t *SIM;
+
+/* library users trace nothing unless they ask; the interactive front end starts at MU_TRACE_MAX */
+int TRACE_LEVEL = TRACE_OFF;
+
+/************************************************************/
+/* Create a simulator                                                                                                */
+/************************************************************/
+mips_sim_t *mips_sim_new() {
+    mips_sim_t *sim = calloc(1, sizeof(mips_sim_t));
+
+    if (sim == NULL) {
+        printf("Error: Out of memory allocating a simulator\n");
+        exit(-1);
+    }
+    mips_sim_select(sim);
+    init_memory();
+    init_predecode();
+    sim->program.entry = MEM_TEXT_BEGIN;
+    CURRENT_STATE.PC = MEM_TEXT_BEGIN;
+    RUN_FLAG = TRUE;
+    SIM_ENGINE = ENGINE_BLOCK;
+    cache_defaults(&sim->caches);
+    bpred_defaults(&sim->bpred);
+    sample_defaults(&sim->sample);
+    jit_defaults(&sim->jit);
+    return sim;
+}
+
+/************************************************************/
+/* Release a simulator with everything it allocated                                                */
+/************************************************************/
+void mips_sim_free(mips_sim_t *sim) {
+    mips_sim_select(sim);
+    flush_blocks();
+    jit_unmap();
+    flush_predecode();
+    reset_memory();
+    free_image_info(&sim->program);
+    cache_free(&sim->caches);
+    bpred_free(&sim->bpred);
+    SIM = NULL;
+    MEM = NULL;
+    PREDECODE = NULL;
+    free(sim);
+}
+
+/************************************************************/
+/* Make sim the simulator the calling thread works on                                           */
+/************************************************************/
+void mips_sim_select(mips_sim_t *sim) {
+    SIM = sim;
+    MEM = &sim->mem;
+    PREDECODE = &sim->decode;
+}
+
+/***************************************************************/
+/* Zero the registers and restart at the entry point                                                      */
+/***************************************************************/
+static void restart_cpu() {
+    int i;
+
+    /*reset registers*/
+    for (i = 0; i < MIPS_REGS; i++) {
+        CURRENT_STATE.REGS[i] = 0;
+    }
+    CURRENT_STATE.HI = 0;
+    CURRENT_STATE.LO = 0;
+
+    /*reset PC*/
+    INSTRUCTION_COUNT = 0;
+    CURRENT_STATE.PC = SIM->program.entry;
+    RUN_FLAG = TRUE;
+    pipe_reset();
+    caches_reset();
+    bpred_reset();
+    sample_reset();
+}
+
+/**************************************************************/
+/* load program into memory                                                                                      */
+/**************************************************************/
+int mips_sim_load(mips_sim_t *sim, const char *path) {
+    image_info_t image;
+    struct stat st;
+    char magic[sizeof(IMAGE_MAGIC) - 1];
+    char *text = NULL;
+    int fd, words, hex = 0, replaced = 0;
+    uint32_t i, end;
+
+    mips_sim_select(sim);
+    sim->load_error[0] = '\0';
+    if (strlen(path) >= sizeof(prog_file)) {
+        return -1;
+    }
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    if (pread(fd, magic, sizeof(magic), 0) == sizeof(magic) && memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0) {
+        /* an image maps straight in */
+        words = load_image(fd, st.st_size, &image);
+        close(fd);
+    } else {
+        if (st.st_size > 0) {
+            text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (text == MAP_FAILED) {
+                close(fd);
+                return -1;
+            }
+        }
+        close(fd);
+        if (st.st_size >= SELFMAG && memcmp(text, ELFMAG, SELFMAG) == 0) {
+            /* an executable is copied out of the mapping, segment by segment */
+            words = load_elf((const uint8_t *) text, st.st_size, &image);
+        } else {
+            hex = replaced = 1;
+            memset(&image, 0, sizeof(image));
+            image.entry = MEM_TEXT_BEGIN;
+            reset_memory();
+            flush_predecode();
+            words = load_hex(text, st.st_size, MEM_TEXT_BEGIN);
+            if (words < 0) {
+                /* anything but hex words is taken for source; memory is left empty if it
+                 * doesn't assemble either */
+                hex = 0;
+                words = assemble(text, st.st_size, &image, sim->load_error, sizeof(sim->load_error));
+                if (words < 0) {
+                    image.entry = MEM_TEXT_BEGIN;
+                }
+            }
+        }
+        if (text != NULL) {
+            munmap(text, st.st_size);
+        }
+    }
+    if (words < 0 && !replaced) {
+        return -1;
+    }
+    free_image_info(&sim->program);
+    sim->program = image;
+    if (!hex && words >= 0) {
+        /* the text segments' words, counted from MEM_TEXT_BEGIN as print_program() lists them */
+        for (i = 0; i < image.segment_count; i++) {
+            end = image.segments[i].address + image.segments[i].size;
+            if ((image.segments[i].flags & SEGMENT_TEXT) && image.segments[i].address >= MEM_TEXT_BEGIN &&
+                image.segments[i].address <= MEM_TEXT_END && end > MEM_TEXT_BEGIN + 4 * words) {
+                words = (end - MEM_TEXT_BEGIN + 3) / 4;
+            }
+        }
+    }
+    if (prog_file != path) {
+        strcpy(prog_file, path);
+    }
+    PROGRAM_SIZE = words < 0 ? 0 : words;
+
+    /* what mips_sim_reset() goes back to */
+    mem_save_pristine();
+    restart_cpu();
+    prevInstruction = 0;
+    return words < 0 ? -1 : (int) PROGRAM_SIZE;
+}
+
+/***************************************************************/
+/* reset registers/memory to the state right after loading                                        */
+/***************************************************************/
+void mips_sim_reset(mips_sim_t *sim) {
+    char path[sizeof(prog_file)];
+
+    mips_sim_select(sim);
+    if (sim->mem.dirty_map == NULL && prog_file[0] != '\0') {
+        /* memory came from a checkpoint, not from loading the program */
+        strcpy(path, prog_file);
+        if (mips_sim_load(sim, path) >= 0) {
+            return;
+        }
+    }
+    /* only the pages written since the load are copied back; decoded instructions and
+     * translated blocks survive unless their text was among them */
+    mem_restore_pristine();
+    restart_cpu();
+}
+
+/***************************************************************/
+/* Run up to max_instructions on the selected engine, stopping at SYSCALL               */
+/* Returns the number of instructions executed.                                                      */
+/***************************************************************/
+uint32_t mips_sim_run(mips_sim_t *sim, uint32_t max_instructions) {
+    mips_sim_select(sim);
+    if (SAMPLE.enabled) {
+        return run_sampled(max_instructions);
+    }
+    return run_engine(SIM_ENGINE, max_instructions);
+}
+
+/***************************************************************/
+/* Run on one engine, whether or not sampling is on                                                */
+/***************************************************************/
+uint32_t run_engine(int engine, uint32_t max_instructions) {
+    uint32_t executed = 0;
+
+    if (engine == ENGINE_PIPE) {
+        return run_pipeline(max_instructions);
+    }
+    /* only cycle() (which the pipeline engine runs on) records the binary trace, and the
+     * branch predictor only scores instructions run here */
+    if (!BTRACE_ACTIVE && !BPRED.enabled) {
+        if (engine == ENGINE_BLOCK || engine == ENGINE_JIT) {
+            return run_blocks(max_instructions);
+        }
+#ifdef MU_THREADED_CORE
+        /* the threaded core keeps no basic-block profile */
+        if (!BBV_ACTIVE) {
+            return run_threaded(max_instructions);
+        }
+#endif
+    }
+    while (executed < max_instructions && RUN_FLAG) {
+        if (BPRED.enabled) {
+            uint32_t pc = CURRENT_STATE.PC;
+            bpred_prediction_t prediction;
+
+            bpred_predict(pc, &prediction);
+            cycle();
+            bpred_resolve(pc, &prediction, CURRENT_STATE.PC);
+        } else {
+            cycle();
+        }
+        executed++;
+    }
+    return executed;
+}
+
+/***************************************************************/
+/* Capture the machine state, sharing memory pages copy-on-write                             */
+/***************************************************************/
+mips_snapshot_t *mips_sim_snapshot(mips_sim_t *sim) {
+    mips_snapshot_t *snap = malloc(sizeof(mips_snapshot_t));
+
+    if (snap == NULL) {
+        printf("Error: Out of memory taking a snapshot\n");
+        exit(-1);
+    }
+    mips_sim_select(sim);
+    snap->state = CURRENT_STATE;
+    snap->run_flag = RUN_FLAG;
+    snap->instruction_count = INSTRUCTION_COUNT;
+    snap->program_size = PROGRAM_SIZE;
+    snap->prev_instruction = prevInstruction;
+    mem_snapshot(&snap->mem);
+    return snap;
+}
+
+/***************************************************************/
+/* Return to a snapshot                                                                                                 */
+/***************************************************************/
+void mips_sim_restore(mips_sim_t *sim, const mips_snapshot_t *snap) {
+    mips_sim_select(sim);
+    /* only pages that changed since are remapped (and their decoded instructions dropped) */
+    mem_restore(&snap->mem);
+    CURRENT_STATE = snap->state;
+    RUN_FLAG = snap->run_flag;
+    INSTRUCTION_COUNT = snap->instruction_count;
+    PROGRAM_SIZE = snap->program_size;
+    prevInstruction = snap->prev_instruction;
+}
+
+void mips_snapshot_free(mips_snapshot_t *snap) {
+    mem_snapshot_free(&snap->mem);
+    free(snap);
+}
+
+/***************************************************************/
+/* Guest memory access from outside the simulator                                                 */
+/***************************************************************/
+uint32_t mips_sim_read_32(mips_sim_t *sim, uint32_t address) {
+    mips_sim_select(sim);
+    return mem_read_32(address);
+}
+
+void mips_sim_write_32(mips_sim_t *sim, uint32_t address, uint32_t value) {
+    mips_sim_select(sim);
+    mem_write_32(address, value);
+}
+
+/***************************************************************/
+/* Execute one cycle                                                                                                              */
+/***************************************************************/
+void cycle() {
+    uint32_t pc = CURRENT_STATE.PC;
+
+    handle_instruction();
+    INSTRUCTION_COUNT++;
+    if (BBV_ACTIVE) {
+        bbv_step(pc, CURRENT_STATE.PC);
+    }
+}
+
+/************************************************************/
+/* trace the instruction about to execute at the current TRACE_LEVEL                        */
+/************************************************************/
+void trace_instruction(uint32_t pc, const decoded_insn_t *d) {
+    uint32_t opcode = (0xFC000000 & d->ins);
+
+    if (TRACE_LEVEL == TRACE_MNEMONIC) {
+        printf("%08x %s\n", pc, OP_NAMES[d->op]);
+        return;
+    }
+    printf("\nInstruction: %08x ", d->ins);
+    printf("\nOpcode: %0x8\n", opcode);
+    if (opcode == 0x00000000) {
+        printf("\nR type instruction\n"
+               "rs : %x\n"
+               "rt : %x\n"
+               "rd : %x\n"
+               "sa : %x\n"
+               "func : %x\n", d->rs, d->rt, d->rd, d->sa, (0x0000003F & d->ins));
+    } else {
+        printf("\nI-type instruction\n"
+               "rs : %x\n"
+               "rt : %x\n"
+               "im : %x\n", d->rs, d->rt, (0x0000FFFF & d->ins));
+    }
+}
+
+/************************************************************/
+/* decode and execute instruction                                                                     */
+/************************************************************/
+void handle_instruction() {
+    /* execute one instruction at a time, updating CURRENT_STATE in place */
+
+    const decoded_insn_t *d = predecode_fetch(CURRENT_STATE.PC);
+    uint32_t rs = d->rs, rt = d->rt, rd = d->rd, sa = d->sa, im = d->imm, target = d->target;
+    uint32_t next_pc = CURRENT_STATE.PC + 0x4;
+
+    TRACE_INSTRUCTION(CURRENT_STATE.PC, d);
+    BTRACE_BEGIN(CURRENT_STATE.PC, d);
+    switch (d->op) {
+        default:
+#define NEXT_STATE CURRENT_STATE
+#define TARGET(op) case OP_##op:
+#define NEXT_INSN() break
+#include "mu-ops.def"
+#undef TARGET
+#undef NEXT_INSN
+#undef NEXT_STATE
+    }
+    CURRENT_STATE.PC = next_pc;
+    BTRACE_END();
+}
@@ -0,0 +1,136 @@
+#ifndef MU_SIM_H
+#define MU_SIM_H
+
+#include <stdint.h>
+
+#include "mu-mem.h"
+#include "mu-decode.h"
+#include "mu-block.h"
+#include "mu-jit.h"
+#include "mu-pipe.h"
+#include "mu-cache.h"
+#include "mu-bpred.h"
+#include "mu-sample.h"
+#include "mu-trace.h"
+#include "mu-load.h"
+
+#define FALSE 0
+#define TRUE  1
+
+#define MIPS_REGS 32
+
+typedef struct CPU_State_Struct {
+
+  uint32_t PC;		                   /* program counter */
+  uint32_t REGS[MIPS_REGS]; /* register file. */
+  uint32_t HI, LO;                          /* special regs for mult/div. */
+} CPU_State;
+
+/* execution engines, selected with the engine command */
+#define ENGINE_INTERP 0 /* cycle() (or the threaded core) one instruction at a time */
+#define ENGINE_BLOCK  1 /* basic-block translation cache */
+#define ENGINE_JIT    2 /* block engine with hot blocks compiled to native code */
+#define ENGINE_PIPE   3 /* cycle() driven through the five-stage pipeline model, which counts cycles */
+
+/******************************************************************************/
+/* Simulator context                                                                                                                                         */
+/******************************************************************************/
+/* everything one guest owns: CPU state, counters, address space and the caches derived from it.
+ * Any number of simulators can live in one process. A thread works on one at a time, the one
+ * mips_sim_select() made current; the engines and mu-ops.def reach it through SIM and the macros
+ * below, which keep the names the single-guest simulator used for its globals.
+ * Tracing (TRACE_LEVEL, btrace) is process-wide and meant for a single guest. */
+typedef struct mips_sim {
+	/* instructions update state in place; there is no separate next state to copy back */
+	CPU_State state;
+	int run_flag;
+	uint32_t instruction_count;
+	uint32_t program_size;          /* in words */
+	uint32_t prev_instruction;      /* function field of the last R-type print_instruction() listed */
+	int engine;                     /* ENGINE_* */
+	char program_file[256];         /* program reloaded by mips_sim_reset() */
+	char load_error[128];           /* what is wrong with the source the last mips_sim_load() failed on */
+	image_info_t program;           /* entry point, segments and symbols of the loaded program */
+	mem_space_t mem;
+	predecode_t decode;
+	block_cache_t blocks;
+	jit_cache_t jit;
+	pipe_t pipe;
+	cache_hierarchy_t caches;       /* configured by the front end; survives loads and resets */
+	bpred_t bpred;                  /* likewise */
+	sample_t sample;                /* likewise */
+} mips_sim_t;
+
+/* machine state captured by mips_sim_snapshot(); memory pages are shared copy-on-write with
+ * the simulator it came from, so a snapshot costs a pointer per allocated page. It can be
+ * restored any number of times, into any simulator, and outlives the one it was taken from. */
+typedef struct mips_snapshot {
+	CPU_State state;
+	int run_flag;
+	uint32_t instruction_count;
+	uint32_t program_size;
+	uint32_t prev_instruction;
+	mem_snapshot_t mem;
+} mips_snapshot_t;
+
+/* the simulator this thread is running */
+extern _Thread_local mips_sim_t *SIM;
+
+#define CURRENT_STATE (SIM->state)
+#define RUN_FLAG (SIM->run_flag)	/* run flag*/
+#define INSTRUCTION_COUNT (SIM->instruction_count)
+#define PROGRAM_SIZE (SIM->program_size)
+#define prevInstruction (SIM->prev_instruction)
+#define SIM_ENGINE (SIM->engine)
+#define prog_file (SIM->program_file)
+
+/* a line of the program's own output (mu-ops.def); jit-verify's replay of instructions the
+ * native code already ran does not print it a second time */
+#define PROGRAM_OUTPUT(text) \
+    do { \
+        if (!JIT_REPLAYING) { \
+            puts(text); \
+        } \
+    } while (0)
+
+/***************************************************************/
+/* Library interface                                                                                                            */
+/***************************************************************/
+/* a new simulator has empty memory, zeroed registers, PC at MEM_TEXT_BEGIN, the block engine and
+ * the default cache hierarchy, branch predictor and sampling, turned off */
+mips_sim_t *mips_sim_new();
+void mips_sim_free(mips_sim_t *sim);
+/* make sim current on the calling thread (the calls below do it themselves) */
+void mips_sim_select(mips_sim_t *sim);
+/* replace memory with a program and restart the CPU at its entry point: an image or an ELF32
+ * MIPS executable (mu-load.h), hex words loaded from MEM_TEXT_BEGIN, which is then the entry
+ * point, or assembly source (mu-asm.h). Returns the number of text words, -1 if path can't be
+ * read or is a broken image or executable (and then nothing changes) or is neither hex words nor
+ * source that assembles (and then memory is left empty and load_error says what is wrong) */
+int mips_sim_load(mips_sim_t *sim, const char *path);
+/* zero the registers, put memory back as the last load left it and restart at the entry point */
+void mips_sim_reset(mips_sim_t *sim);
+/* run up to max_instructions on the selected engine (or sampled, mu-sample.h), stopping at
+ * SYSCALL; returns the number of instructions executed */
+uint32_t mips_sim_run(mips_sim_t *sim, uint32_t max_instructions);
+/* capture registers, counters and memory; restoring puts all of them back, leaving the engine,
+ * the loaded program (what mips_sim_reset() returns to) and cached translations of unchanged
+ * code as they are */
+mips_snapshot_t *mips_sim_snapshot(mips_sim_t *sim);
+void mips_sim_restore(mips_sim_t *sim, const mips_snapshot_t *snap);
+void mips_snapshot_free(mips_snapshot_t *snap);
+uint32_t mips_sim_read_32(mips_sim_t *sim, uint32_t address);
+void mips_sim_write_32(mips_sim_t *sim, uint32_t address, uint32_t value);
+
+/***************************************************************/
+/* Engines (on the current simulator)                                                                            */
+/***************************************************************/
+void cycle();
+void handle_instruction();
+/* mips_sim_run() on the given engine, without sampling */
+uint32_t run_engine(int engine, uint32_t max_instructions);
+
+/* the threaded core is built with -DMU_THREADED_CORE (make CORE=threaded) */
+uint32_t run_threaded(uint32_t max_instructions);
+
+#endif
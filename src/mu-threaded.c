@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mu-sim.h"
+
+/************************************************************/
+/* Direct-threaded interpreter core                                                                        */
+/*                                                                                                                               */
+/* Runs the same handlers as handle_instruction() (mu-ops.def), but every                 */
+/* handler ends by fetching the next decoded instruction and jumping straight to      */
+/* its handler, instead of returning to cycle() and a central switch. Each handler       */
+/* then owns its own indirect jump, which the host branch predictor can learn.        */
+/*                                                                                                                               */
+/* Computed goto is a GCC/Clang extension; other compilers (or -DMU_NO_COMPUTED_GOTO) */
+/* get the same loop built around a switch.                                                          */
+/************************************************************/
+
+#if defined(__GNUC__) && !defined(MU_NO_COMPUTED_GOTO)
+#define USE_COMPUTED_GOTO
+#endif
+
+/* fetch the decoded instruction at CURRENT_STATE.PC and unpack its fields */
+#define FETCH() \
+    do { \
+        d = predecode_fetch(CURRENT_STATE.PC); \
+        rs = d->rs; \
+        rt = d->rt; \
+        rd = d->rd; \
+        sa = d->sa; \
+        im = d->imm; \
+        target = d->target; \
+        next_pc = CURRENT_STATE.PC + 0x4; \
+        TRACE_INSTRUCTION(CURRENT_STATE.PC, d); \
+    } while (0)
+
+/* same bookkeeping as cycle() */
+#define RETIRE() \
+    do { \
+        CURRENT_STATE.PC = next_pc; \
+        INSTRUCTION_COUNT++; \
+        executed++; \
+    } while (0)
+
+/************************************************************/
+/* Execute up to max_instructions, stopping early at SYSCALL                             */
+/* Returns the number of instructions executed.                                                      */
+/************************************************************/
+uint32_t run_threaded(uint32_t max_instructions) {
+    const decoded_insn_t *d;
+    uint32_t rs, rt, rd, sa, im, target, next_pc;
+    uint32_t executed = 0;
+
+    if (max_instructions == 0 || RUN_FLAG == FALSE) {
+        return 0;
+    }
+
+#define NEXT_STATE CURRENT_STATE
+#ifdef USE_COMPUTED_GOTO
+#define OP_LABEL(name, ...) [OP_##name] = &&TARGET_##name,
+    static void *const dispatch_table[NUM_OPS] = {
+        [OP_UNDECODED] = &&TARGET_INVALID,
+        FOR_EACH_OP(OP_LABEL)
+    };
+#undef OP_LABEL
+
+#define TARGET(op) TARGET_##op:
+#define NEXT_INSN() \
+    do { \
+        RETIRE(); \
+        if (executed == max_instructions || RUN_FLAG == FALSE) { \
+            return executed; \
+        } \
+        FETCH(); \
+        goto *dispatch_table[d->op]; \
+    } while (0)
+
+    FETCH();
+    goto *dispatch_table[d->op];
+#include "mu-ops.def"
+
+#else
+#define TARGET(op) case OP_##op:
+#define NEXT_INSN() break
+
+    for (;;) {
+        FETCH();
+        switch (d->op) {
+            default:
+#include "mu-ops.def"
+        }
+        RETIRE();
+        if (executed == max_instructions || RUN_FLAG == FALSE) {
+            return executed;
+        }
+    }
+#endif
+#undef TARGET
+#undef NEXT_INSN
+#undef NEXT_STATE
+}
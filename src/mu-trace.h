@@ -0,0 +1,59 @@
+#ifndef MU_TRACE_H
+#define MU_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mu-decode.h"
+
+/******************************************************************************/
+/* Execution trace                                                                                                                                          */
+/******************************************************************************/
+/* levels, from quiet to verbose:
+ *   TRACE_OFF       nothing
+ *   TRACE_MNEMONIC  one "pc mnemonic" line per instruction
+ *   TRACE_FULL      the decoded fields of every instruction plus the handlers' own lines
+ * MU_TRACE_MAX is the most verbose level compiled in (make TRACE=off|mnemonic, CMake
+ * MU_TRACE_MAX). Trace points above it expand to nothing, so a TRACE=off build has no
+ * tracing code in its hot paths at all. Up to that level, TRACE_LEVEL picks one at runtime
+ * with the trace command. */
+#define TRACE_OFF      0
+#define TRACE_MNEMONIC 1
+#define TRACE_FULL     2
+
+#ifndef MU_TRACE_MAX
+#define MU_TRACE_MAX TRACE_FULL
+#endif
+
+extern int TRACE_LEVEL;
+
+void trace_instruction(uint32_t pc, const decoded_insn_t *d);
+
+#if MU_TRACE_MAX > TRACE_OFF
+/* whether anything is traced at all (the JIT only runs native code when not) */
+#define TRACE_ENABLED() (TRACE_LEVEL != TRACE_OFF)
+/* called before each instruction executes */
+#define TRACE_INSTRUCTION(pc, d) \
+    do { \
+        if (TRACE_LEVEL != TRACE_OFF) { \
+            trace_instruction(pc, d); \
+        } \
+    } while (0)
+#else
+#define TRACE_ENABLED() 0
+#define TRACE_INSTRUCTION(pc, d) ((void) 0)
+#endif
+
+#if MU_TRACE_MAX >= TRACE_FULL
+/* a handler's line of the full trace */
+#define TRACE_HANDLER(text) \
+    do { \
+        if (TRACE_LEVEL >= TRACE_FULL) { \
+            puts(text); \
+        } \
+    } while (0)
+#else
+#define TRACE_HANDLER(text) ((void) 0)
+#endif
+
+#endif